@@ -2,4 +2,6 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image_write.h"
\ No newline at end of file
+#include "stb_image_write.h"
+#define STB_DXT_IMPLEMENTATION
+#include "stb_dxt.h"
@@ -1,13 +1,26 @@
+#include <algorithm>
+
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
 
 #include "application.h"
+#include "obj_loader.h"
+#include "mesh_optimizer.h"
+#include "geometry_arena.h"
+#include "instance_batch.h"
+#include "render_queue.h"
+#include "static_batch.h"
+#include "vertex_format.h"
+#include "./base/gl_state.h"
+#include "./base/glsl_program.h"
 #include "scene_roaming.h"
 #include "whack_moles.h"
 
 Application::Application(const Options& options)
-	: _clearColor(options.backgroundColor) {
+	: _clearColor(options.backgroundColor),
+	  _uploadBudgetMs(options.uploadBudgetMs),
+	  _stageMemoryBudget(options.stageMemoryBudget) {
 	// window
 	_window.reset(new Window({
 		options.glVersion,
@@ -31,9 +44,12 @@ Application::Application(const Options& options)
 	glViewport(0, 0, _window->getWidth(), _window->getHeight());
 
 	if (options.msaa) {
-		glEnable(GL_MULTISAMPLE);
+		GLState::getInstance().enable(GL_MULTISAMPLE);
 	}
 
+	// filter across cubemap face edges, visible once the skybox is mipmapped
+	GLState::getInstance().enable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
 	// callback functions
 	glfwSetFramebufferSizeCallback(_window->getHandle(), framebufferResizeCallback);
 	glfwSetKeyCallback(_window->getHandle(), keyboardCallback);
@@ -44,6 +60,62 @@ Application::Application(const Options& options)
 	// time stamp
 	_lastTimeStamp = std::chrono::high_resolution_clock::now();
 
+	// obj loader
+	ObjLoadOptions objLoadOptions;
+	objLoadOptions.numThreads = options.objLoaderThreads;
+	SetDefaultObjLoadOptions(objLoadOptions);
+
+	// mesh optimization
+	MeshOptimizeOptions meshOptimizeOptions;
+	meshOptimizeOptions.vertexCache = options.meshOptimize;
+	meshOptimizeOptions.vertexFetch = options.meshOptimize;
+	meshOptimizeOptions.overdraw = options.meshOptimize && options.overdrawOrder;
+	meshOptimizeOptions.lodLevels = std::max(options.lodLevels, 1);
+	SetDefaultMeshOptimizeOptions(meshOptimizeOptions);
+
+	// vertex format
+	VertexFormatOptions vertexFormatOptions;
+	vertexFormatOptions.packed = options.vertexPacking;
+	vertexFormatOptions.quantizePositions = options.vertexPacking && options.quantizePositions;
+	vertexFormatOptions.shortIndices = options.vertexPacking;
+	SetDefaultVertexFormatOptions(vertexFormatOptions);
+
+	// textures
+	TextureOptions textureOptions;
+	textureOptions.anisotropy = options.textureAnisotropy;
+	textureOptions.cpuMipmaps = !options.gpuMipmaps;
+	textureOptions.compress = options.textureCompression;
+	SetDefaultTextureOptions(textureOptions);
+
+	// shader program binaries
+	ProgramCacheOptions programCacheOptions;
+	programCacheOptions.enabled = options.shaderCache;
+	SetDefaultProgramCacheOptions(programCacheOptions);
+	if (options.shaderCache && !SupportsProgramBinary()) {
+		std::cout << "program binaries are not supported, shaders compile on every launch" << std::endl;
+	}
+
+	// instancing
+	InstancingOptions instancingOptions;
+	instancingOptions.enabled = options.instancing;
+	instancingOptions.stressInstances = std::max(options.stressInstances, 0);
+	SetDefaultInstancingOptions(instancingOptions);
+
+	// multi draw, the path is chosen by what the context supports
+	MultiDrawOptions multiDrawOptions;
+	multiDrawOptions.enabled = options.multiDraw;
+	multiDrawOptions.indirect = options.indirectDraw;
+	SetDefaultMultiDrawOptions(multiDrawOptions);
+	std::cout << "submit path: " << GetMultiDrawPathName(ChooseMultiDrawPath(multiDrawOptions)) << std::endl;
+
+	// static batching
+	StaticBatchOptions staticBatchOptions;
+	staticBatchOptions.enabled = options.staticBatching;
+	SetDefaultStaticBatchOptions(staticBatchOptions);
+
+	// asset loader
+	_assetLoader.reset(new AssetLoader(options.assetLoaderThreads));
+
 	// init imgui
 	IMGUI_CHECKVERSION();
 	ImGui::CreateContext();
@@ -51,11 +123,15 @@ Application::Application(const Options& options)
 	ImGui_ImplGlfw_InitForOpenGL(_window->getHandle(), true);
 	ImGui_ImplOpenGL3_Init();
 
-	// init stages
-	_stages.emplace_back(new SceneRoaming);
-	_stages.emplace_back(new WhackMoles);
+	// init stages, the window shows while the assets stream in and the
+	// inactive stage is preloaded by updateStages()
+	_stages.resize(2);
+	_stages[0].stage.reset(new SceneRoaming);
+	_stages[1].stage.reset(new WhackMoles);
 
-	_stages[_activeStageIndex]->init(*_window, _mouseInput);
+	loadStage(_activeStageIndex);
+	_stages[_activeStageIndex].stage->activate(*_window, _mouseInput);
+	_stages[_activeStageIndex].state = StageState::Active;
 
 	std::cout << "Application Address: " << this << std::endl;
 } 
@@ -70,6 +146,7 @@ Application::~Application() {
 void Application::run() {
 	while (!_window->shouldClose()) {
 		updateTime();
+		updateStages();
 		handleInput();
 		renderFrame();
 
@@ -149,17 +226,120 @@ void Application::keyboardCallback(GLFWwindow* window, int key, int scancode, in
 void Application::handleInput() {
 	//std::cout << _keyboardInput.keyStates[GLFW_KEY_ENTER] << std::endl;
 	if (_keyboardInput.keyStates[GLFW_KEY_ENTER] != GLFW_RELEASE) {
-		std::cout << "switch stage" << std::endl;
-		_stages[_activeStageIndex]->deinit();
-		_activeStageIndex ^= 1;
-		_stages[_activeStageIndex]->init(*_window, _mouseInput);
+		switchStage(_activeStageIndex ^ 1);
 
 		_keyboardInput.keyStates[GLFW_KEY_ENTER] = GLFW_RELEASE;
 	}
 
-	_stages[_activeStageIndex]->handleInput(*_window, _keyboardInput, _mouseInput, _deltaTime);
+	_stages[_activeStageIndex].stage->handleInput(*_window, _keyboardInput, _mouseInput, _deltaTime);
 }
 
 void Application::renderFrame() {
-	_stages[_activeStageIndex]->renderFrame();
+	// assets uploaded and deleted since the last frame changed the bindings
+	GLState::getInstance().beginFrame();
+	_stages[_activeStageIndex].stage->renderFrame();
+}
+
+void Application::updateStages() {
+	_assetLoader->update(_uploadBudgetMs);
+
+	for (int i = 0; i < static_cast<int>(_stages.size()); ++i) {
+		StageSlot& slot = _stages[i];
+
+		// preload an inactive stage once the active one is complete, unless it
+		// is known not to fit
+		if (slot.state == StageState::Unloaded && _stages[_activeStageIndex].resident &&
+			getResidentBytes() + slot.residentBytes <= _stageMemoryBudget) {
+			loadStage(i);
+		}
+
+		if (slot.state != StageState::Unloaded && !slot.resident && slot.stage->updateAssets()) {
+			slot.resident = true;
+			slot.residentBytes = slot.stage->getResidentBytes();
+
+			auto now = std::chrono::high_resolution_clock::now();
+			std::cout << "stage " << i << " resident: " << slot.residentBytes / 1024 << " KB in "
+				<< std::chrono::duration<double, std::milli>(now - slot.loadTimeStamp).count() << " ms" << std::endl;
+
+			enforceMemoryBudget();
+		}
+	}
+}
+
+void Application::loadStage(int index) {
+	StageSlot& slot = _stages[index];
+	if (slot.state != StageState::Unloaded) {
+		return;
+	}
+
+	slot.loadTimeStamp = std::chrono::high_resolution_clock::now();
+	const ProgramCacheStats shadersBefore = GetProgramCacheStats();
+	slot.stage->load(*_window, *_assetLoader);
+	slot.state = StageState::Loaded;
+	slot.resident = false;
+
+	const ProgramCacheStats& shaders = GetProgramCacheStats();
+	std::cout << "load stage " << index << " shaders: "
+		<< shaders.compiled - shadersBefore.compiled << " compiled in "
+		<< shaders.compileMs - shadersBefore.compileMs << " ms, "
+		<< shaders.cached - shadersBefore.cached << " from cache in "
+		<< shaders.cacheMs - shadersBefore.cacheMs << " ms" << std::endl;
+}
+
+void Application::unloadStage(int index) {
+	StageSlot& slot = _stages[index];
+	slot.stage->unload();
+	slot.state = StageState::Unloaded;
+	slot.resident = false;
+
+	std::cout << "unload stage " << index << ": " << slot.residentBytes / 1024 << " KB" << std::endl;
+
+	// the stage's meshes left holes in the geometry arena
+	const int moved = GeometryArena::getInstance().defragment();
+	if (moved > 0) {
+		std::cout << "defragment geometry arena: " << moved << " ranges moved" << std::endl;
+	}
+}
+
+void Application::switchStage(int index) {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// a stage that was not preloaded streams in while it is shown
+	loadStage(index);
+
+	_stages[_activeStageIndex].stage->deactivate();
+	_stages[_activeStageIndex].state = StageState::Loaded;
+
+	_stages[index].stage->activate(*_window, _mouseInput);
+	_stages[index].state = StageState::Active;
+	_activeStageIndex = index;
+
+	auto now = std::chrono::high_resolution_clock::now();
+	std::cout << "switch to stage " << index << " in "
+		<< std::chrono::duration<double, std::milli>(now - start).count() << " ms" << std::endl;
+
+	enforceMemoryBudget();
+}
+
+size_t Application::getResidentBytes() const {
+	size_t bytes = 0;
+	for (const auto& slot : _stages) {
+		if (slot.state != StageState::Unloaded) {
+			bytes += slot.stage->getResidentBytes();
+		}
+	}
+	return bytes;
+}
+
+void Application::enforceMemoryBudget() {
+	// the active stage always stays, inactive ones are evicted until it fits
+	for (int i = 0; i < static_cast<int>(_stages.size()); ++i) {
+		if (getResidentBytes() <= _stageMemoryBudget) {
+			break;
+		}
+
+		if (_stages[i].state == StageState::Loaded) {
+			unloadStage(i);
+		}
+	}
 }
\ No newline at end of file
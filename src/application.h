@@ -4,6 +4,7 @@
 #include <string>
 #include <stdexcept>
 #include <memory>
+#include <vector>
 
 #include <glm/glm.hpp>
 
@@ -11,6 +12,7 @@
 #include "./base/input.h"
 #include "./base/frame_rate_indicator.h"
 #include "./base/stage.h"
+#include "asset_loader.h"
 
 struct Options {
 	std::string windowTitle;
@@ -21,6 +23,24 @@ struct Options {
 	bool msaa;
 	std::pair<int, int> glVersion;
 	glm::vec4 backgroundColor;
+	int objLoaderThreads;
+	bool meshOptimize;
+	bool overdrawOrder;
+	int lodLevels;
+	bool vertexPacking;
+	bool quantizePositions;
+	int assetLoaderThreads;
+	double uploadBudgetMs;
+	float textureAnisotropy;
+	bool gpuMipmaps;
+	bool textureCompression;
+	bool shaderCache;
+	bool instancing;
+	int stressInstances;
+	bool multiDraw;
+	bool indirectDraw;
+	bool staticBatching;
+	size_t stageMemoryBudget;
 };
 
 class Application {
@@ -51,10 +71,27 @@ private:
 	/* clear color */
 	glm::vec4 _clearColor = glm::vec4(0.6f, 0.6f, 0.6f, 1.0f);
 
+	/* assets stream in through the loader, uploaded within a per frame budget */
+	std::unique_ptr<AssetLoader> _assetLoader;
+	double _uploadBudgetMs;
+
 	/* stages */
-	std::vector <std::unique_ptr<Stage>> _stages;
+	struct StageSlot {
+		std::unique_ptr<Stage> stage;
+		StageState state = StageState::Unloaded;
+		// every asset of the stage is resident
+		bool resident = false;
+		std::chrono::time_point<std::chrono::high_resolution_clock> loadTimeStamp;
+		// measured when the stage became resident, 0 if it never was
+		size_t residentBytes = 0;
+	};
+
+	std::vector<StageSlot> _stages;
 	int _activeStageIndex = 0;
 
+	// gpu memory the loaded stages may keep resident, the active one included
+	size_t _stageMemoryBudget;
+
 private:
 	void updateTime();
 
@@ -62,6 +99,18 @@ private:
 
 	void renderFrame();
 
+	void updateStages();
+
+	void loadStage(int index);
+
+	void unloadStage(int index);
+
+	void switchStage(int index);
+
+	size_t getResidentBytes() const;
+
+	void enforceMemoryBudget();
+
 	void showFpsInWindowTitle();
 
 	static void framebufferResizeCallback(GLFWwindow* window, int width, int height);
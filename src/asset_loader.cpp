@@ -0,0 +1,267 @@
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <optional>
+
+#include "./base/compressed_image.h"
+
+#include "mesh_registry.h"
+#include "asset_loader.h"
+
+namespace {
+	// the key of a texture names its files and sampling, a cubemap lists its six faces
+	std::string getTextureKey(
+		const std::string& kind, const std::vector<std::string>& paths, const TextureOptions& options) {
+		std::string key = kind;
+		for (const auto& path : paths) {
+			key += ":" + path;
+		}
+		key += ":" + std::to_string(static_cast<int>(options.filter)) +
+			":" + std::to_string(options.anisotropy) +
+			":" + std::to_string(options.cpuMipmaps) +
+			":" + std::to_string(options.compress);
+		return key;
+	}
+
+	// the cached blocks of an image, compressed from the source and cached on a miss;
+	// the chain always goes down to 1x1 so one cache entry serves every filter
+	CompressedImage loadCompressedImage(const std::string& path) {
+		try {
+			return CompressedImage(path);
+		}
+		catch (const std::exception& e) {
+			std::cout << e.what() << ", compress from image" << std::endl;
+		}
+
+		CompressedImage image(ImageData(path, true));
+		image.save();
+		return image;
+	}
+}
+
+AssetLoader::AssetLoader(int numThreads) : _pool(numThreads) { }
+
+AssetHandle<const Mesh> AssetLoader::loadMesh(const std::string& path) {
+	if (std::shared_ptr<const Mesh> mesh = MeshRegistry::getInstance().find(path)) {
+		return makeReadyHandle(mesh);
+	}
+
+	return load<const Mesh, MeshData>("mesh:" + path,
+		{ [path]() { return MeshData(path); } },
+		[](const std::vector<MeshData>& data) { return MeshRegistry::getInstance().acquire(data[0]); });
+}
+
+AssetHandle<Texture2D> AssetLoader::loadTexture(const std::string& path, const TextureOptions& options) {
+	const std::string key = getTextureKey("texture2d", { path }, options);
+	const bool mipmaps = options.usesMipmaps() && options.cpuMipmaps;
+	AssetHandle<Texture2D> handle = findTexture<Texture2D>(key);
+	if (handle._state != nullptr) {
+		return handle;
+	}
+
+	if (options.compress && SupportsTextureCompression()) {
+		return load<Texture2D, CompressedImage>(key,
+			{ [path]() { return loadCompressedImage(path); } },
+			[this, key, options](const std::vector<CompressedImage>& images) {
+				std::shared_ptr<Texture2D> texture = std::make_shared<Texture2D>(images[0], options);
+				_textures[key] = texture;
+				return texture;
+			});
+	}
+
+	return load<Texture2D, ImageData>(key,
+		{ [path, mipmaps]() { return ImageData(path, mipmaps); } },
+		[this, key, options](const std::vector<ImageData>& images) {
+			std::shared_ptr<Texture2D> texture = std::make_shared<Texture2D>(images[0], options);
+			_textures[key] = texture;
+			return texture;
+		});
+}
+
+AssetHandle<TextureCubemap> AssetLoader::loadCubemap(
+	const std::vector<std::string>& paths, const TextureOptions& options) {
+	const std::string key = getTextureKey("cubemap", paths, options);
+	const bool mipmaps = options.usesMipmaps() && options.cpuMipmaps;
+	AssetHandle<TextureCubemap> handle = findTexture<TextureCubemap>(key);
+	if (handle._state != nullptr) {
+		return handle;
+	}
+
+	if (options.compress && SupportsTextureCompression()) {
+		std::vector<std::function<CompressedImage()>> decodes;
+		for (const auto& path : paths) {
+			decodes.push_back([path]() { return loadCompressedImage(path); });
+		}
+
+		return load<TextureCubemap, CompressedImage>(key, std::move(decodes),
+			[this, key, options](const std::vector<CompressedImage>& faces) {
+				std::shared_ptr<TextureCubemap> texture = std::make_shared<TextureCubemap>(faces, options);
+				_textures[key] = texture;
+				return texture;
+			});
+	}
+
+	std::vector<std::function<ImageData()>> decodes;
+	for (const auto& path : paths) {
+		decodes.push_back([path, mipmaps]() { return ImageData(path, mipmaps); });
+	}
+
+	return load<TextureCubemap, ImageData>(key, std::move(decodes),
+		[this, key, options](const std::vector<ImageData>& faces) {
+			std::shared_ptr<TextureCubemap> texture = std::make_shared<TextureCubemap>(faces, options);
+			_textures[key] = texture;
+			return texture;
+		});
+}
+
+void AssetLoader::update(double budgetMs) {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	for (;;) {
+		std::function<void()> upload;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (_uploads.empty()) {
+				break;
+			}
+			upload = std::move(_uploads.front());
+			_uploads.pop_front();
+		}
+
+		upload();
+		--_pendingCount;
+
+		auto now = std::chrono::high_resolution_clock::now();
+		if (std::chrono::duration<double, std::milli>(now - start).count() >= budgetMs) {
+			break;
+		}
+	}
+}
+
+size_t AssetLoader::getPendingCount() const {
+	return _pendingCount;
+}
+
+template <typename T, typename Data>
+AssetHandle<T> AssetLoader::load(
+	const std::string& key,
+	std::vector<std::function<Data()>> decodes,
+	std::function<std::shared_ptr<T>(const std::vector<Data>&)> upload) {
+	using State = typename AssetHandle<T>::State;
+
+	// join a load of the same asset that is still in flight
+	removeExpired();
+	auto it = _requests.find(key);
+	if (it != _requests.end()) {
+		AssetHandle<T> handle;
+		handle._state = std::static_pointer_cast<State>(it->second.lock());
+		return handle;
+	}
+
+	AssetHandle<T> handle;
+	handle._state = std::make_shared<State>();
+	_requests[key] = handle._state;
+	++_pendingCount;
+
+	// the parts decode in parallel, the last one to finish queues the upload
+	struct Batch {
+		std::shared_ptr<State> state;
+		std::function<std::shared_ptr<T>(const std::vector<Data>&)> upload;
+		std::vector<std::optional<Data>> parts;
+		std::atomic<size_t> remaining;
+		std::mutex mutex;
+		std::exception_ptr error;
+	};
+
+	auto batch = std::make_shared<Batch>();
+	batch->state = handle._state;
+	batch->upload = std::move(upload);
+	batch->parts.resize(decodes.size());
+	batch->remaining = decodes.size();
+
+	for (size_t i = 0; i < decodes.size(); ++i) {
+		_pool.submit(std::packaged_task<void()>([this, batch, i, decode = std::move(decodes[i])]() {
+			try {
+				batch->parts[i].emplace(decode());
+			}
+			catch (...) {
+				std::lock_guard<std::mutex> lock(batch->mutex);
+				batch->error = std::current_exception();
+			}
+
+			if (--batch->remaining != 0) {
+				return;
+			}
+
+			// errors are handed to the gl thread with the data
+			auto data = std::make_shared<std::vector<Data>>();
+			if (!batch->error) {
+				for (auto& part : batch->parts) {
+					data->push_back(std::move(*part));
+				}
+			}
+
+			std::lock_guard<std::mutex> lock(_mutex);
+			_uploads.push_back(
+				[state = std::move(batch->state), upload = std::move(batch->upload), data, error = batch->error]() {
+				// nobody holds a handle any more, skip the upload
+				if (state.use_count() == 1) {
+					return;
+				}
+
+				if (error) {
+					state->error = error;
+				}
+				else {
+					try {
+						state->asset = upload(*data);
+					}
+					catch (...) {
+						state->error = std::current_exception();
+					}
+				}
+				state->ready = true;
+			});
+		}));
+	}
+
+	return handle;
+}
+
+template <typename T>
+AssetHandle<T> AssetLoader::findTexture(const std::string& key) {
+	auto it = _textures.find(key);
+	if (it != _textures.end()) {
+		if (std::shared_ptr<Texture> texture = it->second.lock()) {
+			return makeReadyHandle(std::static_pointer_cast<T>(texture));
+		}
+	}
+	return AssetHandle<T>();
+}
+
+template <typename T>
+AssetHandle<T> AssetLoader::makeReadyHandle(std::shared_ptr<T> asset) {
+	AssetHandle<T> handle;
+	handle._state = std::make_shared<typename AssetHandle<T>::State>();
+	handle._state->asset = std::move(asset);
+	handle._state->ready = true;
+	return handle;
+}
+
+void AssetLoader::removeExpired() {
+	for (auto it = _requests.begin(); it != _requests.end();) {
+		if (it->second.expired()) {
+			it = _requests.erase(it);
+		} else {
+			++it;
+		}
+	}
+
+	for (auto it = _textures.begin(); it != _textures.end();) {
+		if (it->second.expired()) {
+			it = _textures.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "./base/texture.h"
+#include "./base/thread_pool.h"
+#include "mesh.h"
+
+// Handle to an asset loading in the background, empty until the asset is
+// resident on the gpu. Copies refer to the same asset. Only use it on the
+// gl thread.
+template <typename T>
+class AssetHandle {
+public:
+	AssetHandle() = default;
+
+	// true once the load has finished, successfully or not
+	bool isReady() const {
+		return _state != nullptr && _state->ready;
+	}
+
+	// the resident asset or null, rethrows the error of a failed load
+	std::shared_ptr<T> get() const {
+		if (!isReady()) {
+			return nullptr;
+		}
+		if (_state->error) {
+			std::rethrow_exception(_state->error);
+		}
+		return _state->asset;
+	}
+
+private:
+	struct State {
+		std::shared_ptr<T> asset;
+		std::exception_ptr error;
+		bool ready = false;
+	};
+
+	std::shared_ptr<State> _state;
+
+	friend class AssetLoader;
+};
+
+// Loads assets without stalling the render loop. The cpu work (obj parsing,
+// vertex deduplication, image decoding) runs on a thread pool, the decoded
+// data is queued back and update() uploads it on the gl thread within a per
+// frame time budget. Requests for an asset that is loading or resident share
+// it instead of loading it again.
+class AssetLoader {
+public:
+	// 0 threads for one per core
+	AssetLoader(int numThreads = 0);
+
+	AssetLoader(const AssetLoader&) = delete;
+
+	~AssetLoader() = default;
+
+	// meshes go through the mesh registry, a mesh already alive is ready at once
+	AssetHandle<const Mesh> loadMesh(const std::string& path);
+
+	// the mip chain is built on the worker as part of decoding; compressed
+	// textures are read from the block cache and skip decoding when it is warm
+	AssetHandle<Texture2D> loadTexture(
+		const std::string& path,
+		const TextureOptions& options = GetDefaultTextureOptions());
+
+	// faces in the order +x, -x, +y, -y, +z, -z, decoded in parallel
+	AssetHandle<TextureCubemap> loadCubemap(
+		const std::vector<std::string>& paths,
+		const TextureOptions& options = GetDefaultTextureOptions());
+
+	// upload decoded assets until budgetMs is spent, at least one per call
+	void update(double budgetMs);
+
+	// requested assets that are not resident yet
+	size_t getPendingCount() const;
+
+private:
+	// only touched on the gl thread
+	size_t _pendingCount = 0;
+
+	std::mutex _mutex;
+	std::deque<std::function<void()>> _uploads;
+
+	// assets still loading by key, their handle states
+	std::unordered_map<std::string, std::weak_ptr<void>> _requests;
+
+	// resident textures by key, the texture cache; the key holds the sampling
+	// options as well, so differently filtered copies do not collide
+	std::unordered_map<std::string, std::weak_ptr<Texture>> _textures;
+
+	// declared last so that the workers stop before the upload queue goes away
+	ThreadPool _pool;
+
+	// decode the parts of an asset as separate tasks, the upload gets them all
+	template <typename T, typename Data>
+	AssetHandle<T> load(
+		const std::string& key,
+		std::vector<std::function<Data()>> decodes,
+		std::function<std::shared_ptr<T>(const std::vector<Data>&)> upload);
+
+	template <typename T>
+	AssetHandle<T> findTexture(const std::string& key);
+
+	template <typename T>
+	static AssetHandle<T> makeReadyHandle(std::shared_ptr<T> asset);
+
+	void removeExpired();
+};
@@ -13,15 +13,7 @@ glm::mat4 PerspectiveCamera::getProjectionMatrix() const {
 }
 
 Frustum PerspectiveCamera::getFrustum() const {
-	Frustum frustum;
-	// TODO: construct the frustum with the position and orientation of the camera
-	// Note: this is for Bonus project 'Frustum Culling'
-	// write your code here
-	// ----------------------------------------------------------------------
-	// ...
-	// ----------------------------------------------------------------------
-
-	return frustum;
+	return Frustum::fromMatrix(getProjectionMatrix() * getViewMatrix());
 }
 
 OrthographicCamera::OrthographicCamera(
@@ -41,9 +33,9 @@ Frustum OrthographicCamera::getFrustum() const {
 	// all of the plane normal points inside the frustum, maybe it's a convention
 	frustum.planes[Frustum::NearFace] = { position + znear * fv, fv };
 	frustum.planes[Frustum::FarFace] = { position + zfar * fv, -fv };
-	frustum.planes[Frustum::LeftFace] = { position - right * rv , rv };
+	frustum.planes[Frustum::LeftFace] = { position + left * rv , rv };
 	frustum.planes[Frustum::RightFace] = { position + right * rv , -rv };
-	frustum.planes[Frustum::BottomFace] = { position - bottom * uv , uv };
+	frustum.planes[Frustum::BottomFace] = { position + bottom * uv , uv };
 	frustum.planes[Frustum::TopFace] = { position + top * uv , -uv };
 
 	return frustum;
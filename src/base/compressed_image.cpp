@@ -0,0 +1,298 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include <stb_dxt.h>
+
+#include "hash.h"
+#include "file_stamp.h"
+#include "thread_pool.h"
+#include "compressed_image.h"
+
+namespace {
+	const std::string cacheDirectory = "./cache/textures/";
+
+	constexpr char kMagic[4] = { 'B', 'C', 'T', 'X' };
+	constexpr uint32_t kVersion = 1;
+	constexpr uint64_t kAlignment = 16;
+
+	struct Header {
+		char magic[4];
+		uint32_t version;
+		uint32_t format;
+		uint32_t levelCount;
+		uint32_t pathLength;
+		uint32_t reserved;
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		uint64_t sourceHash;
+		uint64_t payloadHash;
+	};
+
+	// followed by the path, the blocks of every level start aligned
+	struct LevelEntry {
+		uint32_t width;
+		uint32_t height;
+		uint64_t offset;
+		uint64_t size;
+	};
+
+	uint64_t alignUp(uint64_t offset) {
+		return (offset + kAlignment - 1) / kAlignment * kAlignment;
+	}
+
+	size_t getBlockBytes(BlockFormat format) {
+		return format == BlockFormat::BC1 ? 8 : 16;
+	}
+
+	size_t getLevelSize(int width, int height, BlockFormat format) {
+		return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * getBlockBytes(format);
+	}
+
+	bool hasAlpha(const ImageData& image) {
+		if (image.getChannels() != 4) {
+			return false;
+		}
+
+		const unsigned char* pixels = image.getPixels();
+		const size_t count = static_cast<size_t>(image.getWidth()) * image.getHeight();
+		for (size_t i = 0; i < count; ++i) {
+			if (pixels[i * 4 + 3] != 255) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// expand a 4x4 block to rgba, texels past the edge repeat the last one;
+	// a single channel image stays in red like its GL_RED upload
+	void fetchBlock(const ImageData& image, int level, int blockX, int blockY, unsigned char rgba[64]) {
+		const int width = image.getWidth(level);
+		const int height = image.getHeight(level);
+		const int channels = image.getChannels();
+		const unsigned char* pixels = image.getPixels(level);
+
+		for (int y = 0; y < 4; ++y) {
+			const int sy = std::min(blockY * 4 + y, height - 1);
+			for (int x = 0; x < 4; ++x) {
+				const int sx = std::min(blockX * 4 + x, width - 1);
+				const unsigned char* texel = pixels + (static_cast<size_t>(sy) * width + sx) * channels;
+				unsigned char* out = rgba + (y * 4 + x) * 4;
+				out[0] = texel[0];
+				out[1] = channels >= 3 ? texel[1] : 0;
+				out[2] = channels >= 3 ? texel[2] : 0;
+				out[3] = channels == 4 ? texel[3] : 255;
+			}
+		}
+	}
+}
+
+CompressedImage::CompressedImage(const std::string& imagePath)
+	: _path(imagePath), _file(new MappedFile(getCachePath(imagePath))) {
+	const char* data = _file->getData();
+	const size_t size = _file->getSize();
+
+	Header header;
+	if (size < sizeof(Header)) {
+		throw std::runtime_error("texture cache of " + imagePath + " is truncated");
+	}
+	std::memcpy(&header, data, sizeof(Header));
+
+	if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+		header.version != kVersion ||
+		(header.format != static_cast<uint32_t>(BlockFormat::BC1) &&
+		 header.format != static_cast<uint32_t>(BlockFormat::BC3))) {
+		throw std::runtime_error("texture cache of " + imagePath + " has an incompatible format");
+	}
+	_format = static_cast<BlockFormat>(header.format);
+
+	const uint64_t entriesEnd = sizeof(Header) + header.levelCount * sizeof(LevelEntry);
+	if (header.levelCount == 0 || header.levelCount > 32 || entriesEnd + header.pathLength > size) {
+		throw std::runtime_error("texture cache of " + imagePath + " is truncated");
+	}
+
+	if (header.pathLength != imagePath.size() ||
+		std::memcmp(data + entriesEnd, imagePath.data(), imagePath.size()) != 0) {
+		throw std::runtime_error("texture cache of " + imagePath + " belongs to another file");
+	}
+
+	for (uint32_t i = 0; i < header.levelCount; ++i) {
+		LevelEntry entry;
+		std::memcpy(&entry, data + sizeof(Header) + i * sizeof(LevelEntry), sizeof(LevelEntry));
+		if (entry.offset % kAlignment != 0 || entry.offset + entry.size > size ||
+			entry.size != getLevelSize(entry.width, entry.height, _format)) {
+			throw std::runtime_error("texture cache of " + imagePath + " is corrupt");
+		}
+		_levels.push_back({ static_cast<int>(entry.width), static_cast<int>(entry.height),
+			static_cast<size_t>(entry.offset), static_cast<size_t>(entry.size) });
+	}
+
+	// stale if the source changed, the cheap checks go first
+	const FileStamp source = GetFileStamp(imagePath);
+	if (header.sourceSize != source.size || header.sourceTime != source.time ||
+		header.sourceHash != GetFileHash(imagePath)) {
+		throw std::runtime_error("texture cache of " + imagePath + " is stale");
+	}
+
+	const size_t payloadBegin = _levels.front().offset;
+	const size_t payloadEnd = _levels.back().offset + _levels.back().size;
+	if (payloadEnd < payloadBegin ||
+		header.payloadHash != hashBytes(data + payloadBegin, payloadEnd - payloadBegin)) {
+		throw std::runtime_error("texture cache of " + imagePath + " is corrupt");
+	}
+
+	_data = reinterpret_cast<const unsigned char*>(data);
+}
+
+CompressedImage::CompressedImage(const ImageData& image, int numThreads)
+	: _path(image.getPath()),
+	  _format(hasAlpha(image) ? BlockFormat::BC3 : BlockFormat::BC1) {
+	if (image.getChannels() != 1 && image.getChannels() != 3 && image.getChannels() != 4) {
+		throw std::runtime_error("unsupported format");
+	}
+
+	// lay the levels out back to back, aligned like the cache file
+	size_t offset = 0;
+	for (int level = 0; level < image.getLevelCount(); ++level) {
+		const int width = image.getWidth(level);
+		const int height = image.getHeight(level);
+		_levels.push_back({ width, height, offset, getLevelSize(width, height, _format) });
+		offset = alignUp(offset + _levels.back().size);
+	}
+	_blocks.resize(offset);
+
+	// a row of blocks is the unit of work, rows of every level share one queue
+	std::vector<std::pair<int, int>> rows;
+	for (int level = 0; level < image.getLevelCount(); ++level) {
+		for (int row = 0; row < (_levels[level].height + 3) / 4; ++row) {
+			rows.emplace_back(level, row);
+		}
+	}
+
+	const size_t blockBytes = getBlockBytes(_format);
+	const int alpha = _format == BlockFormat::BC3 ? 1 : 0;
+	// on the asset loader's pool when the image decodes in one of its tasks,
+	// so the faces of a cubemap share the workers instead of each starting threads
+	ParallelFor(rows.size(), numThreads, [&](size_t i) {
+		unsigned char rgba[64];
+		const Level& level = _levels[rows[i].first];
+		const int blocksPerRow = (level.width + 3) / 4;
+		unsigned char* out = _blocks.data() + level.offset + rows[i].second * blocksPerRow * blockBytes;
+		for (int x = 0; x < blocksPerRow; ++x) {
+			fetchBlock(image, rows[i].first, x, rows[i].second, rgba);
+			stb_compress_dxt_block(out + x * blockBytes, rgba, alpha, STB_DXT_HIGHQUAL);
+		}
+	});
+
+	_data = _blocks.data();
+}
+
+const std::string& CompressedImage::getPath() const {
+	return _path;
+}
+
+BlockFormat CompressedImage::getFormat() const {
+	return _format;
+}
+
+int CompressedImage::getLevelCount() const {
+	return static_cast<int>(_levels.size());
+}
+
+int CompressedImage::getWidth(int level) const {
+	return _levels[level].width;
+}
+
+int CompressedImage::getHeight(int level) const {
+	return _levels[level].height;
+}
+
+const unsigned char* CompressedImage::getData(int level) const {
+	return _data + _levels[level].offset;
+}
+
+size_t CompressedImage::getSize(int level) const {
+	return _levels[level].size;
+}
+
+size_t CompressedImage::getBytes() const {
+	size_t bytes = 0;
+	for (const auto& level : _levels) {
+		bytes += level.size;
+	}
+	return bytes;
+}
+
+bool CompressedImage::save() const {
+	const std::string cachePath = getCachePath(_path);
+	const std::string tempPath = cachePath + ".tmp";
+
+	try {
+		std::filesystem::create_directories(cacheDirectory);
+
+		const FileStamp source = GetFileStamp(_path);
+		const uint64_t payloadOffset = alignUp(
+			sizeof(Header) + _levels.size() * sizeof(LevelEntry) + _path.size());
+		const size_t payloadSize = _levels.back().offset + _levels.back().size;
+
+		Header header = {};
+		std::memcpy(header.magic, kMagic, sizeof(kMagic));
+		header.version = kVersion;
+		header.format = static_cast<uint32_t>(_format);
+		header.levelCount = static_cast<uint32_t>(_levels.size());
+		header.pathLength = static_cast<uint32_t>(_path.size());
+		header.sourceSize = source.size;
+		header.sourceTime = source.time;
+		header.sourceHash = GetFileHash(_path);
+		header.payloadHash = hashBytes(_data + _levels.front().offset, payloadSize - _levels.front().offset);
+
+		// write to a temporary file and rename it, so that a reader never
+		// sees a half written entry
+		{
+			std::ofstream fout(tempPath, std::ios::binary | std::ios::trunc);
+			if (!fout.is_open()) {
+				throw std::runtime_error("open " + tempPath + " failure");
+			}
+
+			fout.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+			for (const auto& level : _levels) {
+				LevelEntry entry = {
+					static_cast<uint32_t>(level.width), static_cast<uint32_t>(level.height),
+					payloadOffset + level.offset, level.size };
+				fout.write(reinterpret_cast<const char*>(&entry), sizeof(LevelEntry));
+			}
+			fout.write(_path.data(), _path.size());
+
+			const char padding[kAlignment] = {};
+			const uint64_t written = sizeof(Header) + _levels.size() * sizeof(LevelEntry) + _path.size();
+			fout.write(padding, payloadOffset - written);
+			fout.write(reinterpret_cast<const char*>(_data), payloadSize);
+
+			if (!fout) {
+				throw std::runtime_error("write " + tempPath + " failure");
+			}
+		}
+
+		std::filesystem::rename(tempPath, cachePath);
+	}
+	catch (const std::exception& e) {
+		std::cerr << "save texture cache of " << _path << " failure: " << e.what() << std::endl;
+		std::error_code ec;
+		std::filesystem::remove(tempPath, ec);
+		return false;
+	}
+
+	return true;
+}
+
+std::string CompressedImage::getCachePath(const std::string& imagePath) {
+	std::stringstream ss;
+	ss << cacheDirectory << std::filesystem::path(imagePath).stem().string() << "-"
+		<< std::hex << std::setw(16) << std::setfill('0') << fnv1a(imagePath) << ".bctx";
+	return ss.str();
+}
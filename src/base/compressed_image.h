@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+#include "texture.h"
+
+enum class BlockFormat : uint32_t {
+	BC1 = 1,    // 8 bytes per 4x4 block, opaque
+	BC3 = 3     // 16 bytes per 4x4 block, with alpha
+};
+
+// Block compressed mip chain of an image: BC1 when the image is opaque, BC3
+// when it has alpha. The chain is cached on disk, one file per source image,
+// keyed by the source path, size, mtime and content hash, so that a warm start
+// maps the blocks and uploads them without decoding the source.
+class CompressedImage {
+public:
+	// map the cache entry of an image file, throws if it is missing, stale or corrupt
+	CompressedImage(const std::string& imagePath);
+
+	// compress every level of a decoded image, the rows of blocks are split
+	// across threads or the idle workers of the calling thread pool
+	CompressedImage(const ImageData& image, int numThreads = 0);
+
+	CompressedImage(CompressedImage&& rhs) noexcept = default;
+
+	~CompressedImage() = default;
+
+	const std::string& getPath() const;
+
+	BlockFormat getFormat() const;
+
+	int getLevelCount() const;
+
+	int getWidth(int level = 0) const;
+
+	int getHeight(int level = 0) const;
+
+	const unsigned char* getData(int level) const;
+
+	size_t getSize(int level) const;
+
+	// bytes of all levels
+	size_t getBytes() const;
+
+	// write as the cache entry of the source image, errors are reported but not thrown
+	bool save() const;
+
+	static std::string getCachePath(const std::string& imagePath);
+
+private:
+	struct Level {
+		int width;
+		int height;
+		size_t offset;
+		size_t size;
+	};
+
+	std::string _path;
+	BlockFormat _format = BlockFormat::BC1;
+	std::vector<Level> _levels;
+
+	// the blocks live in the mapped cache entry or in memory after compressing
+	std::unique_ptr<MappedFile> _file;
+	std::vector<unsigned char> _blocks;
+	const unsigned char* _data = nullptr;
+};
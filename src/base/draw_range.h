@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+
+#include <glad/glad.h>
+
+// Geometry drawn with one call: indexed unless the index type is 0, in
+// which case the offset is the first vertex of an array draw. Indexed
+// ranges of the geometry arena add their base vertex to every index.
+struct DrawRange {
+	GLuint vao = 0;
+	GLenum mode = GL_TRIANGLES;
+	GLenum indexType = 0;
+	GLsizei count = 0;
+
+	// in bytes into the element buffer of the vertex array
+	size_t offset = 0;
+
+	GLint baseVertex = 0;
+
+	// more than one with per instance attributes in the vertex array
+	GLsizei instanceCount = 1;
+
+	// the vertex array must be bound
+	void draw() const {
+		if (indexType != 0) {
+			if (instanceCount != 1) {
+				glDrawElementsInstancedBaseVertex(mode, count, indexType, (void*)offset, instanceCount, baseVertex);
+			}
+			else {
+				glDrawElementsBaseVertex(mode, count, indexType, (void*)offset, baseVertex);
+			}
+		}
+		else {
+			if (instanceCount != 1) {
+				glDrawArraysInstanced(mode, static_cast<GLint>(offset), count, instanceCount);
+			}
+			else {
+				glDrawArrays(mode, static_cast<GLint>(offset), count);
+			}
+		}
+	}
+};
@@ -0,0 +1,26 @@
+#include <filesystem>
+#include <stdexcept>
+
+#include "hash.h"
+#include "mapped_file.h"
+#include "file_stamp.h"
+
+FileStamp GetFileStamp(const std::string& path) {
+	std::error_code ec;
+	FileStamp stamp;
+	stamp.size = static_cast<uint64_t>(std::filesystem::file_size(path, ec));
+	if (ec) {
+		throw std::runtime_error("stat " + path + " failure");
+	}
+	stamp.time = static_cast<int64_t>(
+		std::filesystem::last_write_time(path, ec).time_since_epoch().count());
+	if (ec) {
+		throw std::runtime_error("stat " + path + " failure");
+	}
+	return stamp;
+}
+
+uint64_t GetFileHash(const std::string& path) {
+	MappedFile file(path);
+	return hashBytes(file.getData(), file.getSize());
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Size and modification time of a file, the cheap half of checking that a
+// cache entry still matches its source; the content hash is the other half.
+struct FileStamp {
+	uint64_t size = 0;
+	int64_t time = 0;
+};
+
+// throws if the file cannot be stat'ed
+FileStamp GetFileStamp(const std::string& path);
+
+// hash of the whole file content, throws if it cannot be read
+uint64_t GetFileHash(const std::string& path);
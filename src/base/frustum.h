@@ -1,6 +1,9 @@
 #pragma once
 
 #include <iostream>
+
+#include <glm/glm.hpp>
+
 #include "plane.h"
 #include "bounding_box.h"
 
@@ -16,12 +19,48 @@ public:
 		FarFace = 5
 	};
 
+	// Gribb-Hartmann extraction: each plane is the sum or difference of the
+	// last row of the matrix and one of the others, normals point inside
+	static Frustum fromMatrix(const glm::mat4& viewProjection) {
+		const glm::vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+		const glm::vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+		const glm::vec4 row2(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+		const glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+
+		const glm::vec4 coefficients[6] = {
+			row3 + row0, row3 - row0,
+			row3 + row1, row3 - row1,
+			row3 + row2, row3 - row2
+		};
+
+		Frustum frustum;
+		for (int i = 0; i < 6; ++i) {
+			const float length = glm::length(glm::vec3(coefficients[i]));
+			frustum.planes[i] = { glm::vec3(coefficients[i]) / length, coefficients[i].w / length };
+		}
+
+		return frustum;
+	}
+
 	bool intersect(const BoundingBox& aabb, const glm::mat4& modelMatrix) const {
-		// TODO: judge whether the frustum intersects the bounding box
-		// write your code here
-		// ------------------------------------------------------------
-		return true;
-		// ------------------------------------------------------------
+		// the world space box around the transformed box has the transformed
+		// center and the extents projected by the absolute linear part
+		const glm::vec3 center = glm::vec3(modelMatrix * glm::vec4((aabb.min + aabb.max) * 0.5f, 1.0f));
+		const glm::vec3 halfSize = (aabb.max - aabb.min) * 0.5f;
+		const glm::mat3 linear(modelMatrix);
+		const glm::vec3 extents =
+			glm::abs(linear[0]) * halfSize.x + glm::abs(linear[1]) * halfSize.y + glm::abs(linear[2]) * halfSize.z;
+
+		// outside if the box lies entirely behind any plane; the six tests
+		// are independent and do not branch, so the compiler can vectorize them
+		bool outside = false;
+		for (int i = 0; i < 6; ++i) {
+			const float distance = planes[i].getSignedDistanceToPoint(center);
+			const float radius = glm::dot(extents, glm::abs(planes[i].normal));
+			outside |= distance + radius < 0.0f;
+		}
+
+		return !outside;
 	}
 };
 
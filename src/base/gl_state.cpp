@@ -0,0 +1,134 @@
+#include "gl_state.h"
+
+const GLenum GLState::kCapabilities[GLState::kCapabilityCount] = {
+	GL_DEPTH_TEST,
+	GL_CULL_FACE,
+	GL_BLEND,
+	GL_STENCIL_TEST,
+	GL_SCISSOR_TEST,
+	GL_MULTISAMPLE,
+	GL_TEXTURE_CUBE_MAP_SEAMLESS
+};
+
+GLState& GLState::getInstance() {
+	static GLState state;
+	return state;
+}
+
+GLState::GLState() {
+	invalidate();
+}
+
+void GLState::useProgram(GLuint program) {
+	if (elide(_program == program)) {
+		return;
+	}
+
+	glUseProgram(program);
+	_program = program;
+}
+
+void GLState::bindVertexArray(GLuint vao) {
+	if (elide(_vao == vao)) {
+		return;
+	}
+
+	glBindVertexArray(vao);
+	_vao = vao;
+}
+
+void GLState::bindTexture(GLenum target, GLuint texture, int unit) {
+	const int slot = target == GL_TEXTURE_2D ? 0 : (target == GL_TEXTURE_CUBE_MAP ? 1 : -1);
+	const bool tracked = slot >= 0 && unit >= 0 && unit < kMaxTextureUnits;
+	if (elide(tracked && _textures[unit][slot] == texture)) {
+		return;
+	}
+
+	if (!elide(_activeUnit == unit)) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		_activeUnit = unit;
+	}
+
+	glBindTexture(target, texture);
+	if (tracked) {
+		_textures[unit][slot] = texture;
+	}
+}
+
+void GLState::setDepthFunc(GLenum func) {
+	if (elide(_depthFunc == func)) {
+		return;
+	}
+
+	glDepthFunc(func);
+	_depthFunc = func;
+}
+
+void GLState::enable(GLenum capability) {
+	setCapability(capability, true);
+}
+
+void GLState::disable(GLenum capability) {
+	setCapability(capability, false);
+}
+
+void GLState::invalidateBindings() {
+	_program = kUnknown;
+	_vao = kUnknown;
+	_activeUnit = -1;
+	for (int i = 0; i < kMaxTextureUnits; ++i) {
+		_textures[i][0] = kUnknown;
+		_textures[i][1] = kUnknown;
+	}
+}
+
+void GLState::invalidate() {
+	invalidateBindings();
+	_depthFunc = kUnknown;
+	for (int i = 0; i < kCapabilityCount; ++i) {
+		_capabilities[i] = -1;
+	}
+}
+
+void GLState::beginFrame() {
+	_lastFrame = _current;
+	_current = GLStateStats();
+	invalidateBindings();
+}
+
+const GLStateStats& GLState::getFrameStats() const {
+	return _lastFrame;
+}
+
+void GLState::setCapability(GLenum capability, bool enabled) {
+	int index = 0;
+	while (index < kCapabilityCount && kCapabilities[index] != capability) {
+		++index;
+	}
+
+	const bool tracked = index < kCapabilityCount;
+	if (elide(tracked && _capabilities[index] == static_cast<int8_t>(enabled))) {
+		return;
+	}
+
+	if (enabled) {
+		glEnable(capability);
+	}
+	else {
+		glDisable(capability);
+	}
+
+	if (tracked) {
+		_capabilities[index] = static_cast<int8_t>(enabled);
+	}
+}
+
+bool GLState::elide(bool redundant) {
+	if (redundant) {
+		++_current.elided;
+	}
+	else {
+		++_current.issued;
+	}
+	return redundant;
+}
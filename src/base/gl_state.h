@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+
+#include <glad/glad.h>
+
+// calls of the previous frame that reached the driver and that were skipped
+struct GLStateStats {
+	int issued = 0;
+	int elided = 0;
+};
+
+// Shadows the state the draw paths change, the bound program, vertex array,
+// textures per unit, depth function and enable bits, and skips every call
+// that would set what is already set. Resource creation and deletion bind
+// and unbind objects behind its back, so the bindings are forgotten at the
+// start of each frame; code that touches the tracked state in the middle of
+// a frame without going through here must call invalidate().
+class GLState {
+public:
+	static constexpr int kMaxTextureUnits = 16;
+
+	static GLState& getInstance();
+
+	GLState(const GLState&) = delete;
+
+	void useProgram(GLuint program);
+
+	void bindVertexArray(GLuint vao);
+
+	// the active unit is only switched when the binding changes
+	void bindTexture(GLenum target, GLuint texture, int unit = 0);
+
+	void setDepthFunc(GLenum func);
+
+	void enable(GLenum capability);
+
+	void disable(GLenum capability);
+
+	// forget the object bindings, the depth function and enable bits are kept
+	void invalidateBindings();
+
+	// forget everything, the next call of each kind reaches the driver
+	void invalidate();
+
+	// close the statistics of the previous frame and forget the bindings
+	void beginFrame();
+
+	const GLStateStats& getFrameStats() const;
+
+private:
+	GLState();
+
+	static constexpr GLuint kUnknown = ~0u;
+
+	// the capabilities that are shadowed, others are always issued
+	static constexpr int kCapabilityCount = 7;
+	static const GLenum kCapabilities[kCapabilityCount];
+
+	GLuint _program;
+	GLuint _vao;
+	int _activeUnit;
+
+	// per unit, GL_TEXTURE_2D then GL_TEXTURE_CUBE_MAP
+	GLuint _textures[kMaxTextureUnits][2];
+
+	GLenum _depthFunc;
+
+	// -1 unknown, 0 disabled, 1 enabled
+	int8_t _capabilities[kCapabilityCount];
+
+	GLStateStats _current;
+	GLStateStats _lastFrame;
+
+	void setCapability(GLenum capability, bool enabled);
+
+	bool elide(bool redundant);
+};
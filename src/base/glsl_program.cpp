@@ -1,9 +1,68 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <stdexcept>
 
+#include "gl_state.h"
 #include "glsl_program.h"
+#include "uniform_buffer.h"
+
+namespace {
+    ProgramCacheOptions defaultProgramCacheOptions;
+    ProgramCacheStats programCacheStats;
+
+    const std::string cacheDirectory = "./cache/shaders/";
+
+    constexpr char kMagic[4] = { 'P', 'R', 'G', 'M' };
+    constexpr uint32_t kVersion = 1;
+
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint32_t binaryFormat;
+        uint32_t binaryLength;
+        uint64_t sourceHash;
+        uint64_t payloadHash;
+    };
+
+    double getMilliseconds(std::chrono::high_resolution_clock::time_point start) {
+        auto now = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double, std::milli>(now - start).count();
+    }
+
+    uint64_t hashString(const char* str, uint64_t seed) {
+        return str != nullptr ? hashBytes(str, std::strlen(str), seed) : seed;
+    }
+}
+
+void SetDefaultProgramCacheOptions(const ProgramCacheOptions& options) {
+    defaultProgramCacheOptions = options;
+}
+
+const ProgramCacheOptions& GetDefaultProgramCacheOptions() {
+    return defaultProgramCacheOptions;
+}
+
+const ProgramCacheStats& GetProgramCacheStats() {
+    return programCacheStats;
+}
+
+bool SupportsProgramBinary() {
+    static const bool supported = [] {
+        if (glGetProgramBinary == nullptr || glProgramBinary == nullptr || glProgramParameteri == nullptr) {
+            return false;
+        }
+        GLint formatCount = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+        return formatCount > 0;
+    }();
+    return supported;
+}
 
 GLSLProgram::GLSLProgram() {
     _handle = glCreateProgram();
@@ -15,7 +74,11 @@ GLSLProgram::GLSLProgram() {
 GLSLProgram::GLSLProgram(GLSLProgram&& rhs) noexcept
     : _handle(rhs._handle),
       _vertexShaders(std::move(rhs._vertexShaders)),
-      _fragmentShaders(std::move(rhs._fragmentShaders)) {
+      _fragmentShaders(std::move(rhs._fragmentShaders)),
+      _sources(std::move(rhs._sources)),
+      _varyings(std::move(rhs._varyings)),
+      _varyingBufferMode(rhs._varyingBufferMode),
+      _uniforms(std::move(rhs._uniforms)) {
     rhs._handle = 0;
     rhs._vertexShaders.clear();
     rhs._fragmentShaders.clear();
@@ -37,15 +100,11 @@ GLSLProgram::~GLSLProgram() {
 }
 
 void GLSLProgram::attachVertexShader(const std::string& code) {
-    GLuint vertexShader = createShader(code, GL_VERTEX_SHADER);
-    glAttachShader(_handle, vertexShader);
-    _vertexShaders.push_back(vertexShader);
+    _sources.emplace_back(GL_VERTEX_SHADER, code);
 }
 
 void GLSLProgram::attachFragmentShader(const std::string& code) {
-    GLuint fragmentShader = createShader(code, GL_FRAGMENT_SHADER);
-    glAttachShader(_handle, fragmentShader);
-    _vertexShaders.push_back(fragmentShader);
+    _sources.emplace_back(GL_FRAGMENT_SHADER, code);
 }
 
 void GLSLProgram::attachVertexShaderFromFile(const std::string& filePath) {
@@ -60,11 +119,59 @@ void GLSLProgram::attachFragmentShaderFromFile(const std::string& filePath) {
 
 void GLSLProgram::setTransformFeedbackVaryings(
     const std::vector<const char*>& varyings, GLenum bufferMode) {
-    glTransformFeedbackVaryings(_handle, static_cast<GLsizei>(varyings.size()), 
-                                varyings.data(), bufferMode);
+    _varyings.assign(varyings.begin(), varyings.end());
+    _varyingBufferMode = bufferMode;
 }
 
 void GLSLProgram::link() {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    const bool useCache = GetDefaultProgramCacheOptions().enabled && SupportsProgramBinary();
+    const uint64_t sourceHash = useCache ? getSourceHash() : 0;
+
+    if (useCache && loadBinary(sourceHash)) {
+        ++programCacheStats.cached;
+        programCacheStats.cacheMs += getMilliseconds(start);
+    }
+    else {
+        compileAndLink();
+        ++programCacheStats.compiled;
+        programCacheStats.compileMs += getMilliseconds(start);
+
+        if (useCache) {
+            saveBinary(sourceHash);
+        }
+    }
+
+    enumerateUniforms();
+    bindUniformBlocks();
+}
+
+void GLSLProgram::compileAndLink() {
+    for (const auto& source : _sources) {
+        GLuint shader = createShader(source.second, source.first);
+        glAttachShader(_handle, shader);
+        if (source.first == GL_VERTEX_SHADER) {
+            _vertexShaders.push_back(shader);
+        }
+        else {
+            _fragmentShaders.push_back(shader);
+        }
+    }
+
+    if (!_varyings.empty()) {
+        std::vector<const char*> varyings;
+        for (const std::string& varying : _varyings) {
+            varyings.push_back(varying.c_str());
+        }
+        glTransformFeedbackVaryings(_handle, static_cast<GLsizei>(varyings.size()),
+                                    varyings.data(), _varyingBufferMode);
+    }
+
+    if (GetDefaultProgramCacheOptions().enabled && SupportsProgramBinary()) {
+        glProgramParameteri(_handle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
     glLinkProgram(_handle);
 
     GLint success;
@@ -76,80 +183,338 @@ void GLSLProgram::link() {
     }
 }
 
+uint64_t GLSLProgram::getSourceHash() const {
+    // a binary is only valid for the driver that produced it
+    uint64_t hash = hashString(reinterpret_cast<const char*>(glGetString(GL_VENDOR)), 0);
+    hash = hashString(reinterpret_cast<const char*>(glGetString(GL_RENDERER)), hash);
+    hash = hashString(reinterpret_cast<const char*>(glGetString(GL_VERSION)), hash);
+
+    for (const auto& source : _sources) {
+        hash = hashBytes(&source.first, sizeof(source.first), hash);
+        hash = hashBytes(source.second.data(), source.second.size(), hash);
+    }
+
+    for (const std::string& varying : _varyings) {
+        hash = hashBytes(varying.data(), varying.size() + 1, hash);
+    }
+    return hashBytes(&_varyingBufferMode, sizeof(_varyingBufferMode), hash);
+}
+
+std::string GLSLProgram::getCachePath(uint64_t sourceHash) {
+    std::stringstream ss;
+    ss << cacheDirectory << std::hex << std::setw(16) << std::setfill('0') << sourceHash << ".bin";
+    return ss.str();
+}
+
+bool GLSLProgram::loadBinary(uint64_t sourceHash) {
+    std::ifstream fin(getCachePath(sourceHash), std::ios::binary);
+    if (!fin.is_open()) {
+        return false;
+    }
+
+    Header header;
+    if (!fin.read(reinterpret_cast<char*>(&header), sizeof(Header)) ||
+        std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+        header.version != kVersion ||
+        header.sourceHash != sourceHash) {
+        return false;
+    }
+
+    std::vector<char> binary(header.binaryLength);
+    if (!fin.read(binary.data(), binary.size()) ||
+        header.payloadHash != hashBytes(binary.data(), binary.size())) {
+        std::cerr << "program binary " << getCachePath(sourceHash) << " is corrupt" << std::endl;
+        return false;
+    }
+
+    glProgramBinary(_handle, header.binaryFormat, binary.data(), static_cast<GLsizei>(binary.size()));
+
+    GLint success;
+    glGetProgramiv(_handle, GL_LINK_STATUS, &success);
+    if (!success) {
+        ++programCacheStats.rejected;
+        std::cout << "program binary " << getCachePath(sourceHash) << " rejected, compile from source" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool GLSLProgram::saveBinary(uint64_t sourceHash) const {
+    const std::string cachePath = getCachePath(sourceHash);
+    const std::string tempPath = cachePath + ".tmp";
+
+    try {
+        GLint length = 0;
+        glGetProgramiv(_handle, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) {
+            throw std::runtime_error("the driver returned no binary");
+        }
+
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(_handle, length, &length, &format, binary.data());
+        binary.resize(length);
+
+        Header header = {};
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.binaryFormat = format;
+        header.binaryLength = static_cast<uint32_t>(binary.size());
+        header.sourceHash = sourceHash;
+        header.payloadHash = hashBytes(binary.data(), binary.size());
+
+        std::filesystem::create_directories(cacheDirectory);
+
+        // write to a temporary file and rename it, so that a reader never
+        // sees a half written entry
+        {
+            std::ofstream fout(tempPath, std::ios::binary | std::ios::trunc);
+            if (!fout.is_open()) {
+                throw std::runtime_error("open " + tempPath + " failure");
+            }
+
+            fout.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+            fout.write(binary.data(), binary.size());
+
+            if (!fout) {
+                throw std::runtime_error("write " + tempPath + " failure");
+            }
+        }
+
+        std::filesystem::rename(tempPath, cachePath);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "save program binary " << cachePath << " failure: " << e.what() << std::endl;
+        std::error_code ec;
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+
+    return true;
+}
+
 void GLSLProgram::use() {
-    glUseProgram(_handle);
+    GLState::getInstance().useProgram(_handle);
+}
+
+UniformHandle GLSLProgram::getUniform(UniformName name) const {
+    auto it = std::lower_bound(_uniforms.begin(), _uniforms.end(), name.hash,
+        [](const Uniform& uniform, uint64_t hash) { return uniform.hash < hash; });
+    if (it == _uniforms.end() || it->hash != name.hash) {
+        return UniformHandle();
+    }
+
+    UniformHandle handle;
+    handle.index = static_cast<int>(it - _uniforms.begin());
+    return handle;
+}
+
+void GLSLProgram::setBool(UniformName name, bool value) const {
+    UniformHandle uniform = getUniform(name);
+    if (!uniform.isValid()) {
+        std::cerr << "find uniform " << name.name << " location failure" << std::endl;
+    }
+
+    setBool(uniform, value);
 }
 
-void GLSLProgram::setBool(const std::string& name, bool value) const {
-    GLint location = glGetUniformLocation(_handle, name.c_str());
-    if (location == -1) {
-        std::cerr << "find uniform " + name + " location failure" << std::endl;
+void GLSLProgram::setInt(UniformName name, int value) const {
+    UniformHandle uniform = getUniform(name);
+    if (!uniform.isValid()) {
+        std::cerr << "find uniform " << name.name << " location failure" << std::endl;
     }
 
-    glUniform1i(location, static_cast<int>(value));
+    setInt(uniform, value);
 }
 
-void GLSLProgram::setInt(const std::string& name, int value) const {
-    GLint location = glGetUniformLocation(_handle, name.c_str());
-    if (location == -1) {
-        std::cerr << "find uniform " + name + " location failure" << std::endl;
+void GLSLProgram::setFloat(UniformName name, float value) const {
+    UniformHandle uniform = getUniform(name);
+    if (!uniform.isValid()) {
+        std::cerr << "find uniform " << name.name << " location failure" << std::endl;
     }
 
-    glUniform1i(location, value);
+    setFloat(uniform, value);
 }
 
-void GLSLProgram::setFloat(const std::string& name, float value) const {
-    GLint location = glGetUniformLocation(_handle, name.c_str());
-    if (location == -1) {
-        std::cerr << "find uniform " + name + " location failure" << std::endl;
+void GLSLProgram::setVec2(UniformName name, const glm::vec2& v2) const {
+    UniformHandle uniform = getUniform(name);
+    if (!uniform.isValid()) {
+        std::cerr << "find uniform " << name.name << " location failure" << std::endl;
     }
 
-    glUniform1f(location, value);
+    setVec2(uniform, v2);
 }
 
-void GLSLProgram::setVec2(const std::string& name, const glm::vec2& v2) const {
-    GLint location = glGetUniformLocation(_handle, name.c_str());
-    if (location == -1) {
-        std::cerr << "find uniform " + name + " location failure" << std::endl;
+void GLSLProgram::setVec3(UniformName name, const glm::vec3& v3) const {
+    UniformHandle uniform = getUniform(name);
+    if (!uniform.isValid()) {
+        std::cerr << "find uniform " << name.name << " location failure" << std::endl;
     }
 
-    glUniform2fv(location, 1, &v2[0]);
+    setVec3(uniform, v3);
 }
 
-void GLSLProgram::setVec3(const std::string& name, const glm::vec3& v3) const {
-    GLint location = glGetUniformLocation(_handle, name.c_str());
-    if (location == -1) {
-        std::cerr << "find uniform " + name + " location failure" << std::endl;
+void GLSLProgram::setVec4(UniformName name, const glm::vec4& v4) const {
+    UniformHandle uniform = getUniform(name);
+    if (!uniform.isValid()) {
+        std::cerr << "find uniform " << name.name << " location failure" << std::endl;
     }
 
-    glUniform3fv(location, 1, &v3[0]);
+    setVec4(uniform, v4);
 }
 
-void GLSLProgram::setVec4(const std::string& name, const glm::vec4& v4) const {
-    GLint location = glGetUniformLocation(_handle, name.c_str());
-    if (location == -1) {
-        std::cerr << "find uniform " + name + " location failure" << std::endl;
+void GLSLProgram::setMat3(UniformName name, const glm::mat3& mat3) const {
+    UniformHandle uniform = getUniform(name);
+    if (!uniform.isValid()) {
+        std::cerr << "find uniform " << name.name << " location failure" << std::endl;
     }
 
-    glUniform4fv(location, 1, &v4[0]);
+    setMat3(uniform, mat3);
 }
 
-void GLSLProgram::setMat3(const std::string& name, const glm::mat3& mat3) const {
-    GLint location = glGetUniformLocation(_handle, name.c_str());
-    if (location == -1) {
-        std::cerr << "find uniform " + name + " location failure" << std::endl;
+void GLSLProgram::setMat4(UniformName name, const glm::mat4& mat4) const {
+    UniformHandle uniform = getUniform(name);
+    if (!uniform.isValid()) {
+        std::cerr << "find uniform " << name.name << " location failure" << std::endl;
     }
 
-    glUniform3fv(location, 1, &mat3[0][0]);
+    setMat4(uniform, mat4);
 }
 
-void GLSLProgram::setMat4(const std::string& name, const glm::mat4& mat4) const {
-    GLint location = glGetUniformLocation(_handle, name.c_str());
-    if (location == -1) {
-        std::cerr << "find uniform " + name + " location failure" << std::endl;
+void GLSLProgram::setBool(UniformHandle uniform, bool value) const {
+    int v = static_cast<int>(value);
+    if (updateCache(uniform, &v, sizeof(v))) {
+        glUniform1i(_uniforms[uniform.index].location, v);
+    }
+}
+
+void GLSLProgram::setInt(UniformHandle uniform, int value) const {
+    if (updateCache(uniform, &value, sizeof(value))) {
+        glUniform1i(_uniforms[uniform.index].location, value);
+    }
+}
+
+void GLSLProgram::setFloat(UniformHandle uniform, float value) const {
+    if (updateCache(uniform, &value, sizeof(value))) {
+        glUniform1f(_uniforms[uniform.index].location, value);
+    }
+}
+
+void GLSLProgram::setVec2(UniformHandle uniform, const glm::vec2& v2) const {
+    if (updateCache(uniform, &v2, sizeof(v2))) {
+        glUniform2fv(_uniforms[uniform.index].location, 1, &v2[0]);
+    }
+}
+
+void GLSLProgram::setVec3(UniformHandle uniform, const glm::vec3& v3) const {
+    if (updateCache(uniform, &v3, sizeof(v3))) {
+        glUniform3fv(_uniforms[uniform.index].location, 1, &v3[0]);
+    }
+}
+
+void GLSLProgram::setVec4(UniformHandle uniform, const glm::vec4& v4) const {
+    if (updateCache(uniform, &v4, sizeof(v4))) {
+        glUniform4fv(_uniforms[uniform.index].location, 1, &v4[0]);
+    }
+}
+
+void GLSLProgram::setMat3(UniformHandle uniform, const glm::mat3& mat3) const {
+    if (updateCache(uniform, &mat3, sizeof(mat3))) {
+        glUniformMatrix3fv(_uniforms[uniform.index].location, 1, GL_FALSE, &mat3[0][0]);
+    }
+}
+
+void GLSLProgram::setMat4(UniformHandle uniform, const glm::mat4& mat4) const {
+    if (updateCache(uniform, &mat4, sizeof(mat4))) {
+        glUniformMatrix4fv(_uniforms[uniform.index].location, 1, GL_FALSE, &mat4[0][0]);
+    }
+}
+
+void GLSLProgram::enumerateUniforms() {
+    _uniforms.clear();
+
+    GLint count = 0;
+    GLint maxLength = 0;
+    glGetProgramiv(_handle, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(_handle, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+    std::vector<std::string> names;
+    std::vector<char> buffer(std::max(maxLength, 1));
+    for (GLint i = 0; i < count; ++i) {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(_handle, static_cast<GLuint>(i), static_cast<GLsizei>(buffer.size()),
+            &length, &size, &type, buffer.data());
+        std::string name(buffer.data(), length);
+
+        // arrays are reported once as "name[0]", every element gets its own
+        // entry and the bare name refers to the first one
+        const size_t bracket = name.back() == ']' ? name.rfind('[') : std::string::npos;
+        if (bracket != std::string::npos && size > 1) {
+            const std::string base = name.substr(0, bracket);
+            names.push_back(base);
+            for (GLint element = 0; element < size; ++element) {
+                names.push_back(base + "[" + std::to_string(element) + "]");
+            }
+        }
+        else {
+            names.push_back(name);
+            if (bracket != std::string::npos) {
+                names.push_back(name.substr(0, bracket));
+            }
+        }
+    }
+
+    for (const std::string& name : names) {
+        // members of uniform blocks have no location
+        const GLint location = glGetUniformLocation(_handle, name.c_str());
+        if (location != -1) {
+            Uniform uniform = {};
+            uniform.hash = fnv1a(name);
+            uniform.location = location;
+            _uniforms.push_back(uniform);
+        }
+    }
+
+    std::sort(_uniforms.begin(), _uniforms.end(), [](const Uniform& a, const Uniform& b) {
+        return a.hash < b.hash;
+    });
+    for (size_t i = 1; i < _uniforms.size(); ++i) {
+        if (_uniforms[i].hash == _uniforms[i - 1].hash) {
+            throw std::runtime_error("uniform name hash collision in program " + std::to_string(_handle));
+        }
+    }
+}
+
+void GLSLProgram::bindUniformBlocks() {
+    GLint count = 0;
+    glGetProgramiv(_handle, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+
+    for (GLint i = 0; i < count; ++i) {
+        char name[256];
+        glGetActiveUniformBlockName(_handle, static_cast<GLuint>(i), sizeof(name), nullptr, name);
+        const GLuint binding = GetUniformBlockBinding(name);
+        if (binding != GL_INVALID_INDEX) {
+            glUniformBlockBinding(_handle, static_cast<GLuint>(i), binding);
+        }
+    }
+}
+
+bool GLSLProgram::updateCache(UniformHandle uniform, const void* value, size_t size) const {
+    if (!uniform.isValid()) {
+        return false;
+    }
+
+    Uniform& entry = _uniforms[uniform.index];
+    if (entry.cached && std::memcmp(entry.value, value, size) == 0) {
+        return false;
     }
 
-    glUniformMatrix4fv(location, 1, GL_FALSE, &mat4[0][0]);
+    std::memcpy(entry.value, value, size);
+    entry.cached = true;
+    return true;
 }
 
 std::string GLSLProgram::readFile(const std::string& filePath) {
@@ -6,6 +6,52 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "hash.h"
+
+// a uniform name and its hash, computed at compile time for string literals
+struct UniformName {
+    const char* name;
+    uint64_t hash;
+
+    template <size_t N>
+    constexpr UniformName(const char (&str)[N]) : name(str), hash(fnv1a(str, N - 1)) { }
+
+    UniformName(const std::string& str) : name(str.c_str()), hash(fnv1a(str)) { }
+};
+
+// index of an active uniform in its program's table, resolved once after linking
+struct UniformHandle {
+    int index = -1;
+
+    bool isValid() const { return index >= 0; }
+};
+
+struct ProgramCacheOptions {
+    // keep linked program binaries in ./cache/shaders and reload them on the next launch
+    bool enabled = true;
+};
+
+void SetDefaultProgramCacheOptions(const ProgramCacheOptions& options);
+const ProgramCacheOptions& GetDefaultProgramCacheOptions();
+
+// programs built since startup, by source compilation or from the binary cache
+struct ProgramCacheStats {
+    int compiled = 0;
+    int cached = 0;
+
+    // binaries the driver did not accept, e.g. after a driver update
+    int rejected = 0;
+
+    double compileMs = 0.0;
+    double cacheMs = 0.0;
+};
+
+const ProgramCacheStats& GetProgramCacheStats();
+
+// glGetProgramBinary is core in opengl 4.1 and loaded from ARB_get_program_binary
+// on older contexts, false if neither provides it or the driver has no binary format
+bool SupportsProgramBinary();
+
 class GLSLProgram {
 public:
     GLSLProgram();
@@ -14,6 +60,7 @@ public:
 
     ~GLSLProgram();
 
+    // the sources are compiled by link() unless the binary cache has the program
     void attachVertexShader(const std::string& code);
 
     void attachFragmentShader(const std::string& code);
@@ -25,25 +72,49 @@ public:
     void setTransformFeedbackVaryings(
         const std::vector<const char*>& varyings, GLenum bufferMode);
 
+    // Load the program binary cached for these sources, or compile and link
+    // them and cache the result. The active uniforms are enumerated and the
+    // shared uniform blocks bound once here.
     void link();
 
     void use();
 
-    void setBool(const std::string& name, bool value) const;
+    // invalid if the program has no such active uniform
+    UniformHandle getUniform(UniformName name) const;
+
+    // the setters remember the last value of every uniform and skip the
+    // upload when it did not change, by handle or by name
+    void setBool(UniformName name, bool value) const;
+
+    void setInt(UniformName name, int value) const;
+
+    void setFloat(UniformName name, float value) const;
+
+    void setVec2(UniformName name, const glm::vec2& v2) const;
 
-    void setInt(const std::string& name, int value) const;
+    void setVec3(UniformName name, const glm::vec3& v3) const;
 
-    void setFloat(const std::string& name, float value) const;
+    void setVec4(UniformName name, const glm::vec4& v4) const;
 
-    void setVec2(const std::string& name, const glm::vec2& v2) const;
+    void setMat3(UniformName name, const glm::mat3& mat3) const;
 
-    void setVec3(const std::string& name, const glm::vec3& v3) const;
+    void setMat4(UniformName name, const glm::mat4& mat4) const;
 
-    void setVec4(const std::string& name, const glm::vec4& v4) const;
+    void setBool(UniformHandle uniform, bool value) const;
 
-    void setMat3(const std::string& name, const glm::mat3& mat3) const;
+    void setInt(UniformHandle uniform, int value) const;
 
-    void setMat4(const std::string& name, const glm::mat4& mat4) const;
+    void setFloat(UniformHandle uniform, float value) const;
+
+    void setVec2(UniformHandle uniform, const glm::vec2& v2) const;
+
+    void setVec3(UniformHandle uniform, const glm::vec3& v3) const;
+
+    void setVec4(UniformHandle uniform, const glm::vec4& v4) const;
+
+    void setMat3(UniformHandle uniform, const glm::mat3& mat3) const;
+
+    void setMat4(UniformHandle uniform, const glm::mat4& mat4) const;
 
 public:
     GLuint _handle = 0;
@@ -52,6 +123,43 @@ public:
 
     std::vector<GLuint> _fragmentShaders;
 
+    // shader type and source, kept until link
+    std::vector<std::pair<GLenum, std::string>> _sources;
+
+    std::vector<std::string> _varyings;
+    GLenum _varyingBufferMode = GL_INTERLEAVED_ATTRIBS;
+
+    // of the sources, the varyings and the driver, names the cache entry
+    uint64_t getSourceHash() const;
+
+    static std::string getCachePath(uint64_t sourceHash);
+
+    // false if the entry is missing, corrupt or rejected by the driver
+    bool loadBinary(uint64_t sourceHash);
+
+    // errors are reported but not thrown
+    bool saveBinary(uint64_t sourceHash) const;
+
+    void compileAndLink();
+
+    // active uniforms sorted by name hash, with the value last uploaded
+    struct Uniform {
+        uint64_t hash;
+        GLint location;
+        bool cached;
+        unsigned char value[sizeof(glm::mat4)];
+    };
+
+    mutable std::vector<Uniform> _uniforms;
+
+    void enumerateUniforms();
+
+    // connect the shared blocks the program uses to their fixed binding points
+    void bindUniformBlocks();
+
+    // false if the uniform is invalid or already holds the value, otherwise caches it
+    bool updateCache(UniformHandle uniform, const void* value, size_t size) const;
+
     std::string readFile(const std::string& filePath);
 
     GLuint createShader(const std::string& code, GLenum shaderType);
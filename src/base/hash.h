@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// 64-bit FNV-1a, usable at compile time for string keys
+constexpr uint64_t fnv1a(const char* str, size_t length) {
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (size_t i = 0; i < length; ++i) {
+		hash = (hash ^ static_cast<uint8_t>(str[i])) * 0x100000001b3ull;
+	}
+	return hash;
+}
+
+inline uint64_t fnv1a(const std::string& str) {
+	return fnv1a(str.data(), str.size());
+}
+
+// fast non-cryptographic hash of a large buffer, consumes 8 bytes per step
+inline uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0) {
+	constexpr uint64_t prime = 0x9e3779b97f4a7c15ull;
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	uint64_t hash = seed ^ (size * prime);
+
+	for (; size >= 8; size -= 8, p += 8) {
+		uint64_t word;
+		std::memcpy(&word, p, 8);
+		word *= prime;
+		word ^= word >> 29;
+		hash = (hash ^ word) * prime;
+	}
+
+	uint64_t tail = 0;
+	std::memcpy(&tail, p, size);
+	hash = (hash ^ tail) * prime;
+
+	hash ^= hash >> 32;
+	hash *= prime;
+	hash ^= hash >> 29;
+	return hash;
+}
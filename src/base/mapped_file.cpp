@@ -0,0 +1,140 @@
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mapped_file.h"
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path) {
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("open " + path + " failure");
+	}
+	_file = file;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		cleanup();
+		throw std::runtime_error("stat " + path + " failure");
+	}
+	_size = static_cast<size_t>(size.QuadPart);
+
+	// an empty file cannot be mapped, leave it as a null view
+	if (_size == 0) {
+		return;
+	}
+
+	_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (_mapping == nullptr) {
+		cleanup();
+		throw std::runtime_error("map " + path + " failure");
+	}
+
+	_data = static_cast<const char*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+	if (_data == nullptr) {
+		cleanup();
+		throw std::runtime_error("map " + path + " failure");
+	}
+}
+
+MappedFile::MappedFile(MappedFile&& rhs) noexcept
+	: _data(rhs._data), _size(rhs._size), _file(rhs._file), _mapping(rhs._mapping) {
+	rhs._data = nullptr;
+	rhs._size = 0;
+	rhs._file = nullptr;
+	rhs._mapping = nullptr;
+}
+
+void MappedFile::cleanup() {
+	if (_data != nullptr) {
+		UnmapViewOfFile(_data);
+		_data = nullptr;
+	}
+
+	if (_mapping != nullptr) {
+		CloseHandle(_mapping);
+		_mapping = nullptr;
+	}
+
+	if (_file != nullptr) {
+		CloseHandle(_file);
+		_file = nullptr;
+	}
+
+	_size = 0;
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path) {
+	_fd = open(path.c_str(), O_RDONLY);
+	if (_fd == -1) {
+		throw std::runtime_error("open " + path + " failure");
+	}
+
+	struct stat st;
+	if (fstat(_fd, &st) != 0) {
+		cleanup();
+		throw std::runtime_error("stat " + path + " failure");
+	}
+	_size = static_cast<size_t>(st.st_size);
+
+	// an empty file cannot be mapped, leave it as a null view
+	if (_size == 0) {
+		return;
+	}
+
+	void* data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+	if (data == MAP_FAILED) {
+		cleanup();
+		throw std::runtime_error("map " + path + " failure");
+	}
+	madvise(data, _size, MADV_SEQUENTIAL);
+	_data = static_cast<const char*>(data);
+}
+
+MappedFile::MappedFile(MappedFile&& rhs) noexcept
+	: _data(rhs._data), _size(rhs._size), _fd(rhs._fd) {
+	rhs._data = nullptr;
+	rhs._size = 0;
+	rhs._fd = -1;
+}
+
+void MappedFile::cleanup() {
+	if (_data != nullptr) {
+		munmap(const_cast<char*>(_data), _size);
+		_data = nullptr;
+	}
+
+	if (_fd != -1) {
+		close(_fd);
+		_fd = -1;
+	}
+
+	_size = 0;
+}
+
+#endif
+
+MappedFile::~MappedFile() {
+	cleanup();
+}
+
+const char* MappedFile::getData() const {
+	return _data;
+}
+
+size_t MappedFile::getSize() const {
+	return _size;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+
+// read-only view of a whole file mapped into the address space
+class MappedFile {
+public:
+	MappedFile(const std::string& path);
+
+	MappedFile(const MappedFile&) = delete;
+
+	MappedFile(MappedFile&& rhs) noexcept;
+
+	~MappedFile();
+
+	const char* getData() const;
+
+	size_t getSize() const;
+
+private:
+	const char* _data = nullptr;
+	size_t _size = 0;
+
+#ifdef _WIN32
+	void* _file = nullptr;
+	void* _mapping = nullptr;
+#else
+	int _fd = -1;
+#endif
+
+	void cleanup();
+};
@@ -1,6 +1,12 @@
+#include "gl_state.h"
 #include "skybox.h"
+#include "uniform_buffer.h"
 
-SkyBox::SkyBox(const std::vector<std::string>& textureFilenames) {
+SkyBox::SkyBox(const std::vector<std::string>& textureFilenames)
+    : SkyBox(std::make_shared<TextureCubemap>(textureFilenames)) { }
+
+SkyBox::SkyBox(std::shared_ptr<TextureCubemap> texture)
+    : _texture(std::move(texture)) {
     GLfloat vertices[] = {
         -1.0f,  1.0f, -1.0f,
         -1.0f, -1.0f, -1.0f,
@@ -59,18 +65,14 @@ SkyBox::SkyBox(const std::vector<std::string>& textureFilenames) {
     glBindVertexArray(0);
 
     try {
-        // init texture
-        _texture.reset(new TextureCubemap(textureFilenames));
-
         const char* vsCode =
             "#version 330 core\n"
             "layout(location = 0) in vec3 aPosition;\n"
             "out vec3 texCoord;\n"
-            "uniform mat4 projection;\n"
-            "uniform mat4 view;\n"
+            FRAME_DATA_GLSL
             "void main() {\n"
             "   texCoord = aPosition;\n"
-            "   gl_Position = (projection * view * vec4(aPosition, 1.0f)).xyww;\n"
+            "   gl_Position = (projection * mat4(mat3(view)) * vec4(aPosition, 1.0f)).xyww;\n"
             "}\n";
 
         const char* fsCode =
@@ -114,27 +116,41 @@ SkyBox::~SkyBox() {
     cleanup();
 }
 
-void SkyBox::draw(const glm::mat4& projection, const glm::mat4& view) {
+void SkyBox::draw() {
     // TODO:: draw skybox
     // write your code here
     // -----------------------------------------------
-	glDepthFunc(GL_LEQUAL);
+	// the sky sits on the far plane, the depth function is left for the next draw to set
+	GLState::getInstance().setDepthFunc(GL_LEQUAL);
 	_myshader->use();
-	_myshader->setMat4("projection", projection);
-	_myshader->setMat4("view", glm::mat4(glm::mat3(view)));
 //	_shader->setInt("cubemap", 0);
 
-	glBindVertexArray(_vao);
-	glActiveTexture(GL_TEXTURE0);
-	_texture->bind();
-
-	glDrawArrays(GL_TRIANGLES, 0, 36);
+	GLState::getInstance().bindVertexArray(_vao);
+	_texture->bind(0);
 
-	glBindVertexArray(0);
-	glDepthFunc(GL_LESS);
+	getDrawRange().draw();
     // -----------------------------------------------
 }
 
+DrawRange SkyBox::getDrawRange() const {
+    DrawRange range;
+    range.vao = _vao;
+    range.count = 36;
+    return range;
+}
+
+GLSLProgram* SkyBox::getProgram() const {
+    return _myshader.get();
+}
+
+const TextureCubemap* SkyBox::getTexture() const {
+    return _texture.get();
+}
+
+size_t SkyBox::getGpuBytes() const {
+    return _texture->getGpuBytes();
+}
+
 void SkyBox::cleanup() {
     if (_vbo != 0) {
         glDeleteBuffers(1, &_vbo);
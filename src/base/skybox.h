@@ -8,6 +8,7 @@
 
 #include <glm/glm.hpp>
 
+#include "draw_range.h"
 #include "glsl_program.h"
 #include "texture.h"
 
@@ -15,17 +16,29 @@ class SkyBox {
 public:
 	SkyBox(const std::vector<std::string>& textureFilenames);
 
+	SkyBox(std::shared_ptr<TextureCubemap> texture);
+
 	SkyBox(SkyBox&& rhs) noexcept;
 
 	~SkyBox();
 
-	void draw(const glm::mat4& projection, const glm::mat4& view);
+	// projection and view come from the FrameData block, the view without its translation
+	void draw();
+
+	// 36 vertices drawn with the cubemap on unit 0 and GL_LEQUAL
+	DrawRange getDrawRange() const;
+
+	GLSLProgram* getProgram() const;
+
+	const TextureCubemap* getTexture() const;
+
+	size_t getGpuBytes() const;
 
 private:
 	GLuint _vao = 0;
 	GLuint _vbo = 0;
 
-	std::unique_ptr<TextureCubemap> _texture;
+	std::shared_ptr<TextureCubemap> _texture;
 
 	std::unique_ptr<GLSLProgram> _myshader;
 
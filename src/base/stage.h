@@ -1,21 +1,48 @@
 #pragma once
 
+#include <cstddef>
+
 #include "window.h"
 #include "input.h"
 
+class AssetLoader;
+
+enum class StageState {
+	Unloaded,
+	Loaded,
+	Active
+};
+
+// A stage goes load -> activate <-> deactivate -> unload. Its assets stream
+// in through the asset loader after load() returns, and updateAssets() binds
+// them as they become resident, so a stage can be shown before it is complete.
 class Stage {
 public:
 	Stage() = default;
 
 	virtual ~Stage() = default;
 
-	virtual void init(Window& window, MouseInput& mouseInput) = 0;
+	// request the assets and create the cheap gpu resources, does not block
+	virtual void load(Window& window, AssetLoader& assetLoader) = 0;
+
+	// bind the assets that became resident, true once every asset is
+	virtual bool updateAssets() = 0;
+
+	// take over input and rendering
+	virtual void activate(Window& window, MouseInput& mouseInput) = 0;
+
+	// stop receiving input, the resources stay resident
+	virtual void deactivate() { }
+
+	// release every resource, the stage can be loaded again later
+	virtual void unload() = 0;
 
-	virtual void deinit() = 0;
+	// bytes of gpu memory held while the stage is loaded
+	virtual size_t getResidentBytes() const = 0;
 
 	virtual void handleInput(
 		Window& window,
-		KeyboardInput& keyboardInput, MouseInput& mouseInput, 
+		KeyboardInput& keyboardInput, MouseInput& mouseInput,
 		float deltaTime) = 0;
 
 	virtual void renderFrame() = 0;
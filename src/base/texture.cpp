@@ -1,14 +1,302 @@
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TEXTURE_USE_SSE2
+#endif
+
+#include "compressed_image.h"
+#include "gl_state.h"
 #include "texture.h"
 
+// s3tc is core in no gl version, glad is generated without the extension
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT  0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+namespace {
+	TextureOptions defaultTextureOptions;
+
+	// the widest unpack alignment that divides the row pitch
+	GLint getUnpackAlignment(int width, int channels) {
+		size_t pitch = width * channels * sizeof(unsigned char);
+		if (pitch % 8 == 0)      return 8;
+		else if (pitch % 4 == 0) return 4;
+		else if (pitch % 2 == 0) return 2;
+		else                     return 1;
+	}
+
+	GLenum getFormat(int channels) {
+		switch (channels) {
+		case 1: return GL_RED;
+		case 3: return GL_RGB;
+		case 4: return GL_RGBA;
+		default:
+			throw std::runtime_error("unsupported format");
+		}
+	}
+
+	GLenum getCompressedFormat(BlockFormat format) {
+		switch (format) {
+		case BlockFormat::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		case BlockFormat::BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		default:
+			throw std::runtime_error("unsupported block format");
+		}
+	}
+
+	int getLevelCount(int width, int height) {
+		int levels = 1;
+		while (width > 1 || height > 1) {
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+			++levels;
+		}
+		return levels;
+	}
+
+	// bytes of level 0 and, with mipmaps, every level below it
+	size_t getChainBytes(int width, int height, int channels, bool mipmaps) {
+		size_t bytes = static_cast<size_t>(width) * height * channels;
+		while (mipmaps && (width > 1 || height > 1)) {
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+			bytes += static_cast<size_t>(width) * height * channels;
+		}
+		return bytes;
+	}
+
+	// sum two rows into 16 bit, 16 bytes per step where sse2 is available
+	void addRows(const unsigned char* row0, const unsigned char* row1, uint16_t* sums, int count) {
+		int i = 0;
+#ifdef TEXTURE_USE_SSE2
+		const __m128i zero = _mm_setzero_si128();
+		for (; i + 16 <= count; i += 16) {
+			const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + i));
+			const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + i));
+			const __m128i low = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+			const __m128i high = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(sums + i), low);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(sums + i + 8), high);
+		}
+#endif
+		for (; i < count; ++i) {
+			sums[i] = static_cast<uint16_t>(row0[i] + row1[i]);
+		}
+	}
+
+	void addRow(const unsigned char* row, uint16_t* sums, int count) {
+		for (int i = 0; i < count; ++i) {
+			sums[i] = static_cast<uint16_t>(sums[i] + row[i]);
+		}
+	}
+
+	// 2x2 box filter. The last texel of an odd size spans three rows or
+	// columns, so that the one the halved size leaves over is not dropped;
+	// a size of 1 is repeated
+	void downsample(
+		const unsigned char* src, int srcWidth, int srcHeight, int channels,
+		unsigned char* dst, int dstWidth, int dstHeight) {
+		const size_t srcPitch = static_cast<size_t>(srcWidth) * channels;
+		const size_t dstPitch = static_cast<size_t>(dstWidth) * channels;
+		const bool oddWidth = srcWidth > 1 && srcWidth % 2 == 1;
+		const bool oddHeight = srcHeight > 1 && srcHeight % 2 == 1;
+		std::vector<uint16_t> sums(srcPitch);
+
+		for (int y = 0; y < dstHeight; ++y) {
+			const unsigned char* row0 = src + std::min(2 * y, srcHeight - 1) * srcPitch;
+			const unsigned char* row1 = src + std::min(2 * y + 1, srcHeight - 1) * srcPitch;
+			addRows(row0, row1, sums.data(), static_cast<int>(srcPitch));
+
+			int rows = 2;
+			if (oddHeight && y == dstHeight - 1) {
+				addRow(src + (2 * y + 2) * srcPitch, sums.data(), static_cast<int>(srcPitch));
+				rows = 3;
+			}
+
+			unsigned char* out = dst + y * dstPitch;
+			for (int x = 0; x < dstWidth; ++x) {
+				const size_t x0 = std::min(2 * x, srcWidth - 1) * channels;
+				const size_t x1 = std::min(2 * x + 1, srcWidth - 1) * channels;
+				const bool wide = oddWidth && x == dstWidth - 1;
+				const size_t x2 = static_cast<size_t>(2 * x + 2) * channels;
+				const int count = rows * (wide ? 3 : 2);
+				for (int c = 0; c < channels; ++c) {
+					const int sum = sums[x0 + c] + sums[x1 + c] + (wide ? sums[x2 + c] : 0);
+					out[x * channels + c] = static_cast<unsigned char>((sum + count / 2) / count);
+				}
+			}
+		}
+	}
+
+	bool hasExtension(const char* extension) {
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (GLint i = 0; i < count; ++i) {
+			const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+			if (std::strcmp(name, extension) == 0) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool supportsAnisotropy() {
+		static const bool supported = []() {
+			GLint major = 0, minor = 0;
+			glGetIntegerv(GL_MAJOR_VERSION, &major);
+			glGetIntegerv(GL_MINOR_VERSION, &minor);
+			if (major > 4 || (major == 4 && minor >= 6)) {
+				return true;
+			}
+
+			return hasExtension("GL_EXT_texture_filter_anisotropic") ||
+				hasExtension("GL_ARB_texture_filter_anisotropic");
+		}();
+		return supported;
+	}
+
+	// filters, anisotropy and the level range of the bound texture
+	void setSampling(GLenum target, const TextureOptions& options, int levels) {
+		GLint minFilter = GL_LINEAR;
+		GLint magFilter = GL_LINEAR;
+		switch (options.filter) {
+		case TextureFilter::Nearest:   minFilter = GL_NEAREST; magFilter = GL_NEAREST; break;
+		case TextureFilter::Linear:    minFilter = GL_LINEAR; break;
+		case TextureFilter::Bilinear:  minFilter = GL_LINEAR_MIPMAP_NEAREST; break;
+		case TextureFilter::Trilinear: minFilter = GL_LINEAR_MIPMAP_LINEAR; break;
+		}
+
+		glTexParameteri(target, GL_TEXTURE_MIN_FILTER, minFilter);
+		glTexParameteri(target, GL_TEXTURE_MAG_FILTER, magFilter);
+		glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+		glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+		if (options.anisotropy > 1.0f && supportsAnisotropy()) {
+			GLfloat maxAnisotropy = 1.0f;
+			glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY, &maxAnisotropy);
+			glTexParameterf(target, GL_TEXTURE_MAX_ANISOTROPY, std::min(options.anisotropy, maxAnisotropy));
+		}
+	}
+
+	// upload every level of an image to a face or a 2d target, the levels the
+	// image does not carry are left to glGenerateMipmap
+	void uploadLevels(GLenum target, const ImageData& image, int levels) {
+		const GLenum format = getFormat(image.getChannels());
+		for (int level = 0; level < std::min(levels, image.getLevelCount()); ++level) {
+			glPixelStorei(GL_UNPACK_ALIGNMENT, getUnpackAlignment(image.getWidth(level), image.getChannels()));
+			glTexImage2D(target, level, format, image.getWidth(level), image.getHeight(level), 0,
+				format, GL_UNSIGNED_BYTE, image.getPixels(level));
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	}
+
+	// upload the block compressed levels, returns their bytes
+	size_t uploadLevels(GLenum target, const CompressedImage& image, int levels) {
+		const GLenum format = getCompressedFormat(image.getFormat());
+		size_t bytes = 0;
+		for (int level = 0; level < levels; ++level) {
+			glCompressedTexImage2D(target, level, format, image.getWidth(level), image.getHeight(level), 0,
+				static_cast<GLsizei>(image.getSize(level)), image.getData(level));
+			bytes += image.getSize(level);
+		}
+		return bytes;
+	}
+
+	std::vector<ImageData> decodeImages(const std::vector<std::string>& paths, bool mipmaps) {
+		std::vector<ImageData> images;
+		images.reserve(paths.size());
+		for (const auto& path : paths) {
+			images.emplace_back(path, mipmaps);
+		}
+		return images;
+	}
+}
+
+void SetDefaultTextureOptions(const TextureOptions& options) {
+	defaultTextureOptions = options;
+}
+
+const TextureOptions& GetDefaultTextureOptions() {
+	return defaultTextureOptions;
+}
+
+bool SupportsTextureCompression() {
+	static const bool supported = hasExtension("GL_EXT_texture_compression_s3tc");
+	return supported;
+}
+
+ImageData::ImageData(const std::string& path, bool mipmaps): _path(path) {
+	// load image to the memory
+//	stbi_set_flip_vertically_on_load(true);
+	_pixels.reset(stbi_load(_path.c_str(), &_width, &_height, &_channels, 0));
+	if (_pixels == nullptr) {
+		throw std::runtime_error("load " + path + " failure");
+	}
+
+	if (mipmaps) {
+		generateMipmaps();
+	}
+}
+
+void ImageData::generateMipmaps() {
+	while (getWidth(getLevelCount() - 1) > 1 || getHeight(getLevelCount() - 1) > 1) {
+		const int level = getLevelCount() - 1;
+		MipLevel mip;
+		mip.width = std::max(1, getWidth(level) / 2);
+		mip.height = std::max(1, getHeight(level) / 2);
+		mip.pixels.resize(static_cast<size_t>(mip.width) * mip.height * _channels);
+		downsample(getPixels(level), getWidth(level), getHeight(level), _channels,
+			mip.pixels.data(), mip.width, mip.height);
+		_mipmaps.push_back(std::move(mip));
+	}
+}
+
+const std::string& ImageData::getPath() const {
+	return _path;
+}
+
+int ImageData::getLevelCount() const {
+	return 1 + static_cast<int>(_mipmaps.size());
+}
+
+const unsigned char* ImageData::getPixels(int level) const {
+	return level == 0 ? _pixels.get() : _mipmaps[level - 1].pixels.data();
+}
+
+int ImageData::getWidth(int level) const {
+	return level == 0 ? _width : _mipmaps[level - 1].width;
+}
+
+int ImageData::getHeight(int level) const {
+	return level == 0 ? _height : _mipmaps[level - 1].height;
+}
+
+int ImageData::getChannels() const {
+	return _channels;
+}
+
+size_t ImageData::getBytes() const {
+	size_t bytes = static_cast<size_t>(_width) * _height * _channels;
+	for (const auto& mip : _mipmaps) {
+		bytes += mip.pixels.size();
+	}
+	return bytes;
+}
+
 Texture::Texture() {
 	// create texture object
 	glGenTextures(1, &_handle);
 }
 
-Texture::Texture(Texture&& rhs) noexcept: _handle(rhs._handle) {
+Texture::Texture(Texture&& rhs) noexcept: _handle(rhs._handle), _gpuBytes(rhs._gpuBytes) {
 	rhs._handle = 0;
+	rhs._gpuBytes = 0;
 }
 
 Texture::~Texture() {
@@ -23,6 +311,10 @@ GLuint Texture::getHandle() const {
 	return _handle;
 }
 
+size_t Texture::getGpuBytes() const {
+	return _gpuBytes;
+}
+
 void Texture::cleanup() {
 	if (_handle != 0) {
 		glDeleteTextures(1, &_handle);
@@ -30,57 +322,60 @@ void Texture::cleanup() {
 	}
 }
 
-Texture2D::Texture2D(const std::string path): _path(path) {
-	// load image to the memory
-//	stbi_set_flip_vertically_on_load(true);
-	int width = 0, height = 0, channels = 0;
-	unsigned char* data = stbi_load(_path.c_str(), &width, &height, &channels, 0);
-	if (data == nullptr) {
-		cleanup();
-		throw std::runtime_error("load " + path + " failure");
-	}
+Texture2D::Texture2D(const std::string path, const TextureOptions& options)
+	: Texture2D(ImageData(path, options.usesMipmaps() && options.cpuMipmaps), options) { }
 
-	// choose image format
-	GLenum format = GL_RGB;
-	switch (channels) {
-	case 1: format = GL_RED;  break;
-	case 3: format = GL_RGB;  break;
-	case 4: format = GL_RGBA; break;
-	default:
-		cleanup();
-		stbi_image_free(data);
-		throw std::runtime_error("unsupported format");
-	}
+Texture2D::Texture2D(const ImageData& image, const TextureOptions& options): _path(image.getPath()) {
+	const int width = image.getWidth();
+	const int height = image.getHeight();
+	const int levels = options.usesMipmaps() ? getLevelCount(width, height) : 1;
 
 	// set texture parameters
 	glBindTexture(GL_TEXTURE_2D, _handle);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-
-	// transfer data to gpu
-	// 1. set alignment for data transfer
-	GLint alignment = 1;
-	size_t pitch = width * channels * sizeof(unsigned char);
-	if (pitch % 8 == 0)      alignment = 8;
-	else if (pitch % 4 == 0) alignment = 4;
-	else if (pitch % 2 == 0) alignment = 2;
-	else                     alignment = 1;
+	setSampling(GL_TEXTURE_2D, options, levels);
 
-	glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
-
-	// 2. transfer data
-	glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+	// transfer data to gpu, the mip chain of the image if it has one
+	try {
+		uploadLevels(GL_TEXTURE_2D, image, levels);
+	}
+	catch (const std::exception&) {
+		glBindTexture(GL_TEXTURE_2D, 0);
+		cleanup();
+		throw;
+	}
 
-	// 3. restore alignment
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	if (levels > image.getLevelCount()) {
+		glGenerateMipmap(GL_TEXTURE_2D);
+	}
 
 	// unbind texture
 	glBindTexture(GL_TEXTURE_2D, 0);
 
-	// free data
-	stbi_image_free(data);
+	_gpuBytes = getChainBytes(width, height, image.getChannels(), levels > 1);
+
+	GLenum error = glGetError();
+	if (error != GL_NO_ERROR) {
+		std::stringstream ss;
+		ss << "texture object operation failure, (code " << error << ")";
+		cleanup();
+		throw std::runtime_error(ss.str());
+	}
+}
+
+Texture2D::Texture2D(const CompressedImage& image, const TextureOptions& options): _path(image.getPath()) {
+	const int levels = options.usesMipmaps() ? image.getLevelCount() : 1;
+
+	glBindTexture(GL_TEXTURE_2D, _handle);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	setSampling(GL_TEXTURE_2D, options, levels);
+
+	// the blocks go to the gpu as they are, there is nothing to decode
+	_gpuBytes = uploadLevels(GL_TEXTURE_2D, image, levels);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
 
 	GLenum error = glGetError();
 	if (error != GL_NO_ERROR) {
@@ -97,61 +392,43 @@ Texture2D::Texture2D(Texture2D&& rhs) noexcept
 	rhs._path = "";
 }
 
-void Texture2D::bind() const {
-	glBindTexture(GL_TEXTURE_2D, _handle);
+void Texture2D::bind(int unit) const {
+	GLState::getInstance().bindTexture(GL_TEXTURE_2D, _handle, unit);
 }
 
-void Texture2D::unbind() const {
-	glBindTexture(GL_TEXTURE_2D, 0);
+void Texture2D::unbind(int unit) const {
+	GLState::getInstance().bindTexture(GL_TEXTURE_2D, 0, unit);
 }
 
-TextureCubemap::TextureCubemap(const std::vector<std::string>& filenames)
-	: _paths(filenames) {
-	assert(filenames.size() == 6);
-	// TODO: load 6 images and generate texture cubemap
-	// hint: you can refer to Texture2D(const std::string&) for image loading
-	// write your code here
-	// -----------------------------------------------
-	for (unsigned int i = 0; i < _paths.size(); i++) {
-//		stbi_set_flip_vertically_on_load(true);
-		int width = 0, height = 0, channels = 0;
-		unsigned char* data = stbi_load(_paths[i].c_str(), &width, &height, &channels, 0);
+TextureCubemap::TextureCubemap(const std::vector<std::string>& filenames, const TextureOptions& options)
+	: TextureCubemap(decodeImages(filenames, options.usesMipmaps() && options.cpuMipmaps), options) { }
 
-		if (data == nullptr) {
-			cleanup();
-			throw std::runtime_error("load " + _paths[i] + " failure");
-		}
+TextureCubemap::TextureCubemap(const std::vector<ImageData>& faces, const TextureOptions& options) {
+	assert(faces.size() == 6);
+	const int levels = options.usesMipmaps() ? getLevelCount(faces[0].getWidth(), faces[0].getHeight()) : 1;
 
-		GLenum format = GL_RGB;
-		switch (channels) {
-		case 1: format = GL_RED;  break;
-		case 3: format = GL_RGB;  break;
-		case 4: format = GL_RGBA; break;
-		default:
+	glBindTexture(GL_TEXTURE_CUBE_MAP, _handle);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	setSampling(GL_TEXTURE_CUBE_MAP, options, levels);
+
+	bool generate = false;
+	for (unsigned int i = 0; i < faces.size(); i++) {
+		const ImageData& face = faces[i];
+		_paths.push_back(face.getPath());
+
+		try {
+			uploadLevels(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, face, levels);
+		}
+		catch (const std::exception&) {
+			glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
 			cleanup();
-			stbi_image_free(data);
-			throw std::runtime_error("unsupported format");
+			throw;
 		}
 
-		glBindTexture(GL_TEXTURE_CUBE_MAP, _handle);
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		GLint alignment = 1;
-		size_t pitch = width * channels * sizeof(unsigned char);
-		if (pitch % 8 == 0)      alignment = 8;
-		else if (pitch % 4 == 0) alignment = 4;
-		else if (pitch % 2 == 0) alignment = 2;
-		else                     alignment = 1;
-
-		glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-
-		stbi_image_free(data);
+		generate = generate || levels > face.getLevelCount();
+		_gpuBytes += getChainBytes(face.getWidth(), face.getHeight(), face.getChannels(), levels > 1);
 
 		GLenum error = glGetError();
 		if (error != GL_NO_ERROR) {
@@ -160,9 +437,43 @@ TextureCubemap::TextureCubemap(const std::vector<std::string>& filenames)
 			cleanup();
 			throw std::runtime_error(ss.str());
 		}
-		glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
 	}
-	// -----------------------------------------------
+
+	if (generate) {
+		glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+	}
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+}
+
+TextureCubemap::TextureCubemap(const std::vector<CompressedImage>& faces, const TextureOptions& options) {
+	assert(faces.size() == 6);
+	for (const auto& face : faces) {
+		if (face.getFormat() != faces[0].getFormat() || face.getLevelCount() != faces[0].getLevelCount()) {
+			cleanup();
+			throw std::runtime_error("cubemap faces differ in block format or levels");
+		}
+	}
+	const int levels = options.usesMipmaps() ? faces[0].getLevelCount() : 1;
+
+	glBindTexture(GL_TEXTURE_CUBE_MAP, _handle);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	setSampling(GL_TEXTURE_CUBE_MAP, options, levels);
+
+	for (unsigned int i = 0; i < faces.size(); i++) {
+		_paths.push_back(faces[i].getPath());
+		_gpuBytes += uploadLevels(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, faces[i], levels);
+	}
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+	GLenum error = glGetError();
+	if (error != GL_NO_ERROR) {
+		std::stringstream ss;
+		ss << "texture object operation failure, (code " << error << ")";
+		cleanup();
+		throw std::runtime_error(ss.str());
+	}
 }
 
 TextureCubemap::TextureCubemap(TextureCubemap&& rhs) noexcept
@@ -172,12 +483,12 @@ TextureCubemap::TextureCubemap(TextureCubemap&& rhs) noexcept
 }
 
 
-void TextureCubemap::bind() const {
-	glBindTexture(GL_TEXTURE_CUBE_MAP, _handle);
+void TextureCubemap::bind(int unit) const {
+	GLState::getInstance().bindTexture(GL_TEXTURE_CUBE_MAP, _handle, unit);
 }
 
-void TextureCubemap::unbind() const {
-	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+void TextureCubemap::unbind(int unit) const {
+	GLState::getInstance().bindTexture(GL_TEXTURE_CUBE_MAP, 0, unit);
 }
 
 DataTexture::DataTexture(GLenum internalFormat, int width, int height, GLenum format, GLenum dataType) {
@@ -193,10 +504,10 @@ DataTexture::DataTexture(GLenum internalFormat, int width, int height, GLenum fo
 DataTexture::DataTexture(DataTexture&& rhs) noexcept
 	: Texture(std::move(rhs)) { }
 
-void DataTexture::bind() const {
-	glBindTexture(GL_TEXTURE_2D, _handle);
+void DataTexture::bind(int unit) const {
+	GLState::getInstance().bindTexture(GL_TEXTURE_2D, _handle, unit);
 }
 
-void DataTexture::unbind() const {
-	glBindTexture(GL_TEXTURE_2D, 0);
+void DataTexture::unbind(int unit) const {
+	GLState::getInstance().bindTexture(GL_TEXTURE_2D, 0, unit);
 }
\ No newline at end of file
@@ -3,10 +3,91 @@
 #include <string>
 #include <sstream>
 #include <vector>
+#include <memory>
 
 #include <glad/glad.h>
 #include <stb_image.h>
 
+enum class TextureFilter {
+	Nearest,    // nearest texel of level 0
+	Linear,     // bilinear within level 0
+	Bilinear,   // bilinear within the nearest mip level
+	Trilinear   // bilinear within and linear between mip levels
+};
+
+struct TextureOptions {
+	TextureFilter filter = TextureFilter::Trilinear;
+
+	// maximum anisotropy, 1 turns it off; clamped to what the driver supports
+	float anisotropy = 8.0f;
+
+	// build the mip chain on the cpu while decoding, otherwise glGenerateMipmap
+	bool cpuMipmaps = true;
+
+	// keep the mip chain block compressed on the gpu where the driver supports
+	// it, the blocks are cached on disk after the first load
+	bool compress = true;
+
+	bool usesMipmaps() const {
+		return filter == TextureFilter::Bilinear || filter == TextureFilter::Trilinear;
+	}
+};
+
+// options used by textures when the caller does not pass its own
+void SetDefaultTextureOptions(const TextureOptions& options);
+const TextureOptions& GetDefaultTextureOptions();
+
+// true if the driver takes s3tc (bc1 - bc3) textures, only call it on the gl thread
+bool SupportsTextureCompression();
+
+class CompressedImage;
+
+// Decoded pixels of an image file, the cpu half of a texture. Decoding does
+// not touch opengl, so it can run on a worker thread.
+class ImageData {
+public:
+	// throws if the image cannot be decoded
+	ImageData(const std::string& path, bool mipmaps = false);
+
+	ImageData(ImageData&& rhs) noexcept = default;
+
+	~ImageData() = default;
+
+	// append levels down to 1x1, each a 2x2 box filter of the previous one
+	void generateMipmaps();
+
+	const std::string& getPath() const;
+
+	int getLevelCount() const;
+
+	const unsigned char* getPixels(int level = 0) const;
+
+	int getWidth(int level = 0) const;
+
+	int getHeight(int level = 0) const;
+
+	int getChannels() const;
+
+	// bytes of all levels
+	size_t getBytes() const;
+
+private:
+	struct MipLevel {
+		int width;
+		int height;
+		std::vector<unsigned char> pixels;
+	};
+
+	std::string _path;
+	int _width = 0;
+	int _height = 0;
+	int _channels = 0;
+	std::unique_ptr<unsigned char, void(*)(void*)> _pixels{ nullptr, stbi_image_free };
+
+	// levels 1 and below
+	std::vector<MipLevel> _mipmaps;
+};
+
 class Texture {
 public:
 	Texture();
@@ -15,29 +96,39 @@ public:
 
 	virtual ~Texture();
 
-	virtual void bind() const = 0;
+	// through the state tracker, redundant binds are skipped
+	virtual void bind(int unit = 0) const = 0;
 
-	virtual void unbind() const = 0;
+	virtual void unbind(int unit = 0) const = 0;
 
 	GLuint getHandle() const;
 
+	// bytes of gpu memory held by the texture
+	size_t getGpuBytes() const;
+
 protected:
 	GLuint _handle = {};
+	size_t _gpuBytes = 0;
 
 	virtual void cleanup();
 };
 
 class Texture2D : public Texture {
 public:
-	Texture2D(const std::string path);
+	Texture2D(const std::string path, const TextureOptions& options = GetDefaultTextureOptions());
+
+	Texture2D(const ImageData& image, const TextureOptions& options = GetDefaultTextureOptions());
+
+	// the levels are uploaded as they are, the image must carry the mip chain it samples
+	Texture2D(const CompressedImage& image, const TextureOptions& options = GetDefaultTextureOptions());
 
 	Texture2D(Texture2D&& rhs) noexcept;
 
 	~Texture2D() = default;
 
-	void bind() const override;
+	void bind(int unit = 0) const override;
 
-	virtual void unbind() const;
+	void unbind(int unit = 0) const override;
 
 private:
 	std::string _path;
@@ -45,15 +136,27 @@ private:
 
 class TextureCubemap : public Texture {
 public:
-	TextureCubemap(const std::vector<std::string>& filenames);
+	TextureCubemap(
+		const std::vector<std::string>& filenames,
+		const TextureOptions& options = GetDefaultTextureOptions());
+
+	// faces in the order +x, -x, +y, -y, +z, -z
+	TextureCubemap(
+		const std::vector<ImageData>& faces,
+		const TextureOptions& options = GetDefaultTextureOptions());
+
+	// faces in the same order, all of one block format
+	TextureCubemap(
+		const std::vector<CompressedImage>& faces,
+		const TextureOptions& options = GetDefaultTextureOptions());
 
 	TextureCubemap(TextureCubemap&& rhs) noexcept;
 
 	~TextureCubemap() = default;
 
-	void bind() const override;
+	void bind(int unit = 0) const override;
 
-	void unbind() const override;
+	void unbind(int unit = 0) const override;
 
 private:
 	std::vector<std::string> _paths;
@@ -67,7 +170,7 @@ public:
 
 	~DataTexture() = default;
 
-	void bind() const override;
+	void bind(int unit = 0) const override;
 
-	virtual void unbind() const;
+	void unbind(int unit = 0) const override;
 };
\ No newline at end of file
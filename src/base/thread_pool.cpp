@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+#include "thread_pool.h"
+
+namespace {
+	thread_local ThreadPool* currentPool = nullptr;
+
+	// the indices of a parallel loop, claimed one at a time by every thread taking part
+	struct ParallelLoop {
+		std::atomic<size_t> next{ 0 };
+		size_t count = 0;
+		std::function<void(size_t)> body;
+
+		std::mutex mutex;
+		std::condition_variable finishedCondition;
+		size_t finished = 0;
+		std::exception_ptr error;
+
+		void run() {
+			for (size_t i = next++; i < count; i = next++) {
+				try {
+					body(i);
+				}
+				catch (...) {
+					std::lock_guard<std::mutex> lock(mutex);
+					if (!error) {
+						error = std::current_exception();
+					}
+				}
+
+				std::lock_guard<std::mutex> lock(mutex);
+				if (++finished == count) {
+					finishedCondition.notify_all();
+				}
+			}
+		}
+
+		void wait() {
+			std::unique_lock<std::mutex> lock(mutex);
+			finishedCondition.wait(lock, [this]() { return finished == count; });
+			if (error) {
+				std::rethrow_exception(error);
+			}
+		}
+	};
+
+	size_t getThreadLimit(int numThreads) {
+		return numThreads > 0 ?
+			static_cast<size_t>(numThreads) : std::max(1u, std::thread::hardware_concurrency());
+	}
+}
+
+ThreadPool::ThreadPool(int numThreads) {
+	const size_t count = getThreadLimit(numThreads);
+	for (size_t i = 0; i < count; ++i) {
+		_workers.emplace_back(&ThreadPool::run, this);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+		_tasks.clear();
+	}
+	_condition.notify_all();
+
+	for (auto& worker : _workers) {
+		worker.join();
+	}
+}
+
+std::future<void> ThreadPool::submit(std::packaged_task<void()> task) {
+	std::future<void> result = task.get_future();
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_tasks.push_back(std::move(task));
+	}
+	_condition.notify_one();
+	return result;
+}
+
+size_t ThreadPool::getThreadCount() const {
+	return _workers.size();
+}
+
+size_t ThreadPool::getPendingCount() const {
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _tasks.size();
+}
+
+void ThreadPool::parallelFor(size_t count, size_t maxThreads, const std::function<void(size_t)>& body) {
+	if (count == 0) {
+		return;
+	}
+
+	// shared with the helper tasks, which may only start after the loop is done
+	auto loop = std::make_shared<ParallelLoop>();
+	loop->count = count;
+	loop->body = body;
+
+	const size_t helpers = std::min({ count, maxThreads, _workers.size() + 1 }) - 1;
+	for (size_t i = 0; i < helpers; ++i) {
+		submit(std::packaged_task<void()>([loop]() { loop->run(); }));
+	}
+
+	loop->run();
+	loop->wait();
+}
+
+ThreadPool* ThreadPool::getCurrent() {
+	return currentPool;
+}
+
+void ThreadPool::run() {
+	currentPool = this;
+	for (;;) {
+		std::packaged_task<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_condition.wait(lock, [this]() { return _stop || !_tasks.empty(); });
+			if (_stop) {
+				return;
+			}
+			task = std::move(_tasks.front());
+			_tasks.pop_front();
+		}
+		task();
+	}
+}
+
+void ParallelFor(size_t count, int numThreads, const std::function<void(size_t)>& body) {
+	const size_t maxThreads = getThreadLimit(numThreads);
+	if (ThreadPool* pool = ThreadPool::getCurrent()) {
+		pool->parallelFor(count, maxThreads, body);
+		return;
+	}
+
+	if (count == 0) {
+		return;
+	}
+
+	ParallelLoop loop;
+	loop.count = count;
+	loop.body = body;
+
+	std::vector<std::thread> workers;
+	for (size_t i = 1; i < std::min(count, maxThreads); ++i) {
+		workers.emplace_back(&ParallelLoop::run, &loop);
+	}
+	loop.run();
+	for (auto& worker : workers) {
+		worker.join();
+	}
+	loop.wait();
+}
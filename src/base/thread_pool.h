@@ -0,0 +1,50 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running queued tasks in submission order.
+class ThreadPool {
+public:
+	// 0 threads for one per core
+	ThreadPool(int numThreads = 0);
+
+	ThreadPool(const ThreadPool&) = delete;
+
+	// waits for the running tasks, the ones not started yet are discarded
+	~ThreadPool();
+
+	std::future<void> submit(std::packaged_task<void()> task);
+
+	size_t getThreadCount() const;
+
+	size_t getPendingCount() const;
+
+	// Run body for every index below count on the calling thread and on up to
+	// maxThreads - 1 workers. The caller takes part and only waits for indices
+	// already running, so a task of the pool may call it without deadlocking
+	// when every worker is busy. Rethrows the first exception of body.
+	void parallelFor(size_t count, size_t maxThreads, const std::function<void(size_t)>& body);
+
+	// the pool whose worker runs the calling thread, null on other threads
+	static ThreadPool* getCurrent();
+
+private:
+	std::vector<std::thread> _workers;
+	mutable std::mutex _mutex;
+	std::condition_variable _condition;
+	std::deque<std::packaged_task<void()>> _tasks;
+	bool _stop = false;
+
+	void run();
+};
+
+// Run body for every index below count with up to numThreads threads, 0 for
+// one per core. Work done on a pool's worker goes to that pool instead of
+// starting threads, so nested parallel work does not oversubscribe the cores.
+void ParallelFor(size_t count, int numThreads, const std::function<void(size_t)>& body);
@@ -0,0 +1,98 @@
+#include <cstring>
+#include <stdexcept>
+
+#include "uniform_buffer.h"
+
+GLuint GetUniformBlockBinding(const char* blockName) {
+	if (std::strcmp(blockName, "FrameData") == 0) {
+		return kFrameDataBinding;
+	}
+	if (std::strcmp(blockName, "LightData") == 0) {
+		return kLightDataBinding;
+	}
+	return GL_INVALID_INDEX;
+}
+
+FrameData MakeFrameData(const Camera& camera) {
+	FrameData data = {};
+	data.projection = camera.getProjectionMatrix();
+	data.view = camera.getViewMatrix();
+	data.eyePosition = camera.position;
+	return data;
+}
+
+LightData MakeLightData(
+	const AmbientLight& ambientLight,
+	const DirectionalLight& directionalLight,
+	const SpotLight& spotLight) {
+	LightData data = {};
+	data.ambientColor = ambientLight.color;
+	data.ambientIntensity = ambientLight.intensity;
+
+	data.directionalDirection = directionalLight.getFront();
+	data.directionalIntensity = directionalLight.intensity;
+	data.directionalColor = directionalLight.color;
+
+	data.spotPosition = spotLight.position;
+	data.spotDirection = spotLight.getFront();
+	data.spotIntensity = spotLight.intensity;
+	data.spotColor = spotLight.color;
+	data.spotAngle = spotLight.angle;
+	data.spotKc = spotLight.kc;
+	data.spotKl = spotLight.kl;
+	data.spotKq = spotLight.kq;
+	return data;
+}
+
+UniformBuffer::UniformBuffer(GLuint binding, size_t size)
+	: _binding(binding), _data(size) {
+	glGenBuffers(1, &_handle);
+	if (_handle == 0) {
+		throw std::runtime_error("create uniform buffer failure");
+	}
+
+	glBindBuffer(GL_UNIFORM_BUFFER, _handle);
+	glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+UniformBuffer::UniformBuffer(UniformBuffer&& rhs) noexcept
+	: _handle(rhs._handle),
+	  _binding(rhs._binding),
+	  _data(std::move(rhs._data)),
+	  _uploaded(rhs._uploaded) {
+	rhs._handle = 0;
+}
+
+UniformBuffer::~UniformBuffer() {
+	if (_handle != 0) {
+		glDeleteBuffers(1, &_handle);
+		_handle = 0;
+	}
+}
+
+void UniformBuffer::bind() const {
+	glBindBufferBase(GL_UNIFORM_BUFFER, _binding, _handle);
+}
+
+bool UniformBuffer::update(const void* data) {
+	if (_uploaded && std::memcmp(_data.data(), data, _data.size()) == 0) {
+		return false;
+	}
+
+	std::memcpy(_data.data(), data, _data.size());
+	_uploaded = true;
+
+	glBindBuffer(GL_UNIFORM_BUFFER, _handle);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, _data.size(), _data.data());
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	return true;
+}
+
+GLuint UniformBuffer::getBinding() const {
+	return _binding;
+}
+
+size_t UniformBuffer::getSize() const {
+	return _data.size();
+}
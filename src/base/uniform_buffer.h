@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "camera.h"
+#include "light.h"
+
+// Fixed binding points of the uniform blocks shared by every program,
+// GLSLProgram::link connects the blocks it finds by name.
+constexpr GLuint kFrameDataBinding = 0;
+constexpr GLuint kLightDataBinding = 1;
+
+// binding point of a block name, GL_INVALID_INDEX for blocks that are not shared
+GLuint GetUniformBlockBinding(const char* blockName);
+
+// GLSL declarations of the blocks, to be spliced into shader sources
+#define FRAME_DATA_GLSL \
+	"layout(std140) uniform FrameData {\n" \
+	"	mat4 projection;\n" \
+	"	mat4 view;\n" \
+	"	vec3 eyePosition;\n" \
+	"};\n"
+
+#define LIGHT_DATA_GLSL \
+	"struct AmbientLight {\n" \
+	"	vec3 color;\n" \
+	"	float intensity;\n" \
+	"};\n" \
+	"struct DirectionalLight {\n" \
+	"	vec3 direction;\n" \
+	"	float intensity;\n" \
+	"	vec3 color;\n" \
+	"};\n" \
+	"struct SpotLight {\n" \
+	"	vec3 position;\n" \
+	"	vec3 direction;\n" \
+	"	float intensity;\n" \
+	"	vec3 color;\n" \
+	"	float angle;\n" \
+	"	float kc;\n" \
+	"	float kl;\n" \
+	"	float kq;\n" \
+	"};\n" \
+	"layout(std140) uniform LightData {\n" \
+	"	AmbientLight ambientLight;\n" \
+	"	DirectionalLight directionalLight;\n" \
+	"	SpotLight spotLight;\n" \
+	"};\n"
+
+// std140 layout of FrameData, a vec3 takes the space of a vec4
+struct FrameData {
+	glm::mat4 projection;
+	glm::mat4 view;
+	glm::vec3 eyePosition;
+	float padding0;
+};
+
+// std140 layout of LightData, every struct starts on 16 bytes
+struct LightData {
+	glm::vec3 ambientColor;
+	float ambientIntensity;
+
+	glm::vec3 directionalDirection;
+	float directionalIntensity;
+	glm::vec3 directionalColor;
+	float padding0;
+
+	glm::vec3 spotPosition;
+	float padding1;
+	glm::vec3 spotDirection;
+	float spotIntensity;
+	glm::vec3 spotColor;
+	float spotAngle;
+	float spotKc;
+	float spotKl;
+	float spotKq;
+	float padding2;
+};
+
+static_assert(sizeof(FrameData) == 144, "FrameData does not match std140");
+static_assert(offsetof(LightData, directionalDirection) == 16, "LightData does not match std140");
+static_assert(offsetof(LightData, spotPosition) == 48, "LightData does not match std140");
+static_assert(offsetof(LightData, spotDirection) == 64, "LightData does not match std140");
+static_assert(offsetof(LightData, spotColor) == 80, "LightData does not match std140");
+static_assert(sizeof(LightData) == 112, "LightData does not match std140");
+
+FrameData MakeFrameData(const Camera& camera);
+
+LightData MakeLightData(
+	const AmbientLight& ambientLight,
+	const DirectionalLight& directionalLight,
+	const SpotLight& spotLight);
+
+// A uniform buffer for one block at a fixed binding point. It keeps a copy
+// of its contents and only uploads when they change.
+class UniformBuffer {
+public:
+	UniformBuffer(GLuint binding, size_t size);
+
+	UniformBuffer(const UniformBuffer&) = delete;
+
+	UniformBuffer(UniformBuffer&& rhs) noexcept;
+
+	~UniformBuffer();
+
+	// attach the buffer to its binding point, once whenever its owner becomes active
+	void bind() const;
+
+	// returns whether the data differed and was uploaded
+	bool update(const void* data);
+
+	GLuint getBinding() const;
+
+	size_t getSize() const;
+
+private:
+	GLuint _handle = 0;
+	GLuint _binding = 0;
+
+	std::vector<unsigned char> _data;
+	bool _uploaded = false;
+};
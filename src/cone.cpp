@@ -1,3 +1,5 @@
+#include "./base/gl_state.h"
+#include "shader_registry.h"
 #include "cone.h"
 
 Cone::Cone() {
@@ -39,48 +41,14 @@ Cone::Cone() {
             }
     }
 
-    // create vao and vbo
-    glGenVertexArrays(1, &_vao);
-    glGenBuffers(1, &_vbo);
-    glGenBuffers(1, &_ebo);
-
-    glBindVertexArray(_vao);
-    
-    glBindBuffer(GL_ARRAY_BUFFER, _vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), &vertices, GL_STATIC_DRAW);
-    
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), &indices, GL_STATIC_DRAW);
-    
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-   
-    glBindVertexArray(0);
+    _geometry = GeometryArena::getInstance().allocate(GeometryLayout::positions(),
+        vertices, sizeof(vertices) / (3 * sizeof(vertices[0])),
+        indices, sizeof(indices) / sizeof(indices[0]), GL_UNSIGNED_INT);
 
     try {
 
-        const char* vsCode =
-            "#version 330 core\n"
-            "layout(location = 0) in vec3 aPosition;\n"
-            "uniform mat4 projection;\n"
-            "uniform mat4 view;\n"
-            "uniform mat4 model;\n"
-            "void main() {\n"
-            "mat4 model = mat4(1.0f);"
-            "   gl_Position = (projection * view * model * vec4(aPosition, 1.0f));\n"
-            "}\n";
-
-        const char* fsCode =
-            "#version 330 core\n"
-            "out vec4 color;\n"
-            "void main() {\n"
-            "   color = vec4(1.0 , 0.0 , 0.0 , 1.0);\n"
-            "}\n";
-
-        _shader.reset(new GLSLProgram);
-        _shader->attachVertexShader(vsCode);
-        _shader->attachFragmentShader(fsCode);
-        _shader->link();
+        // the flat color program is shared by every primitive
+        _shader = AcquireFlatColorProgram();
     } catch (const std::exception&) {
         cleanup();
         throw;
@@ -98,45 +66,38 @@ Cone::Cone() {
 }
 
 Cone::Cone(Cone&& rhs) noexcept
-    : _vao(rhs._vao),
-      _vbo(rhs._vbo),
-      _ebo(rhs._ebo),
-      _shader(std::move(rhs._shader)) {
-    rhs._vao = 0;
-    rhs._vbo = 0;
-    rhs._ebo = 0;
-}
+    : _geometry(std::move(rhs._geometry)),
+      _shader(std::move(rhs._shader)) { }
 
 
 Cone::~Cone() {
     cleanup();
 }
 
-void Cone::draw(const glm::mat4& projection, const glm::mat4& view) {
-    glDepthFunc(GL_LEQUAL);
+void Cone::draw() {
+    GLState::getInstance().setDepthFunc(GL_LEQUAL);
     _shader->use();
-    _shader->setMat4("view",view);
-    _shader->setMat4("projection",projection);
-    glBindVertexArray(_vao);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,_ebo);
-    glDrawElements(GL_TRIANGLES, 60000, GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
-    glDepthFunc(GL_LESS);
+    _shader->setVec4("flatColor", color);
+    const DrawRange range = getDrawRange();
+    GLState::getInstance().bindVertexArray(range.vao);
+    range.draw();
 
 }
 
-void Cone::cleanup() {
-    if (_vbo != 0) {
-        glDeleteBuffers(1, &_vbo);
-        _vbo = 0;
-    }
+DrawRange Cone::getDrawRange() const {
+    DrawRange range = _geometry.getDrawRange();
+    range.count = 60000;
+    return range;
+}
 
-    if (_vao != 0) {
-        glDeleteVertexArrays(1, &_vao);
-        _vao = 0;
-    }
-    if (_ebo != 0) {
-        glDeleteVertexArrays(1, &_ebo);
-        _ebo = 0;
-    }
+GLSLProgram* Cone::getProgram() const {
+    return _shader.get();
+}
+
+const GeometryAllocation& Cone::getGeometry() const {
+    return _geometry;
+}
+
+void Cone::cleanup() {
+    _geometry.reset();
 }
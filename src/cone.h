@@ -7,7 +7,9 @@
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include "./base/draw_range.h"
 #include "./base/glsl_program.h"
+#include "geometry_arena.h"
 
 class Cone {
 public:
@@ -17,14 +19,22 @@ public:
 
     ~Cone();
 
-    void draw(const glm::mat4& projection, const glm::mat4& view);
+    // projection and view come from the FrameData block
+    void draw();
+
+    DrawRange getDrawRange() const;
+
+    GLSLProgram* getProgram() const;
+
+    // read back by the static batch
+    const GeometryAllocation& getGeometry() const;
+
+    glm::vec4 color = glm::vec4(1.0f, 0.0f, 0.0f, 1.0f);
 
 private:
-    GLuint _vao = 0;
-    GLuint _vbo = 0;
-    GLuint _ebo = 0;
+    GeometryAllocation _geometry;
 
-    std::unique_ptr<GLSLProgram> _shader;
+    std::shared_ptr<GLSLProgram> _shader;
 
     void cleanup();
 };
@@ -7,8 +7,10 @@
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include "./base/draw_range.h"
 #include "./base/glsl_program.h"
 #include "./base/bounding_box.h"
+#include "geometry_arena.h"
 
 class Cube {
 public:
@@ -23,20 +25,25 @@ public:
 
 	//virtual void drawBoundingBox() const;
 
-    void draw(const glm::mat4& projection, const glm::mat4& view);
+    // projection and view come from the FrameData block
+    void draw();
+
+    DrawRange getDrawRange() const;
+
+    GLSLProgram* getProgram() const;
+
+    // read back by the static batch
+    const GeometryAllocation& getGeometry() const;
+
+    glm::vec4 color = glm::vec4(1.0f, 0.0f, 1.0f, 1.0f);
 
 private:
-    GLuint _vao = 0;
-    GLuint _vbo = 0;
-    GLuint _ebo = 0;
-	GLuint _boxVao = 0;
-	GLuint _boxVbo = 0;
-	GLuint _boxEbo = 0;
+    GeometryAllocation _geometry;
 	//BoundingBox _boundingBox;
 	//void computeBoundingBox();
 	//void initBoxGLResources();
 
-    std::unique_ptr<GLSLProgram> _shader;
+    std::shared_ptr<GLSLProgram> _shader;
 
     void cleanup();
 };
@@ -0,0 +1,603 @@
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+#include "./base/gl_state.h"
+#include "geometry_arena.h"
+
+namespace {
+	// a pool starts with room for a typical obj mesh and doubles from there
+	constexpr size_t kInitialVertices = 1 << 16;
+	constexpr size_t kInitialIndexUnits = 1 << 18;
+
+	constexpr size_t kIndexUnit = 4;
+
+	size_t getIndexSize(GLenum indexType) {
+		return indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+	}
+
+	size_t roundUpToPowerOfTwo(size_t value) {
+		size_t result = 1;
+		while (result < value) {
+			result *= 2;
+		}
+		return result;
+	}
+
+	// a capacity that fits what is used, not more than the current one
+	size_t getCompactCapacity(size_t used, size_t minimum, size_t current) {
+		return std::min(std::max(minimum, roundUpToPowerOfTwo(used)), current);
+	}
+
+	GLuint createBuffer(size_t bytes) {
+		GLuint buffer = 0;
+		glGenBuffers(1, &buffer);
+		if (buffer == 0) {
+			throw std::runtime_error("create geometry arena buffer failure");
+		}
+
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, bytes, nullptr, GL_STATIC_DRAW);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		return buffer;
+	}
+
+	void copyBuffer(GLuint source, size_t sourceOffset, GLuint target, size_t targetOffset, size_t bytes) {
+		if (bytes == 0) {
+			return;
+		}
+
+		glBindBuffer(GL_COPY_READ_BUFFER, source);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, target);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, sourceOffset, targetOffset, bytes);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+
+	void uploadBuffer(GLuint buffer, size_t offset, size_t bytes, const void* data) {
+		if (bytes == 0) {
+			return;
+		}
+
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, offset, bytes, data);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+}
+
+GeometryLayout GeometryLayout::positions(bool vertexColors) {
+	GeometryLayout layout;
+	layout.positionsOnly = true;
+	layout.vertexColors = vertexColors;
+	return layout;
+}
+
+GeometryLayout GeometryLayout::of(const VertexFormat& format) {
+	GeometryLayout layout;
+	layout.format = format;
+	return layout;
+}
+
+GLsizei GeometryLayout::getStride() const {
+	if (positionsOnly) {
+		return static_cast<GLsizei>(3 * sizeof(float) + (vertexColors ? sizeof(uint32_t) : 0));
+	}
+	return format.getStride();
+}
+
+void GeometryLayout::setAttributes() const {
+	if (positionsOnly) {
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, getStride(), (void*)0);
+		glEnableVertexAttribArray(0);
+		if (vertexColors) {
+			glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, getStride(), (void*)(3 * sizeof(float)));
+			glEnableVertexAttribArray(1);
+		}
+	}
+	else {
+		format.setAttributes();
+	}
+}
+
+bool GeometryLayout::operator==(const GeometryLayout& rhs) const {
+	if (positionsOnly || rhs.positionsOnly) {
+		return positionsOnly == rhs.positionsOnly && vertexColors == rhs.vertexColors;
+	}
+
+	return format.packed == rhs.format.packed &&
+		format.quantizedPositions == rhs.format.quantizedPositions &&
+		format.normalizedTexCoords == rhs.format.normalizedTexCoords;
+}
+
+RangeAllocator::RangeAllocator(size_t capacity) : _capacity(capacity) {
+	if (capacity > 0) {
+		_free[0] = capacity;
+	}
+}
+
+bool RangeAllocator::allocate(size_t size, size_t& offset) {
+	if (size == 0) {
+		offset = 0;
+		return true;
+	}
+
+	auto best = _free.end();
+	for (auto it = _free.begin(); it != _free.end(); ++it) {
+		if (it->second >= size && (best == _free.end() || it->second < best->second)) {
+			best = it;
+			if (best->second == size) {
+				break;
+			}
+		}
+	}
+
+	if (best == _free.end()) {
+		return false;
+	}
+
+	offset = best->first;
+	const size_t remaining = best->second - size;
+	_free.erase(best);
+	if (remaining > 0) {
+		_free[offset + size] = remaining;
+	}
+
+	_used += size;
+	return true;
+}
+
+void RangeAllocator::release(size_t offset, size_t size) {
+	if (size == 0) {
+		return;
+	}
+
+	_used -= size;
+	auto it = _free.emplace(offset, size).first;
+
+	// merge with the following range
+	auto next = std::next(it);
+	if (next != _free.end() && it->first + it->second == next->first) {
+		it->second += next->second;
+		_free.erase(next);
+	}
+
+	// and with the preceding one
+	if (it != _free.begin()) {
+		auto previous = std::prev(it);
+		if (previous->first + previous->second == it->first) {
+			previous->second += it->second;
+			_free.erase(it);
+		}
+	}
+}
+
+void RangeAllocator::grow(size_t capacity) {
+	if (capacity <= _capacity) {
+		return;
+	}
+
+	const size_t added = capacity - _capacity;
+	const size_t offset = _capacity;
+	_capacity = capacity;
+	_used += added;
+	release(offset, added);
+}
+
+size_t RangeAllocator::getCapacity() const {
+	return _capacity;
+}
+
+size_t RangeAllocator::getUsed() const {
+	return _used;
+}
+
+size_t RangeAllocator::getFreeRangeCount() const {
+	return _free.size();
+}
+
+size_t RangeAllocator::getLargestFreeRange() const {
+	size_t largest = 0;
+	for (const auto& range : _free) {
+		largest = std::max(largest, range.second);
+	}
+	return largest;
+}
+
+GeometryAllocation::GeometryAllocation(int pool, int slot) : _pool(pool), _slot(slot) { }
+
+GeometryAllocation::GeometryAllocation(GeometryAllocation&& rhs) noexcept
+	: _pool(rhs._pool), _slot(rhs._slot) {
+	rhs._pool = -1;
+	rhs._slot = -1;
+}
+
+GeometryAllocation& GeometryAllocation::operator=(GeometryAllocation&& rhs) noexcept {
+	if (this != &rhs) {
+		reset();
+		_pool = rhs._pool;
+		_slot = rhs._slot;
+		rhs._pool = -1;
+		rhs._slot = -1;
+	}
+	return *this;
+}
+
+GeometryAllocation::~GeometryAllocation() {
+	reset();
+}
+
+bool GeometryAllocation::isValid() const {
+	return _pool >= 0;
+}
+
+void GeometryAllocation::reset() {
+	if (isValid()) {
+		GeometryArena::getInstance().release(_pool, _slot);
+		_pool = -1;
+		_slot = -1;
+	}
+}
+
+GLuint GeometryAllocation::getVao() const {
+	return isValid() ? GeometryArena::getInstance()._pools[_pool]->vao : 0;
+}
+
+GLuint GeometryAllocation::getVertexBuffer() const {
+	return isValid() ? GeometryArena::getInstance()._pools[_pool]->vbo : 0;
+}
+
+GLuint GeometryAllocation::getIndexBuffer() const {
+	return isValid() ? GeometryArena::getInstance()._pools[_pool]->ebo : 0;
+}
+
+GLint GeometryAllocation::getBaseVertex() const {
+	return isValid() ? static_cast<GLint>(GeometryArena::getInstance().getSlot(_pool, _slot).vertexOffset) : 0;
+}
+
+size_t GeometryAllocation::getIndexOffset() const {
+	return isValid() ? GeometryArena::getInstance().getSlot(_pool, _slot).indexOffset * kIndexUnit : 0;
+}
+
+size_t GeometryAllocation::getVertexCount() const {
+	return isValid() ? GeometryArena::getInstance().getSlot(_pool, _slot).vertexCount : 0;
+}
+
+size_t GeometryAllocation::getIndexCount() const {
+	return isValid() ? GeometryArena::getInstance().getSlot(_pool, _slot).indexCount : 0;
+}
+
+GLenum GeometryAllocation::getIndexType() const {
+	return isValid() ? GeometryArena::getInstance().getSlot(_pool, _slot).indexType : 0;
+}
+
+DrawRange GeometryAllocation::getDrawRange() const {
+	DrawRange range;
+	if (!isValid()) {
+		return range;
+	}
+
+	const GeometryArena& arena = GeometryArena::getInstance();
+	const GeometryArena::Slot& slot = arena.getSlot(_pool, _slot);
+	range.vao = arena._pools[_pool]->vao;
+	if (slot.indexCount > 0) {
+		range.indexType = slot.indexType;
+		range.count = static_cast<GLsizei>(slot.indexCount);
+		range.offset = slot.indexOffset * kIndexUnit;
+		range.baseVertex = static_cast<GLint>(slot.vertexOffset);
+	}
+	else {
+		range.count = static_cast<GLsizei>(slot.vertexCount);
+		range.offset = slot.vertexOffset;
+	}
+	return range;
+}
+
+void GeometryAllocation::download(std::vector<unsigned char>& vertices, std::vector<uint32_t>& indices) const {
+	vertices.clear();
+	indices.clear();
+	if (!isValid()) {
+		return;
+	}
+
+	const GeometryArena& arena = GeometryArena::getInstance();
+	const GeometryArena::Pool& pool = *arena._pools[_pool];
+	const GeometryArena::Slot& slot = arena.getSlot(_pool, _slot);
+	const size_t stride = pool.layout.getStride();
+
+	vertices.resize(slot.vertexCount * stride);
+	indices.resize(slot.indexCount);
+
+	glBindBuffer(GL_COPY_READ_BUFFER, pool.vbo);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, slot.vertexOffset * stride, vertices.size(), vertices.data());
+
+	glBindBuffer(GL_COPY_READ_BUFFER, pool.ebo);
+	if (slot.indexType == GL_UNSIGNED_SHORT) {
+		std::vector<uint16_t> shortIndices(slot.indexCount);
+		glGetBufferSubData(GL_COPY_READ_BUFFER, slot.indexOffset * kIndexUnit,
+			shortIndices.size() * sizeof(uint16_t), shortIndices.data());
+		std::copy(shortIndices.begin(), shortIndices.end(), indices.begin());
+	}
+	else {
+		glGetBufferSubData(GL_COPY_READ_BUFFER, slot.indexOffset * kIndexUnit,
+			indices.size() * sizeof(uint32_t), indices.data());
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+void GeometryAllocation::updateVertices(size_t first, size_t count, const void* vertices) {
+	if (!isValid()) {
+		return;
+	}
+
+	const GeometryArena& arena = GeometryArena::getInstance();
+	const GeometryArena::Pool& pool = *arena._pools[_pool];
+	const GeometryArena::Slot& slot = arena.getSlot(_pool, _slot);
+	const size_t stride = pool.layout.getStride();
+
+	uploadBuffer(pool.vbo, (slot.vertexOffset + first) * stride, count * stride, vertices);
+}
+
+size_t GeometryAllocation::getGpuBytes() const {
+	if (!isValid()) {
+		return 0;
+	}
+
+	const GeometryArena& arena = GeometryArena::getInstance();
+	const GeometryArena::Slot& slot = arena.getSlot(_pool, _slot);
+	return slot.vertexCount * arena._pools[_pool]->layout.getStride() + slot.indexUnits * kIndexUnit;
+}
+
+GeometryArena& GeometryArena::getInstance() {
+	static GeometryArena arena;
+	return arena;
+}
+
+GeometryAllocation GeometryArena::allocate(
+	const GeometryLayout& layout,
+	const void* vertices, size_t vertexCount,
+	const void* indices, size_t indexCount, GLenum indexType) {
+	if (indices == nullptr) {
+		indexCount = 0;
+	}
+
+	const size_t stride = layout.getStride();
+	const size_t indexBytes = indexCount * getIndexSize(indexType);
+	const size_t indexUnits = (indexBytes + kIndexUnit - 1) / kIndexUnit;
+
+	const int poolIndex = findPool(layout);
+	Pool& pool = *_pools[poolIndex];
+
+	size_t vertexOffset = 0;
+	if (!pool.vertices.allocate(vertexCount, vertexOffset)) {
+		const size_t capacity = pool.vertices.getCapacity();
+		reallocate(pool, std::max(capacity * 2, capacity + vertexCount), pool.indices.getCapacity(), false);
+		pool.vertices.allocate(vertexCount, vertexOffset);
+	}
+
+	size_t indexOffset = 0;
+	if (!pool.indices.allocate(indexUnits, indexOffset)) {
+		const size_t capacity = pool.indices.getCapacity();
+		reallocate(pool, pool.vertices.getCapacity(), std::max(capacity * 2, capacity + indexUnits), false);
+		pool.indices.allocate(indexUnits, indexOffset);
+	}
+
+	uploadBuffer(pool.vbo, vertexOffset * stride, vertexCount * stride, vertices);
+	uploadBuffer(pool.ebo, indexOffset * kIndexUnit, indexBytes, indices);
+
+	Slot slot;
+	slot.live = true;
+	slot.vertexOffset = vertexOffset;
+	slot.vertexCount = vertexCount;
+	slot.indexOffset = indexOffset;
+	slot.indexUnits = indexUnits;
+	slot.indexCount = indexCount;
+	slot.indexType = indexCount > 0 ? indexType : 0;
+
+	int slotIndex;
+	if (!pool.freeSlots.empty()) {
+		slotIndex = pool.freeSlots.back();
+		pool.freeSlots.pop_back();
+		pool.slots[slotIndex] = slot;
+	}
+	else {
+		slotIndex = static_cast<int>(pool.slots.size());
+		pool.slots.push_back(slot);
+	}
+	++pool.liveCount;
+
+	return GeometryAllocation(poolIndex, slotIndex);
+}
+
+int GeometryArena::defragment() {
+	int moved = 0;
+	for (auto& pool : _pools) {
+		if (pool == nullptr) {
+			continue;
+		}
+
+		const RangeAllocator& vertices = pool->vertices;
+		const RangeAllocator& indices = pool->indices;
+
+		// the free space is not one range
+		const bool fragmented =
+			vertices.getLargestFreeRange() < vertices.getCapacity() - vertices.getUsed() ||
+			indices.getLargestFreeRange() < indices.getCapacity() - indices.getUsed();
+
+		const size_t vertexCapacity = getCompactCapacity(vertices.getUsed(), kInitialVertices, vertices.getCapacity());
+		const size_t indexCapacity = getCompactCapacity(indices.getUsed(), kInitialIndexUnits, indices.getCapacity());
+		const bool oversized = vertexCapacity * 2 <= vertices.getCapacity() || indexCapacity * 2 <= indices.getCapacity();
+
+		if (fragmented || oversized) {
+			moved += reallocate(*pool, vertexCapacity, indexCapacity, true);
+		}
+	}
+
+	return moved;
+}
+
+std::vector<GeometryPoolReport> GeometryArena::getReport() const {
+	std::vector<GeometryPoolReport> report;
+	for (const auto& pool : _pools) {
+		if (pool == nullptr) {
+			continue;
+		}
+
+		GeometryPoolReport entry;
+		entry.positionsOnly = pool->layout.positionsOnly;
+		entry.stride = pool->layout.getStride();
+		entry.vertexCapacity = pool->vertices.getCapacity();
+		entry.vertexUsed = pool->vertices.getUsed();
+		entry.indexCapacityBytes = pool->indices.getCapacity() * kIndexUnit;
+		entry.indexUsedBytes = pool->indices.getUsed() * kIndexUnit;
+		entry.allocations = pool->liveCount;
+		entry.freeRanges = static_cast<int>(
+			pool->vertices.getFreeRangeCount() + pool->indices.getFreeRangeCount());
+		report.push_back(entry);
+	}
+	return report;
+}
+
+uint32_t GeometryArena::getGeneration() const {
+	return _generation;
+}
+
+bool GeometryArena::setPoolAttributes(GLuint poolVao) const {
+	for (const auto& pool : _pools) {
+		if (pool != nullptr && pool->vao == poolVao) {
+			glBindBuffer(GL_ARRAY_BUFFER, pool->vbo);
+			pool->layout.setAttributes();
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool->ebo);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			return true;
+		}
+	}
+	return false;
+}
+
+const GeometryArena::Slot& GeometryArena::getSlot(int pool, int slot) const {
+	return _pools[pool]->slots[slot];
+}
+
+void GeometryArena::release(int poolIndex, int slotIndex) {
+	Pool& pool = *_pools[poolIndex];
+	Slot& slot = pool.slots[slotIndex];
+
+	pool.vertices.release(slot.vertexOffset, slot.vertexCount);
+	pool.indices.release(slot.indexOffset, slot.indexUnits);
+	slot.live = false;
+	pool.freeSlots.push_back(slotIndex);
+
+	if (--pool.liveCount == 0) {
+		destroyPool(poolIndex);
+	}
+}
+
+int GeometryArena::findPool(const GeometryLayout& layout) {
+	int empty = -1;
+	for (int i = 0; i < static_cast<int>(_pools.size()); ++i) {
+		if (_pools[i] == nullptr) {
+			empty = empty < 0 ? i : empty;
+		}
+		else if (_pools[i]->layout == layout) {
+			return i;
+		}
+	}
+
+	std::unique_ptr<Pool> pool(new Pool);
+	pool->layout = layout;
+	glGenVertexArrays(1, &pool->vao);
+	if (pool->vao == 0) {
+		throw std::runtime_error("create geometry arena vertex array failure");
+	}
+	reallocate(*pool, kInitialVertices, kInitialIndexUnits, false);
+
+	if (empty < 0) {
+		empty = static_cast<int>(_pools.size());
+		_pools.emplace_back();
+	}
+	_pools[empty] = std::move(pool);
+	return empty;
+}
+
+int GeometryArena::reallocate(Pool& pool, size_t vertexCapacity, size_t indexUnits, bool compact) {
+	const size_t stride = pool.layout.getStride();
+	const GLuint vbo = createBuffer(vertexCapacity * stride);
+	const GLuint ebo = createBuffer(indexUnits * kIndexUnit);
+
+	int moved = 0;
+	if (!compact) {
+		// the ranges keep their offsets
+		copyBuffer(pool.vbo, 0, vbo, 0, pool.vertices.getCapacity() * stride);
+		copyBuffer(pool.ebo, 0, ebo, 0, pool.indices.getCapacity() * kIndexUnit);
+		pool.vertices.grow(vertexCapacity);
+		pool.indices.grow(indexUnits);
+	}
+	else {
+		// pack the live ranges from the start in their current order
+		std::vector<int> order;
+		for (int i = 0; i < static_cast<int>(pool.slots.size()); ++i) {
+			if (pool.slots[i].live) {
+				order.push_back(i);
+			}
+		}
+		std::sort(order.begin(), order.end(), [&pool](int lhs, int rhs) {
+			return pool.slots[lhs].vertexOffset < pool.slots[rhs].vertexOffset;
+		});
+
+		RangeAllocator vertices(vertexCapacity);
+		RangeAllocator indices(indexUnits);
+		for (int index : order) {
+			Slot& slot = pool.slots[index];
+			size_t vertexOffset = 0;
+			size_t indexOffset = 0;
+			vertices.allocate(slot.vertexCount, vertexOffset);
+			indices.allocate(slot.indexUnits, indexOffset);
+
+			copyBuffer(pool.vbo, slot.vertexOffset * stride, vbo, vertexOffset * stride, slot.vertexCount * stride);
+			copyBuffer(pool.ebo, slot.indexOffset * kIndexUnit, ebo, indexOffset * kIndexUnit, slot.indexUnits * kIndexUnit);
+
+			if (vertexOffset != slot.vertexOffset || indexOffset != slot.indexOffset) {
+				++moved;
+			}
+			slot.vertexOffset = vertexOffset;
+			slot.indexOffset = indexOffset;
+		}
+
+		pool.vertices = vertices;
+		pool.indices = indices;
+	}
+
+	if (pool.vbo != 0) {
+		glDeleteBuffers(1, &pool.vbo);
+	}
+	if (pool.ebo != 0) {
+		glDeleteBuffers(1, &pool.ebo);
+	}
+	pool.vbo = vbo;
+	pool.ebo = ebo;
+
+	setupVertexArray(pool);
+	++_generation;
+	return moved;
+}
+
+void GeometryArena::setupVertexArray(Pool& pool) {
+	GLState& glState = GLState::getInstance();
+	glState.bindVertexArray(pool.vao);
+	glBindBuffer(GL_ARRAY_BUFFER, pool.vbo);
+	pool.layout.setAttributes();
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.ebo);
+	glState.bindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void GeometryArena::destroyPool(int index) {
+	Pool& pool = *_pools[index];
+	glDeleteVertexArrays(1, &pool.vao);
+	glDeleteBuffers(1, &pool.vbo);
+	glDeleteBuffers(1, &pool.ebo);
+	_pools[index].reset();
+
+	// the vertex array's name may be handed out again
+	++_generation;
+}
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "./base/draw_range.h"
+#include "vertex_format.h"
+
+// Vertex layout of a pool: one of the mesh formats, or three floats of
+// position for the primitives and bounding boxes, optionally followed by an
+// rgba8 color at attribute 1. The position offset and scale of a mesh
+// format are uniforms, they do not split pools.
+struct GeometryLayout {
+	bool positionsOnly = false;
+	bool vertexColors = false;
+	VertexFormat format;
+
+	static GeometryLayout positions(bool vertexColors = false);
+
+	static GeometryLayout of(const VertexFormat& format);
+
+	GLsizei getStride() const;
+
+	// attributes of the bound vertex array for the bound vertex buffer
+	void setAttributes() const;
+
+	bool operator==(const GeometryLayout& rhs) const;
+};
+
+// Best fit allocation of ranges of some unit within a capacity, the free
+// ranges are kept sorted by offset and merged with their neighbours.
+class RangeAllocator {
+public:
+	RangeAllocator(size_t capacity = 0);
+
+	// false if no free range is large enough, an empty range always fits at 0
+	bool allocate(size_t size, size_t& offset);
+
+	void release(size_t offset, size_t size);
+
+	// the added space joins the free range at the end
+	void grow(size_t capacity);
+
+	size_t getCapacity() const;
+
+	size_t getUsed() const;
+
+	size_t getFreeRangeCount() const;
+
+	size_t getLargestFreeRange() const;
+
+private:
+	size_t _capacity = 0;
+	size_t _used = 0;
+
+	// offset to size
+	std::map<size_t, size_t> _free;
+};
+
+// fill of one pool, see GeometryArena::getReport
+struct GeometryPoolReport {
+	bool positionsOnly = false;
+	GLsizei stride = 0;
+
+	size_t vertexCapacity = 0;
+	size_t vertexUsed = 0;
+
+	size_t indexCapacityBytes = 0;
+	size_t indexUsedBytes = 0;
+
+	int allocations = 0;
+
+	// more than one free range in either buffer is fragmentation
+	int freeRanges = 0;
+};
+
+// A range of vertices and indices in one of the arena's pools, released
+// when destroyed. The offsets may change when the arena grows or
+// defragments a pool, they are looked up for every draw range.
+class GeometryAllocation {
+public:
+	GeometryAllocation() = default;
+
+	GeometryAllocation(const GeometryAllocation&) = delete;
+
+	GeometryAllocation(GeometryAllocation&& rhs) noexcept;
+
+	GeometryAllocation& operator=(GeometryAllocation&& rhs) noexcept;
+
+	~GeometryAllocation();
+
+	bool isValid() const;
+
+	void reset();
+
+	// the pool's vertex array and buffers, shared with every allocation of the layout
+	GLuint getVao() const;
+
+	GLuint getVertexBuffer() const;
+
+	GLuint getIndexBuffer() const;
+
+	// the first vertex, added to every index of the draw
+	GLint getBaseVertex() const;
+
+	// in bytes into the pool's index buffer
+	size_t getIndexOffset() const;
+
+	size_t getVertexCount() const;
+
+	size_t getIndexCount() const;
+
+	GLenum getIndexType() const;
+
+	// every index, or every vertex without indices
+	DrawRange getDrawRange() const;
+
+	// read the range back, the indices widened to 32 bits and relative to
+	// the first vertex
+	void download(std::vector<unsigned char>& vertices, std::vector<uint32_t>& indices) const;
+
+	// overwrite vertices of the range in place
+	void updateVertices(size_t first, size_t count, const void* vertices);
+
+	size_t getGpuBytes() const;
+
+private:
+	friend class GeometryArena;
+
+	int _pool = -1;
+	int _slot = -1;
+
+	GeometryAllocation(int pool, int slot);
+};
+
+// Suballocates the vertices and indices of every mesh and primitive
+// from a few large buffers, one pool per vertex layout under a single
+// vertex array. Draws select their range with glDrawElementsBaseVertex, so
+// indices stay relative to the first vertex of their allocation and ranges
+// can move. A pool doubles its buffers when full, is compacted by
+// defragment() and is deleted with its last allocation.
+class GeometryArena {
+public:
+	static GeometryArena& getInstance();
+
+	GeometryArena(const GeometryArena&) = delete;
+
+	// indices may be null for array draws, the index type is then ignored
+	GeometryAllocation allocate(
+		const GeometryLayout& layout,
+		const void* vertices, size_t vertexCount,
+		const void* indices, size_t indexCount, GLenum indexType);
+
+	// Move the live ranges of fragmented pools together and shrink their
+	// buffers to what is used, returns the number of ranges moved.
+	int defragment();
+
+	std::vector<GeometryPoolReport> getReport() const;
+
+	// changes whenever a pool's buffers are replaced, vertex arrays that
+	// reference them from outside the arena must then be set up again
+	uint32_t getGeneration() const;
+
+	// point the bound vertex array at the buffers of the pool whose vertex
+	// array is given, with the pool's attributes; false if no pool has it
+	bool setPoolAttributes(GLuint poolVao) const;
+
+private:
+	friend class GeometryAllocation;
+
+	struct Slot {
+		bool live = false;
+		size_t vertexOffset = 0;
+		size_t vertexCount = 0;
+
+		// in units of 4 bytes, so 32 bit indices stay aligned
+		size_t indexOffset = 0;
+		size_t indexUnits = 0;
+		size_t indexCount = 0;
+		GLenum indexType = 0;
+	};
+
+	struct Pool {
+		GeometryLayout layout;
+		GLuint vao = 0;
+		GLuint vbo = 0;
+		GLuint ebo = 0;
+
+		RangeAllocator vertices;
+		RangeAllocator indices;
+
+		std::vector<Slot> slots;
+		std::vector<int> freeSlots;
+		int liveCount = 0;
+	};
+
+	std::vector<std::unique_ptr<Pool>> _pools;
+	uint32_t _generation = 0;
+
+	GeometryArena() = default;
+
+	const Slot& getSlot(int pool, int slot) const;
+
+	void release(int pool, int slot);
+
+	int findPool(const GeometryLayout& layout);
+
+	// Replace the pool's buffers by ones of the given capacities, the live
+	// ranges either keep their offsets or are packed from the start. Returns
+	// the number of ranges that moved.
+	int reallocate(Pool& pool, size_t vertexCapacity, size_t indexUnits, bool compact);
+
+	void setupVertexArray(Pool& pool);
+
+	void destroyPool(int index);
+};
@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <unordered_map>
+
+#include "obj_loader.h"
+#include "vertex_indexer.h"
+#include "indexer_benchmark.h"
+
+namespace {
+	constexpr int kRuns = 5;
+	constexpr int kRepeats = 20;
+
+	struct ObjMesh {
+		std::string name;
+		attrib_t attrib;
+		index_t index;
+
+		size_t getCornerCount() const {
+			return index.positionIndex.size() * 3;
+		}
+	};
+
+	// the deduplication IndexObjVertices replaced, two lookups per corner
+	void indexReference(const attrib_t& attrib, const index_t& index,
+		std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+		std::unordered_map<Vertex, uint32_t> uniqueVertices;
+		vertices.clear();
+		indices.clear();
+		for (size_t i = 0; i < index.positionIndex.size(); ++i) {
+			for (int k = 0; k < 3; ++k) {
+				Vertex vertex{};
+				vertex.position = attrib.vertexPosition[index.positionIndex[i][k]];
+				vertex.normal = attrib.vertexNormal[index.normalIndex[i][k]];
+				vertex.texCoord = attrib.vertexTexcoord[index.texcoordIndex[i][k]];
+
+				if (uniqueVertices.count(vertex) == 0) {
+					uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
+					vertices.push_back(vertex);
+				}
+				indices.push_back(uniqueVertices[vertex]);
+			}
+		}
+	}
+
+	// the best of a few runs in milliseconds
+	template <typename Job>
+	double measure(Job job) {
+		double best = 0.0;
+		for (int run = 0; run < kRuns; ++run) {
+			auto start = std::chrono::high_resolution_clock::now();
+			job();
+			auto now = std::chrono::high_resolution_clock::now();
+			const double ms = std::chrono::duration<double, std::milli>(now - start).count();
+			best = run == 0 ? ms : std::min(best, ms);
+		}
+		return best;
+	}
+
+	ObjMesh repeat(const ObjMesh& mesh, int count) {
+		ObjMesh result;
+		result.name = mesh.name + " x" + std::to_string(count);
+		for (int r = 0; r < count; ++r) {
+			const glm::ivec3 positionBase(static_cast<int>(result.attrib.vertexPosition.size()));
+			const glm::ivec3 texCoordBase(static_cast<int>(result.attrib.vertexTexcoord.size()));
+			const glm::ivec3 normalBase(static_cast<int>(result.attrib.vertexNormal.size()));
+
+			result.attrib.vertexPosition.insert(result.attrib.vertexPosition.end(),
+				mesh.attrib.vertexPosition.begin(), mesh.attrib.vertexPosition.end());
+			result.attrib.vertexTexcoord.insert(result.attrib.vertexTexcoord.end(),
+				mesh.attrib.vertexTexcoord.begin(), mesh.attrib.vertexTexcoord.end());
+			result.attrib.vertexNormal.insert(result.attrib.vertexNormal.end(),
+				mesh.attrib.vertexNormal.begin(), mesh.attrib.vertexNormal.end());
+
+			for (size_t i = 0; i < mesh.index.positionIndex.size(); ++i) {
+				result.index.positionIndex.push_back(mesh.index.positionIndex[i] + positionBase);
+				result.index.texcoordIndex.push_back(mesh.index.texcoordIndex[i] + texCoordBase);
+				result.index.normalIndex.push_back(mesh.index.normalIndex[i] + normalBase);
+			}
+		}
+		return result;
+	}
+
+	bool benchmark(const ObjMesh& mesh, int numThreads) {
+		std::vector<Vertex> referenceVertices, vertices;
+		std::vector<uint32_t> referenceIndices, indices;
+
+		const double referenceMs = measure([&]() {
+			indexReference(mesh.attrib, mesh.index, referenceVertices, referenceIndices);
+		});
+
+		const double hashMs = measure([&]() {
+			IndexObjVertices(mesh.attrib, mesh.index, vertices, indices, 1);
+		});
+		bool same = vertices == referenceVertices && indices == referenceIndices;
+
+		bool sorted = false;
+		const double threadedMs = measure([&]() {
+			sorted = IndexObjVertices(mesh.attrib, mesh.index, vertices, indices, numThreads);
+		});
+		same = same && vertices == referenceVertices && indices == referenceIndices;
+
+		std::cout << std::left << std::setw(16) << mesh.name << std::right
+			<< std::setw(9) << mesh.getCornerCount() << " corners "
+			<< std::setw(9) << referenceVertices.size() << " vertices  "
+			<< std::fixed << std::setprecision(1)
+			<< "unordered_map " << std::setw(7) << referenceMs << " ms  "
+			<< "hash " << std::setw(7) << hashMs << " ms  "
+			<< (sorted ? "sort " : "hash ") << std::setw(7) << threadedMs << " ms"
+			<< (same ? "" : "  output differs") << std::endl;
+		return same;
+	}
+}
+
+bool RunIndexerBenchmark(const std::string& directory, int numThreads) {
+	std::vector<std::string> paths;
+	for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+		if (entry.is_regular_file() && entry.path().extension() == ".obj") {
+			paths.push_back(entry.path().string());
+		}
+	}
+	std::sort(paths.begin(), paths.end());
+
+	std::vector<ObjMesh> meshes;
+	for (const auto& path : paths) {
+		ObjMesh mesh;
+		mesh.name = std::filesystem::path(path).filename().string();
+		if (!LoadObj(path, mesh.attrib, mesh.index)) {
+			continue;
+		}
+		meshes.push_back(std::move(mesh));
+	}
+
+	if (meshes.empty()) {
+		std::cout << "no obj files in " << directory << std::endl;
+		return false;
+	}
+
+	std::cout << "best of " << kRuns << " runs, threaded column with "
+		<< (numThreads > 0 ? std::to_string(numThreads) : "one per core") << " threads" << std::endl;
+
+	bool same = true;
+	for (const ObjMesh& mesh : meshes) {
+		same = benchmark(mesh, numThreads) && same;
+	}
+
+	const ObjMesh& largest = *std::max_element(meshes.begin(), meshes.end(),
+		[](const ObjMesh& a, const ObjMesh& b) { return a.getCornerCount() < b.getCornerCount(); });
+	same = benchmark(repeat(largest, kRepeats), numThreads) && same;
+
+	return same;
+}
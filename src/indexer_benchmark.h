@@ -0,0 +1,10 @@
+#pragma once
+
+#include <string>
+
+// Time the vertex deduplication of every obj file in a directory against the
+// unordered_map over whole Vertex structs it replaced, on one thread and on
+// numThreads (0 for one per core), and check that all of them give the same
+// arrays. The largest mesh repeated 20 times stands in for one large enough
+// for the sort path. Returns false if any output differed.
+bool RunIndexerBenchmark(const std::string& directory, int numThreads);
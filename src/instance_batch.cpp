@@ -0,0 +1,148 @@
+#include <cstddef>
+#include <sstream>
+#include <stdexcept>
+
+#include "./base/gl_state.h"
+#include "instance_batch.h"
+
+namespace {
+	InstancingOptions defaultInstancingOptions;
+}
+
+void SetDefaultInstancingOptions(const InstancingOptions& options) {
+	defaultInstancingOptions = options;
+}
+
+const InstancingOptions& GetDefaultInstancingOptions() {
+	return defaultInstancingOptions;
+}
+
+void SetInstanceAttributes() {
+	// a mat4 takes four vec4 locations
+	for (GLuint i = 0; i < 4; ++i) {
+		glEnableVertexAttribArray(kInstanceModelLocation + i);
+		glVertexAttribPointer(kInstanceModelLocation + i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+			(void*)(offsetof(InstanceData, model) + i * sizeof(glm::vec4)));
+		glVertexAttribDivisor(kInstanceModelLocation + i, 1);
+	}
+
+	glEnableVertexAttribArray(kInstanceTintLocation);
+	glVertexAttribPointer(kInstanceTintLocation, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+		(void*)offsetof(InstanceData, tint));
+	glVertexAttribDivisor(kInstanceTintLocation, 1);
+}
+
+InstanceBatch::InstanceBatch(std::shared_ptr<const Mesh> mesh)
+	: _mesh(std::move(mesh)) {
+	glGenVertexArrays(1, &_vao);
+	glGenBuffers(1, &_instanceBuffer);
+
+	setupVertexArray();
+
+	GLenum error = glGetError();
+	if (error != GL_NO_ERROR) {
+		std::stringstream ss;
+		ss << "instance batch creation failure, (code " << error << ")";
+		cleanup();
+		throw std::runtime_error(ss.str());
+	}
+}
+
+void InstanceBatch::setupVertexArray() {
+	GLState& glState = GLState::getInstance();
+	_generation = GeometryArena::getInstance().getGeneration();
+
+	glState.bindVertexArray(_vao);
+
+	// the mesh's buffers as they are
+	glBindBuffer(GL_ARRAY_BUFFER, _mesh->getVertexBuffer());
+	_mesh->getVertexFormat().setAttributes();
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _mesh->getIndexBuffer());
+
+	glBindBuffer(GL_ARRAY_BUFFER, _instanceBuffer);
+	SetInstanceAttributes();
+
+	glState.bindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+InstanceBatch::InstanceBatch(InstanceBatch&& rhs) noexcept
+	: _mesh(std::move(rhs._mesh)),
+	  _vao(rhs._vao),
+	  _instanceBuffer(rhs._instanceBuffer),
+	  _capacity(rhs._capacity),
+	  _instances(std::move(rhs._instances)),
+	  _uploadedCount(rhs._uploadedCount),
+	  _generation(rhs._generation) {
+	rhs._vao = 0;
+	rhs._instanceBuffer = 0;
+	rhs._capacity = 0;
+	rhs._uploadedCount = 0;
+}
+
+InstanceBatch::~InstanceBatch() {
+	cleanup();
+}
+
+const std::shared_ptr<const Mesh>& InstanceBatch::getMesh() const {
+	return _mesh;
+}
+
+void InstanceBatch::clear() {
+	_instances.clear();
+}
+
+void InstanceBatch::add(const glm::mat4& model, const glm::vec4& tint) {
+	_instances.push_back({ model, tint });
+}
+
+size_t InstanceBatch::getInstanceCount() const {
+	return _instances.size();
+}
+
+void InstanceBatch::upload() {
+	if (_generation != GeometryArena::getInstance().getGeneration()) {
+		setupVertexArray();
+	}
+
+	_uploadedCount = _instances.size();
+	if (_instances.empty()) {
+		return;
+	}
+
+	if (_capacity < _instances.size()) {
+		_capacity = 1;
+		while (_capacity < _instances.size()) {
+			_capacity *= 2;
+		}
+	}
+
+	const size_t bytes = _instances.size() * sizeof(InstanceData);
+	glBindBuffer(GL_ARRAY_BUFFER, _instanceBuffer);
+	glBufferData(GL_ARRAY_BUFFER, _capacity * sizeof(InstanceData), nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, _instances.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+DrawRange InstanceBatch::getDrawRange(int lod) const {
+	DrawRange range = _mesh->getDrawRange(lod);
+	range.vao = _vao;
+	range.instanceCount = static_cast<GLsizei>(_uploadedCount);
+	return range;
+}
+
+size_t InstanceBatch::getGpuBytes() const {
+	return _capacity * sizeof(InstanceData);
+}
+
+void InstanceBatch::cleanup() {
+	if (_instanceBuffer != 0) {
+		glDeleteBuffers(1, &_instanceBuffer);
+		_instanceBuffer = 0;
+	}
+
+	if (_vao != 0) {
+		glDeleteVertexArrays(1, &_vao);
+		_vao = 0;
+	}
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "./base/draw_range.h"
+#include "mesh.h"
+
+struct InstancingOptions {
+	// one instanced draw per batch, otherwise a draw per instance for comparison
+	bool enabled = true;
+
+	// extra instances of the stress test, 0 to turn it off
+	int stressInstances = 0;
+};
+
+void SetDefaultInstancingOptions(const InstancingOptions& options);
+const InstancingOptions& GetDefaultInstancingOptions();
+
+// attribute locations of the per instance data, after the mesh's 0 - 2
+constexpr GLuint kInstanceModelLocation = 3;
+constexpr GLuint kInstanceTintLocation = 7;
+
+// GLSL inputs of the per instance data, for programs acquired with the INSTANCED define
+#define INSTANCE_DATA_GLSL \
+	"layout(location = 3) in mat4 aInstanceModel;\n" \
+	"layout(location = 7) in vec4 aInstanceTint;\n"
+
+struct InstanceData {
+	glm::mat4 model;
+	glm::vec4 tint;
+};
+
+// point the per instance attributes of the bound vertex array at the bound
+// array buffer of InstanceData, advancing once per instance
+void SetInstanceAttributes();
+
+// Copies of one mesh drawn with a single glDrawElementsInstanced. The batch
+// has a vertex array of its own that reads the mesh's vertex and index
+// buffers plus an instance buffer with attribute divisors of 1. The
+// instances are collected on the cpu every frame and uploaded at once.
+// The mesh's buffers belong to the geometry arena, the vertex array is set
+// up again when the arena replaces them.
+class InstanceBatch {
+public:
+	InstanceBatch(std::shared_ptr<const Mesh> mesh);
+
+	InstanceBatch(const InstanceBatch&) = delete;
+
+	InstanceBatch(InstanceBatch&& rhs) noexcept;
+
+	~InstanceBatch();
+
+	const std::shared_ptr<const Mesh>& getMesh() const;
+
+	void clear();
+
+	void add(const glm::mat4& model, const glm::vec4& tint = glm::vec4(1.0f));
+
+	size_t getInstanceCount() const;
+
+	// the instance buffer grows to the next power of two and is orphaned
+	// before every upload, so a frame never waits for the previous draw
+	void upload();
+
+	// all uploaded instances at a level of detail of the mesh
+	DrawRange getDrawRange(int lod = 0) const;
+
+	size_t getGpuBytes() const;
+
+private:
+	std::shared_ptr<const Mesh> _mesh;
+
+	GLuint _vao = 0;
+	GLuint _instanceBuffer = 0;
+	size_t _capacity = 0;
+
+	std::vector<InstanceData> _instances;
+	size_t _uploadedCount = 0;
+
+	// arena generation the vertex array was set up for
+	uint32_t _generation = 0;
+
+	void setupVertexArray();
+
+	void cleanup();
+};
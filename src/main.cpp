@@ -1,7 +1,9 @@
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
 
 #include "application.h"
+#include "indexer_benchmark.h"
 
 Options getOptions(int argc, char* argv[]) {
 	Options options;
@@ -13,6 +15,99 @@ Options getOptions(int argc, char* argv[]) {
 	options.msaa = true;
 	options.glVersion = { 3, 3 };
 	options.backgroundColor = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	options.objLoaderThreads = 0;
+	options.meshOptimize = true;
+	options.overdrawOrder = false;
+	options.lodLevels = 5;
+	options.vertexPacking = true;
+	options.quantizePositions = false;
+	options.assetLoaderThreads = 0;
+	options.uploadBudgetMs = 2.0;
+	options.textureAnisotropy = 8.0f;
+	options.gpuMipmaps = false;
+	options.textureCompression = true;
+	options.shaderCache = true;
+	options.instancing = true;
+	options.stressInstances = 0;
+	options.multiDraw = true;
+	options.indirectDraw = true;
+	options.staticBatching = true;
+	options.stageMemoryBudget = 512 * 1024 * 1024;
+
+	for (int i = 1; i < argc; ++i) {
+		// "--obj-threads N" - threads used to parse obj files, 0 for one per core
+		if (std::strcmp(argv[i], "--obj-threads") == 0 && i + 1 < argc) {
+			options.objLoaderThreads = std::atoi(argv[++i]);
+		}
+		// "--no-mesh-optimize" - keep obj meshes in file order
+		else if (std::strcmp(argv[i], "--no-mesh-optimize") == 0) {
+			options.meshOptimize = false;
+		}
+		// "--overdraw-order" - also sort triangle clusters to reduce overdraw
+		else if (std::strcmp(argv[i], "--overdraw-order") == 0) {
+			options.overdrawOrder = true;
+		}
+		// "--lod-levels N" - levels of detail per obj mesh, the full mesh included, 1 to turn them off
+		else if (std::strcmp(argv[i], "--lod-levels") == 0 && i + 1 < argc) {
+			options.lodLevels = std::atoi(argv[++i]);
+		}
+		// "--no-vertex-packing" - upload 32 byte float vertices and 32 bit indices
+		else if (std::strcmp(argv[i], "--no-vertex-packing") == 0) {
+			options.vertexPacking = false;
+		}
+		// "--quantize-positions" - also store positions as unorm16 within the bounding box
+		else if (std::strcmp(argv[i], "--quantize-positions") == 0) {
+			options.quantizePositions = true;
+		}
+		// "--loader-threads N" - threads decoding assets, 0 for one per core
+		else if (std::strcmp(argv[i], "--loader-threads") == 0 && i + 1 < argc) {
+			options.assetLoaderThreads = std::atoi(argv[++i]);
+		}
+		// "--upload-budget MS" - time per frame spent uploading streamed assets
+		else if (std::strcmp(argv[i], "--upload-budget") == 0 && i + 1 < argc) {
+			options.uploadBudgetMs = std::atof(argv[++i]);
+		}
+		// "--anisotropy N" - maximum anisotropic filtering, 1 to turn it off
+		else if (std::strcmp(argv[i], "--anisotropy") == 0 && i + 1 < argc) {
+			options.textureAnisotropy = static_cast<float>(std::atof(argv[++i]));
+		}
+		// "--gpu-mipmaps" - let the driver build mip chains instead of the loader threads
+		else if (std::strcmp(argv[i], "--gpu-mipmaps") == 0) {
+			options.gpuMipmaps = true;
+		}
+		// "--no-texture-compression" - keep textures uncompressed on the gpu
+		else if (std::strcmp(argv[i], "--no-texture-compression") == 0) {
+			options.textureCompression = false;
+		}
+		// "--no-shader-cache" - compile shaders from source on every launch
+		else if (std::strcmp(argv[i], "--no-shader-cache") == 0) {
+			options.shaderCache = false;
+		}
+		// "--no-instancing" - draw repeated meshes one by one instead of in one instanced draw
+		else if (std::strcmp(argv[i], "--no-instancing") == 0) {
+			options.instancing = false;
+		}
+		// "--stress-instances N" - extra gophers drawn in the whack moles stage
+		else if (std::strcmp(argv[i], "--stress-instances") == 0 && i + 1 < argc) {
+			options.stressInstances = std::atoi(argv[++i]);
+		}
+		// "--no-multi-draw" - a draw call per packet instead of one per run of packets with the same state
+		else if (std::strcmp(argv[i], "--no-multi-draw") == 0) {
+			options.multiDraw = false;
+		}
+		// "--no-indirect-draw" - use glMultiDrawElementsBaseVertex even where opengl 4.3 is available
+		else if (std::strcmp(argv[i], "--no-indirect-draw") == 0) {
+			options.indirectDraw = false;
+		}
+		// "--no-static-batching" - draw the objects that never move one by one
+		else if (std::strcmp(argv[i], "--no-static-batching") == 0) {
+			options.staticBatching = false;
+		}
+		// "--stage-budget MB" - gpu memory the loaded stages may keep resident
+		else if (std::strcmp(argv[i], "--stage-budget") == 0 && i + 1 < argc) {
+			options.stageMemoryBudget = static_cast<size_t>(std::atoi(argv[++i])) * 1024 * 1024;
+		}
+	}
 
 	return options;
 }
@@ -20,6 +115,13 @@ Options getOptions(int argc, char* argv[]) {
 int main(int argc, char* argv[]) {
 	Options options = getOptions(argc, argv);
 
+	// "--bench-indexer" - time the vertex deduplication of media/*.obj and exit
+	for (int i = 1; i < argc; ++i) {
+		if (std::strcmp(argv[i], "--bench-indexer") == 0) {
+			return RunIndexerBenchmark("./media/", options.objLoaderThreads) ? 0 : EXIT_FAILURE;
+		}
+	}
+
 	try {
 		Application app(options);
 		app.run();
@@ -0,0 +1,373 @@
+#include <iostream>
+#include <limits>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+#include "obj_loader.h"
+#include "vertex_indexer.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "mesh_cache.h"
+#include "mesh_exporter.h"
+#include "./base/gl_state.h"
+#include "mesh.h"
+
+
+namespace {
+    BoundingBox computeBoundingBox(const std::vector<Vertex>& vertices) {
+        float minX = std::numeric_limits<float>::max();
+        float minY = std::numeric_limits<float>::max();
+        float minZ = std::numeric_limits<float>::max();
+        float maxX = -std::numeric_limits<float>::max();
+        float maxY = -std::numeric_limits<float>::max();
+        float maxZ = -std::numeric_limits<float>::max();
+
+        for (const auto& v : vertices) {
+            minX = std::min(v.position.x, minX);
+            minY = std::min(v.position.y, minY);
+            minZ = std::min(v.position.z, minZ);
+            maxX = std::max(v.position.x, maxX);
+            maxY = std::max(v.position.y, maxY);
+            maxZ = std::max(v.position.z, maxZ);
+        }
+
+        BoundingBox box;
+        box.min = glm::vec3(minX, minY, minZ);
+        box.max = glm::vec3(maxX, maxY, maxZ);
+        return box;
+    }
+}
+
+MeshData::MeshData(const std::string& filepath) : _path(filepath) {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// a valid cache entry skips obj parsing and vertex deduplication,
+	// its mapped arrays are uploaded without an intermediate copy
+	try {
+		_cache.reset(new MeshCache(filepath, GetDefaultMeshOptimizeOptions(), GetDefaultVertexFormatOptions()));
+	}
+	catch (const std::exception& e) {
+		std::cout << e.what() << ", load from obj" << std::endl;
+	}
+
+	if (_cache != nullptr) {
+		_boundingBox = _cache->getBoundingBox();
+		_lods = _cache->getLods();
+		_packedGeometry.format = _cache->getVertexFormat();
+		_packedGeometry.indexType = _cache->getIndexType();
+
+		auto now = std::chrono::high_resolution_clock::now();
+		std::cout << "load " << filepath << " from mesh cache in "
+			<< std::chrono::duration<double, std::milli>(now - start).count() << " ms" << std::endl;
+	}
+	else {
+		loadObj();
+	}
+}
+
+void MeshData::loadObj() {
+	attrib_t attrib;
+	index_t index;
+	std::string err;
+
+	//	std::string::size_type index = filepath.find_last_of("/");
+
+	ObjLoadStats stats;
+	if (!LoadObj(_path, attrib, index, GetDefaultObjLoadOptions(), &stats)) {
+		throw std::runtime_error("load " + _path + " failure: " + err);
+	}
+	std::cout << "load " << _path << ": " << stats.bytes << " bytes in "
+		<< stats.seconds * 1000.0 << " ms (" << stats.getThroughput() << " MB/s, "
+		<< stats.threads << " threads)" << std::endl;
+	if (!err.empty()) {
+		std::cerr << err << std::endl;
+	}
+
+	auto indexStart = std::chrono::high_resolution_clock::now();
+	IndexObjVertices(attrib, index, _vertices, _indices, GetDefaultObjLoadOptions().numThreads);
+	auto indexEnd = std::chrono::high_resolution_clock::now();
+	std::cout << "index " << _path << ": " << _indices.size() << " corners to " << _vertices.size()
+		<< " vertices in " << std::chrono::duration<double, std::milli>(indexEnd - indexStart).count()
+		<< " ms" << std::endl;
+
+	// reorder for the post-transform cache and vertex fetch, the cache keeps the result
+	const MeshOptimizeOptions& optimizeOptions = GetDefaultMeshOptimizeOptions();
+	auto optimizeStart = std::chrono::high_resolution_clock::now();
+	MeshOptimizeStats optimizeStats;
+	OptimizeMesh(_vertices, _indices, optimizeOptions, &optimizeStats);
+	auto optimizeEnd = std::chrono::high_resolution_clock::now();
+	std::cout << "optimize " << _path << ": acmr " << optimizeStats.acmrBefore << " -> " << optimizeStats.acmrAfter
+		<< " in " << std::chrono::duration<double, std::milli>(optimizeEnd - optimizeStart).count()
+		<< " ms" << std::endl;
+
+	// coarser levels go behind the full mesh in the same index array
+	auto lodStart = std::chrono::high_resolution_clock::now();
+	_lods = GenerateLods(_vertices.data(), _vertices.size(), _indices, optimizeOptions.lodLevels);
+	auto lodEnd = std::chrono::high_resolution_clock::now();
+	std::cout << "simplify " << _path << ": " << _lods.size() << " levels,";
+	for (const MeshLod& lod : _lods) {
+		std::cout << " " << lod.indexCount / 3;
+	}
+	std::cout << " triangles in " << std::chrono::duration<double, std::milli>(lodEnd - lodStart).count()
+		<< " ms" << std::endl;
+
+	_boundingBox = computeBoundingBox(_vertices);
+
+	const VertexFormatOptions& formatOptions = GetDefaultVertexFormatOptions();
+	_packedGeometry = PackGeometry(_vertices.data(), _vertices.size(), _indices.data(), _indices.size(),
+		_boundingBox, formatOptions);
+
+	// the mesh is uploaded from the arrays, the cache writes a copy of the
+	// packed streams in the background
+	const unsigned char* vertexData = static_cast<const unsigned char*>(getVertexData());
+	const unsigned char* indexData = static_cast<const unsigned char*>(getIndexData());
+	const size_t indexSize = getIndexType() == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+	MeshExporter::getInstance().exportCache(_path,
+		std::vector<unsigned char>(vertexData, vertexData + getVertexCount() * getVertexFormat().getStride()),
+		getVertexFormat(),
+		std::vector<unsigned char>(indexData, indexData + getIndexCount() * indexSize),
+		getIndexType(), _boundingBox, _lods, optimizeOptions, formatOptions);
+}
+
+const std::string& MeshData::getPath() const {
+    return _path;
+}
+
+const void* MeshData::getVertexData() const {
+    return _cache != nullptr ? _cache->getVertexData() : _packedGeometry.getVertexData(_vertices.data());
+}
+
+size_t MeshData::getVertexCount() const {
+    return _cache != nullptr ? _cache->getVertexCount() : _vertices.size();
+}
+
+const void* MeshData::getIndexData() const {
+    return _cache != nullptr ? _cache->getIndexData() : _packedGeometry.getIndexData(_indices.data());
+}
+
+size_t MeshData::getIndexCount() const {
+    return _cache != nullptr ? _cache->getIndexCount() : _indices.size();
+}
+
+BoundingBox MeshData::getBoundingBox() const {
+    return _boundingBox;
+}
+
+const std::vector<MeshLod>& MeshData::getLods() const {
+    return _lods;
+}
+
+const VertexFormat& MeshData::getVertexFormat() const {
+    return _packedGeometry.format;
+}
+
+GLenum MeshData::getIndexType() const {
+    return _packedGeometry.indexType;
+}
+
+
+Mesh::Mesh(const std::string& filepath)
+    : Mesh(MeshData(filepath)) { }
+
+Mesh::Mesh(const MeshData& data) {
+    _boundingBox = data.getBoundingBox();
+    _lods = data.getLods();
+
+    // straight from the mapped cache entry on a warm start
+    initGLResources(data.getVertexData(), data.getVertexCount(), data.getVertexFormat(),
+        data.getIndexData(), data.getIndexCount(), data.getIndexType());
+
+    initBoxGLResources();
+
+    GLenum error = glGetError();
+    if (error != GL_NO_ERROR) {
+        cleanup();
+        throw std::runtime_error("OpenGL Error: " + std::to_string(error));
+    }
+}
+
+Mesh::Mesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices) {
+    _boundingBox = computeBoundingBox(vertices);
+    _lods = { { 0, static_cast<uint32_t>(indices.size()), 0.0f } };
+
+    const PackedGeometry geometry = PackGeometry(vertices.data(), vertices.size(), indices.data(), indices.size(),
+        _boundingBox, GetDefaultVertexFormatOptions());
+    initGLResources(geometry.getVertexData(vertices.data()), vertices.size(), geometry.format,
+        geometry.getIndexData(indices.data()), indices.size(), geometry.indexType);
+
+    initBoxGLResources();
+
+    GLenum error = glGetError();
+    if (error != GL_NO_ERROR) {
+        cleanup();
+        throw std::runtime_error("OpenGL Error: " + std::to_string(error));
+    }
+}
+
+Mesh::Mesh(Mesh&& rhs) noexcept
+    : _vertexCount(rhs._vertexCount),
+      _indexCount(rhs._indexCount),
+      _vertexFormat(rhs._vertexFormat),
+      _indexType(rhs._indexType),
+      _lods(std::move(rhs._lods)),
+      _boundingBox(std::move(rhs._boundingBox)),
+      _geometry(std::move(rhs._geometry)),
+      _boxGeometry(std::move(rhs._boxGeometry)) { }
+
+Mesh::~Mesh() {
+    cleanup();
+}
+
+BoundingBox Mesh::getBoundingBox() const {
+    return _boundingBox;
+}
+
+DrawRange Mesh::getDrawRange(int lod) const {
+    const MeshLod& level = getLod(lod);
+    const size_t indexSize = _indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+
+    DrawRange range = _geometry.getDrawRange();
+    range.count = static_cast<GLsizei>(level.indexCount);
+    range.offset += level.indexOffset * indexSize;
+    return range;
+}
+
+void Mesh::draw(int lod) const {
+    // the vertex array stays bound, the next draw binds its own
+    const DrawRange range = getDrawRange(lod);
+    GLState::getInstance().bindVertexArray(range.vao);
+    range.draw();
+}
+
+void Mesh::drawBoundingBox() const {
+    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    DrawRange range = _boxGeometry.getDrawRange();
+    range.mode = GL_LINES;
+    GLState::getInstance().bindVertexArray(range.vao);
+    range.draw();
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+}
+
+void Mesh::downloadGeometry(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) const {
+    // the full detail level comes first in the index buffer
+    const size_t indexCount = getLod(0).indexCount;
+    vertices.resize(_vertexCount);
+    indices.resize(indexCount);
+
+    // the buffers hold the packed layout, expand it back to float vertices
+    std::vector<unsigned char> vertexData(_vertexCount * _vertexFormat.getStride());
+    std::vector<uint16_t> shortIndices(_indexType == GL_UNSIGNED_SHORT ? indexCount : 0);
+
+    // the mesh is a range of the arena's shared buffers
+    const size_t vertexOffset = _geometry.getBaseVertex() * _vertexFormat.getStride();
+    const size_t indexOffset = _geometry.getIndexOffset();
+
+    glBindBuffer(GL_COPY_READ_BUFFER, _geometry.getVertexBuffer());
+    glGetBufferSubData(GL_COPY_READ_BUFFER, vertexOffset, vertexData.size(), vertexData.data());
+    glBindBuffer(GL_COPY_READ_BUFFER, _geometry.getIndexBuffer());
+    if (_indexType == GL_UNSIGNED_SHORT) {
+        glGetBufferSubData(GL_COPY_READ_BUFFER, indexOffset, indexCount * sizeof(uint16_t), shortIndices.data());
+        std::copy(shortIndices.begin(), shortIndices.end(), indices.begin());
+    }
+    else {
+        glGetBufferSubData(GL_COPY_READ_BUFFER, indexOffset, indexCount * sizeof(uint32_t), indices.data());
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    UnpackVertices(vertexData.data(), _vertexCount, _vertexFormat, vertices.data());
+}
+
+GLuint Mesh::getVao() const {
+    return _geometry.getVao();
+}
+
+GLuint Mesh::getBoundingBoxVao() const {
+    return _boxGeometry.getVao();
+}
+
+GLuint Mesh::getVertexBuffer() const {
+    return _geometry.getVertexBuffer();
+}
+
+GLuint Mesh::getIndexBuffer() const {
+    return _geometry.getIndexBuffer();
+}
+
+size_t Mesh::getVertexCount() const {
+    return _vertexCount;
+}
+
+size_t Mesh::getFaceCount() const {
+    return getLod(0).indexCount / 3;
+}
+
+int Mesh::getLodCount() const {
+    return static_cast<int>(_lods.size());
+}
+
+const MeshLod& Mesh::getLod(int level) const {
+    return _lods[std::min(std::max(level, 0), getLodCount() - 1)];
+}
+
+size_t Mesh::getGpuBytes() const {
+    const size_t indexSize = _indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+    return _vertexCount * _vertexFormat.getStride() + _indexCount * indexSize;
+}
+
+const VertexFormat& Mesh::getVertexFormat() const {
+    return _vertexFormat;
+}
+
+GLenum Mesh::getIndexType() const {
+    return _indexType;
+}
+
+void Mesh::initGLResources(
+    const void* vertexData, size_t vertexCount, const VertexFormat& format,
+    const void* indexData, size_t indexCount, GLenum indexType) {
+    _vertexCount = vertexCount;
+    _indexCount = indexCount;
+
+    _vertexFormat = format;
+    _indexType = indexType;
+
+    _geometry = GeometryArena::getInstance().allocate(
+        GeometryLayout::of(_vertexFormat), vertexData, vertexCount, indexData, indexCount, _indexType);
+}
+
+void Mesh::initBoxGLResources() {
+    std::vector<glm::vec3> boxVertices = {
+        glm::vec3(_boundingBox.min.x, _boundingBox.min.y, _boundingBox.min.z),
+        glm::vec3(_boundingBox.max.x, _boundingBox.min.y, _boundingBox.min.z),
+        glm::vec3(_boundingBox.min.x, _boundingBox.max.y, _boundingBox.min.z),
+        glm::vec3(_boundingBox.max.x, _boundingBox.max.y, _boundingBox.min.z),
+        glm::vec3(_boundingBox.min.x, _boundingBox.min.y, _boundingBox.max.z),
+        glm::vec3(_boundingBox.max.x, _boundingBox.min.y, _boundingBox.max.z),
+        glm::vec3(_boundingBox.min.x, _boundingBox.max.y, _boundingBox.max.z),
+        glm::vec3(_boundingBox.max.x, _boundingBox.max.y, _boundingBox.max.z),
+    };
+
+    std::vector<uint32_t> boxIndices = {
+        0, 1,
+        0, 2,
+        0, 4,
+        3, 1,
+        3, 2,
+        3, 7,
+        5, 4,
+        5, 1,
+        5, 7,
+        6, 4,
+        6, 7,
+        6, 2
+    };
+
+    _boxGeometry = GeometryArena::getInstance().allocate(GeometryLayout::positions(),
+        boxVertices.data(), boxVertices.size(), boxIndices.data(), boxIndices.size(), GL_UNSIGNED_INT);
+}
+
+void Mesh::cleanup() {
+    _boxGeometry.reset();
+    _geometry.reset();
+}
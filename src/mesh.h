@@ -0,0 +1,154 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include <glad/glad.h>
+
+#include "./base/vertex.h"
+#include "./base/bounding_box.h"
+#include "./base/draw_range.h"
+#include "geometry_arena.h"
+#include "mesh_cache.h"
+#include "vertex_format.h"
+
+// Vertex and index buffer contents of a mesh before upload, the cpu half of a
+// mesh, in the default vertex format. They are mapped from the mesh cache when
+// it is valid, otherwise built from the obj file and packed. Loading does not
+// touch opengl, so it can run on a worker thread.
+class MeshData {
+public:
+    // throws if the obj file cannot be loaded
+    MeshData(const std::string& filepath);
+
+    MeshData(MeshData&& rhs) noexcept = default;
+
+    ~MeshData() = default;
+
+    const std::string& getPath() const;
+
+    // vertices in getVertexFormat()
+    const void* getVertexData() const;
+
+    size_t getVertexCount() const;
+
+    // indices of getIndexType()
+    const void* getIndexData() const;
+
+    size_t getIndexCount() const;
+
+    const VertexFormat& getVertexFormat() const;
+
+    GLenum getIndexType() const;
+
+    BoundingBox getBoundingBox() const;
+
+    // ranges of the index array, the full mesh first
+    const std::vector<MeshLod>& getLods() const;
+
+private:
+    std::string _path;
+
+    // either the mapped cache entry or the arrays built from the obj
+    std::unique_ptr<MeshCache> _cache;
+    std::vector<Vertex> _vertices;
+    std::vector<uint32_t> _indices;
+
+    // the format, and the packed arrays of those built from the obj
+    PackedGeometry _packedGeometry;
+
+    BoundingBox _boundingBox;
+
+    std::vector<MeshLod> _lods;
+
+    void loadObj();
+};
+
+// Geometry uploaded to the gpu, shared by every model instance that uses it.
+// A mesh is immutable once constructed.
+class Mesh {
+public:
+    Mesh(const std::string& filepath);
+
+    Mesh(const MeshData& data);
+
+    Mesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+
+    Mesh(const Mesh&) = delete;
+
+    Mesh(Mesh&& rhs) noexcept;
+
+    virtual ~Mesh();
+
+    // the geometry arena pool's vertex array, shared with other meshes
+    GLuint getVao() const;
+
+    GLuint getBoundingBoxVao() const;
+
+    // for vertex arrays that add attributes of their own, e.g. per instance,
+    // the draw range's base vertex and offset select the mesh within them
+    GLuint getVertexBuffer() const;
+
+    GLuint getIndexBuffer() const;
+
+    size_t getVertexCount() const;
+
+    // faces of the full detail level
+    size_t getFaceCount() const;
+
+    // at least one, level 0 is the full mesh and each further one coarser
+    int getLodCount() const;
+
+    const MeshLod& getLod(int level) const;
+
+    // bytes of gpu buffer memory held by the mesh
+    size_t getGpuBytes() const;
+
+    // layout of the vertex buffer, the shader needs its position offset and scale
+    const VertexFormat& getVertexFormat() const;
+
+    // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    GLenum getIndexType() const;
+
+    BoundingBox getBoundingBox() const;
+
+    // read the vertex and index buffers back from the gpu, e.g. for exporting,
+    // the indices of the full detail level only
+    void downloadGeometry(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) const;
+
+    // the index range of a level of detail, clamped like getLod
+    DrawRange getDrawRange(int lod = 0) const;
+
+    virtual void draw(int lod = 0) const;
+
+    virtual void drawBoundingBox() const;
+
+protected:
+    // the vertices and indices only live in the gpu buffers
+    size_t _vertexCount = 0;
+    size_t _indexCount = 0;
+
+    // chosen per mesh from the vertex format options
+    VertexFormat _vertexFormat;
+    GLenum _indexType = GL_UNSIGNED_INT;
+
+    // levels of detail, ranges of the one index buffer
+    std::vector<MeshLod> _lods;
+
+    // bounding box
+    BoundingBox _boundingBox;
+
+    // ranges of the geometry arena
+    GeometryAllocation _geometry;
+    GeometryAllocation _boxGeometry;
+
+    // the buffer contents as they are, already in the format and index type
+    void initGLResources(
+        const void* vertexData, size_t vertexCount, const VertexFormat& format,
+        const void* indexData, size_t indexCount, GLenum indexType);
+
+    void initBoxGLResources();
+
+    void cleanup();
+};
\ No newline at end of file
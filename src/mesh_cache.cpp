@@ -0,0 +1,301 @@
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <stdexcept>
+#include <filesystem>
+
+#include "./base/hash.h"
+#include "./base/file_stamp.h"
+#include "mesh_cache.h"
+
+namespace {
+	const std::string cacheDirectory = "./cache/meshes/";
+
+	constexpr char kMagic[4] = { 'M', 'E', 'S', 'H' };
+	constexpr uint32_t kVersion = 4;
+	// keep the arrays aligned for the driver's memcpy and for SIMD readers
+	constexpr uint64_t kAlignment = 64;
+
+	struct Header {
+		char magic[4];
+		uint32_t version;
+		uint32_t vertexStride;
+		uint32_t pathLength;
+		uint32_t optimizeFlags;
+		float overdrawThreshold;
+		uint32_t lodCount;
+		uint32_t formatOptionFlags;
+		uint32_t formatFlags;
+		uint32_t indexType;
+		float positionOffset[3];
+		float positionScale[3];
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		uint64_t sourceHash;
+		uint64_t payloadHash;
+		uint64_t vertexCount;
+		uint64_t indexCount;
+		uint64_t vertexOffset;
+		uint64_t indexOffset;
+		float boxMin[3];
+		float boxMax[3];
+	};
+
+	uint64_t alignUp(uint64_t offset) {
+		return (offset + kAlignment - 1) / kAlignment * kAlignment;
+	}
+
+	uint32_t getOptimizeFlags(const MeshOptimizeOptions& options) {
+		return (options.vertexCache ? 1u : 0u) | (options.overdraw ? 2u : 0u) | (options.vertexFetch ? 4u : 0u) |
+			static_cast<uint32_t>(std::max(options.lodLevels, 1)) << 8;
+	}
+
+	uint32_t getFormatOptionFlags(const VertexFormatOptions& options) {
+		return (options.packed ? 1u : 0u) | (options.quantizePositions ? 2u : 0u) | (options.shortIndices ? 4u : 0u);
+	}
+
+	uint32_t getFormatFlags(const VertexFormat& format) {
+		return (format.packed ? 1u : 0u) | (format.quantizedPositions ? 2u : 0u) |
+			(format.normalizedTexCoords ? 4u : 0u);
+	}
+
+	size_t getIndexSize(GLenum indexType) {
+		return indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+	}
+
+	template <typename Index>
+	bool checkIndices(const void* data, size_t count, size_t vertexCount) {
+		const Index* indices = static_cast<const Index*>(data);
+		for (size_t i = 0; i < count; ++i) {
+			if (indices[i] >= vertexCount) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	uint64_t getPayloadHash(
+		const void* vertices, size_t vertexBytes, const void* indices, size_t indexBytes,
+		const void* lods, size_t lodBytes) {
+		return hashBytes(lods, lodBytes, hashBytes(indices, indexBytes, hashBytes(vertices, vertexBytes)));
+	}
+}
+
+MeshCache::MeshCache(
+	const std::string& objPath,
+	const MeshOptimizeOptions& options,
+	const VertexFormatOptions& formatOptions)
+	: _file(getCachePath(objPath)) {
+	const char* data = _file.getData();
+	const size_t size = _file.getSize();
+
+	Header header;
+	if (size < sizeof(Header)) {
+		throw std::runtime_error("mesh cache of " + objPath + " is truncated");
+	}
+	std::memcpy(&header, data, sizeof(Header));
+
+	if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion) {
+		throw std::runtime_error("mesh cache of " + objPath + " has an incompatible format");
+	}
+
+	_vertexFormat.packed = (header.formatFlags & 1u) != 0;
+	_vertexFormat.quantizedPositions = (header.formatFlags & 2u) != 0;
+	_vertexFormat.normalizedTexCoords = (header.formatFlags & 4u) != 0;
+	_vertexFormat.positionOffset = glm::vec3(
+		header.positionOffset[0], header.positionOffset[1], header.positionOffset[2]);
+	_vertexFormat.positionScale = glm::vec3(
+		header.positionScale[0], header.positionScale[1], header.positionScale[2]);
+	_indexType = header.indexType;
+	if (header.vertexStride != static_cast<uint32_t>(_vertexFormat.getStride()) ||
+		(_indexType != GL_UNSIGNED_SHORT && _indexType != GL_UNSIGNED_INT)) {
+		throw std::runtime_error("mesh cache of " + objPath + " has an incompatible format");
+	}
+
+	const uint64_t lodBytes = static_cast<uint64_t>(header.lodCount) * sizeof(MeshLod);
+	if (header.pathLength != objPath.size() ||
+		sizeof(Header) + header.pathLength + lodBytes > size ||
+		std::memcmp(data + sizeof(Header), objPath.data(), objPath.size()) != 0) {
+		throw std::runtime_error("mesh cache of " + objPath + " belongs to another file");
+	}
+
+	const uint64_t vertexBytes = header.vertexCount * header.vertexStride;
+	const uint64_t indexBytes = header.indexCount * getIndexSize(_indexType);
+	if (header.vertexOffset % kAlignment != 0 || header.indexOffset % kAlignment != 0 ||
+		header.vertexOffset + vertexBytes > size || header.indexOffset + indexBytes > size) {
+		throw std::runtime_error("mesh cache of " + objPath + " is truncated");
+	}
+
+	if (header.optimizeFlags != getOptimizeFlags(options) ||
+		(options.overdraw && header.overdrawThreshold != options.overdrawThreshold)) {
+		throw std::runtime_error("mesh cache of " + objPath + " is optimized differently");
+	}
+
+	if (header.formatOptionFlags != getFormatOptionFlags(formatOptions)) {
+		throw std::runtime_error("mesh cache of " + objPath + " is packed differently");
+	}
+
+	// stale if the source changed, the cheap checks go first
+	const FileStamp source = GetFileStamp(objPath);
+	if (header.sourceSize != source.size || header.sourceTime != source.time ||
+		header.sourceHash != GetFileHash(objPath)) {
+		throw std::runtime_error("mesh cache of " + objPath + " is stale");
+	}
+
+	const void* vertices = data + header.vertexOffset;
+	const void* indices = data + header.indexOffset;
+	const char* lods = data + sizeof(Header) + header.pathLength;
+	if (header.payloadHash != getPayloadHash(vertices, vertexBytes, indices, indexBytes, lods, lodBytes)) {
+		throw std::runtime_error("mesh cache of " + objPath + " is corrupt");
+	}
+
+	_vertexData = vertices;
+	_vertexCount = static_cast<size_t>(header.vertexCount);
+	_indexData = indices;
+	_indexCount = static_cast<size_t>(header.indexCount);
+	_boundingBox.min = glm::vec3(header.boxMin[0], header.boxMin[1], header.boxMin[2]);
+	_boundingBox.max = glm::vec3(header.boxMax[0], header.boxMax[1], header.boxMax[2]);
+
+	const bool validIndices = _indexType == GL_UNSIGNED_SHORT ?
+		checkIndices<uint16_t>(_indexData, _indexCount, _vertexCount) :
+		checkIndices<uint32_t>(_indexData, _indexCount, _vertexCount);
+	if (!validIndices) {
+		throw std::runtime_error("mesh cache of " + objPath + " is corrupt");
+	}
+
+	// the table follows the path unaligned, copy it out
+	if (header.lodCount == 0) {
+		throw std::runtime_error("mesh cache of " + objPath + " is corrupt");
+	}
+	_lods.resize(header.lodCount);
+	std::memcpy(_lods.data(), lods, lodBytes);
+	for (const MeshLod& lod : _lods) {
+		if (static_cast<uint64_t>(lod.indexOffset) + lod.indexCount > _indexCount) {
+			throw std::runtime_error("mesh cache of " + objPath + " is corrupt");
+		}
+	}
+}
+
+const void* MeshCache::getVertexData() const {
+	return _vertexData;
+}
+
+size_t MeshCache::getVertexCount() const {
+	return _vertexCount;
+}
+
+const void* MeshCache::getIndexData() const {
+	return _indexData;
+}
+
+size_t MeshCache::getIndexCount() const {
+	return _indexCount;
+}
+
+const VertexFormat& MeshCache::getVertexFormat() const {
+	return _vertexFormat;
+}
+
+GLenum MeshCache::getIndexType() const {
+	return _indexType;
+}
+
+BoundingBox MeshCache::getBoundingBox() const {
+	return _boundingBox;
+}
+
+const std::vector<MeshLod>& MeshCache::getLods() const {
+	return _lods;
+}
+
+bool MeshCache::save(
+	const std::string& objPath,
+	const void* vertexData, size_t vertexCount, const VertexFormat& format,
+	const void* indexData, size_t indexCount, GLenum indexType,
+	const BoundingBox& boundingBox,
+	const std::vector<MeshLod>& lods,
+	const MeshOptimizeOptions& options,
+	const VertexFormatOptions& formatOptions) {
+	const std::string cachePath = getCachePath(objPath);
+	const std::string tempPath = cachePath + ".tmp";
+
+	try {
+		std::filesystem::create_directories(cacheDirectory);
+
+		const FileStamp source = GetFileStamp(objPath);
+		const size_t vertexBytes = vertexCount * format.getStride();
+		const size_t indexBytes = indexCount * getIndexSize(indexType);
+		const size_t lodBytes = lods.size() * sizeof(MeshLod);
+
+		Header header = {};
+		std::memcpy(header.magic, kMagic, sizeof(kMagic));
+		header.version = kVersion;
+		header.vertexStride = static_cast<uint32_t>(format.getStride());
+		header.pathLength = static_cast<uint32_t>(objPath.size());
+		header.optimizeFlags = getOptimizeFlags(options);
+		header.overdrawThreshold = options.overdrawThreshold;
+		header.lodCount = static_cast<uint32_t>(lods.size());
+		header.formatOptionFlags = getFormatOptionFlags(formatOptions);
+		header.formatFlags = getFormatFlags(format);
+		header.indexType = indexType;
+		for (int i = 0; i < 3; ++i) {
+			header.positionOffset[i] = format.positionOffset[i];
+			header.positionScale[i] = format.positionScale[i];
+		}
+		header.sourceSize = source.size;
+		header.sourceTime = source.time;
+		header.sourceHash = GetFileHash(objPath);
+		header.payloadHash = getPayloadHash(
+			vertexData, vertexBytes, indexData, indexBytes, lods.data(), lodBytes);
+		header.vertexCount = vertexCount;
+		header.indexCount = indexCount;
+		header.vertexOffset = alignUp(sizeof(Header) + objPath.size() + lodBytes);
+		header.indexOffset = alignUp(header.vertexOffset + vertexBytes);
+		for (int i = 0; i < 3; ++i) {
+			header.boxMin[i] = boundingBox.min[i];
+			header.boxMax[i] = boundingBox.max[i];
+		}
+
+		// write to a temporary file and rename it, so that a reader never
+		// sees a half written entry
+		{
+			std::ofstream fout(tempPath, std::ios::binary | std::ios::trunc);
+			if (!fout.is_open()) {
+				throw std::runtime_error("open " + tempPath + " failure");
+			}
+
+			const char padding[kAlignment] = {};
+			fout.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+			fout.write(objPath.data(), objPath.size());
+			fout.write(reinterpret_cast<const char*>(lods.data()), lodBytes);
+			fout.write(padding, header.vertexOffset - sizeof(Header) - objPath.size() - lodBytes);
+			fout.write(static_cast<const char*>(vertexData), vertexBytes);
+			fout.write(padding, header.indexOffset - header.vertexOffset - vertexBytes);
+			fout.write(static_cast<const char*>(indexData), indexBytes);
+
+			if (!fout) {
+				throw std::runtime_error("write " + tempPath + " failure");
+			}
+		}
+
+		std::filesystem::rename(tempPath, cachePath);
+	}
+	catch (const std::exception& e) {
+		std::cerr << "save mesh cache of " << objPath << " failure: " << e.what() << std::endl;
+		std::error_code ec;
+		std::filesystem::remove(tempPath, ec);
+		return false;
+	}
+
+	return true;
+}
+
+std::string MeshCache::getCachePath(const std::string& objPath) {
+	std::stringstream ss;
+	ss << cacheDirectory << std::filesystem::path(objPath).stem().string() << "-"
+		<< std::hex << std::setw(16) << std::setfill('0') << fnv1a(objPath) << ".mesh";
+	return ss.str();
+}
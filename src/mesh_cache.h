@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "./base/vertex.h"
+#include "./base/bounding_box.h"
+#include "./base/mapped_file.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "vertex_format.h"
+
+// Binary cache of a model's final vertex and index buffers, one file per
+// source obj. The entry is keyed by the source path, size, mtime and content
+// hash, by the optimizations applied to the arrays and by the vertex format
+// options they were packed with. The table of the levels of detail in the
+// index array follows the header, and the packed vertex and index streams are
+// stored aligned so the mapped file can be passed straight to glBufferData.
+class MeshCache {
+public:
+	// map the cache entry of an obj file, throws if it is missing, stale, corrupt
+	// or optimized or packed with other options
+	MeshCache(
+		const std::string& objPath,
+		const MeshOptimizeOptions& options,
+		const VertexFormatOptions& formatOptions);
+
+	MeshCache(MeshCache&& rhs) noexcept = default;
+
+	~MeshCache() = default;
+
+	// vertices in getVertexFormat()
+	const void* getVertexData() const;
+
+	size_t getVertexCount() const;
+
+	// indices of getIndexType()
+	const void* getIndexData() const;
+
+	size_t getIndexCount() const;
+
+	const VertexFormat& getVertexFormat() const;
+
+	GLenum getIndexType() const;
+
+	BoundingBox getBoundingBox() const;
+
+	const std::vector<MeshLod>& getLods() const;
+
+	// write the cache entry of an obj file, errors are reported but not thrown
+	static bool save(
+		const std::string& objPath,
+		const void* vertexData, size_t vertexCount, const VertexFormat& format,
+		const void* indexData, size_t indexCount, GLenum indexType,
+		const BoundingBox& boundingBox,
+		const std::vector<MeshLod>& lods,
+		const MeshOptimizeOptions& options,
+		const VertexFormatOptions& formatOptions);
+
+	static std::string getCachePath(const std::string& objPath);
+
+private:
+	MappedFile _file;
+
+	const void* _vertexData = nullptr;
+	size_t _vertexCount = 0;
+
+	const void* _indexData = nullptr;
+	size_t _indexCount = 0;
+
+	VertexFormat _vertexFormat;
+	GLenum _indexType = GL_UNSIGNED_INT;
+
+	BoundingBox _boundingBox;
+
+	std::vector<MeshLod> _lods;
+};
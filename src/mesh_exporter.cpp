@@ -0,0 +1,170 @@
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+
+#include "mesh_cache.h"
+#include "mesh_exporter.h"
+
+namespace {
+	struct BinaryHeader {
+		char magic[4];
+		uint32_t version;
+		uint32_t vertexSize;
+		uint32_t vertexCount;
+		uint32_t indexCount;
+	};
+
+	bool writeBinary(const std::string& path,
+		const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices) {
+		std::error_code ec;
+		const std::filesystem::path parent = std::filesystem::path(path).parent_path();
+		if (!parent.empty()) {
+			std::filesystem::create_directories(parent, ec);
+		}
+
+		std::ofstream fout(path, std::ios::binary);
+		if (!fout.is_open()) {
+			std::cout << "file:" << path << "write error" << std::endl;
+			return false;
+		}
+
+		BinaryHeader header = { { 'M', 'S', 'H', 'B' }, 1,
+			static_cast<uint32_t>(sizeof(Vertex)),
+			static_cast<uint32_t>(vertices.size()),
+			static_cast<uint32_t>(indices.size()) };
+		fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		fout.write(reinterpret_cast<const char*>(vertices.data()), vertices.size() * sizeof(Vertex));
+		fout.write(reinterpret_cast<const char*>(indices.data()), indices.size() * sizeof(uint32_t));
+
+		return static_cast<bool>(fout);
+	}
+
+	// every deduplicated vertex becomes one v/vt/vn triple with a shared index
+	bool writeObj(const std::string& path,
+		const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices) {
+		attrib_t attrib;
+		index_t index;
+		attrib.vertexPosition.reserve(vertices.size());
+		attrib.vertexTexcoord.reserve(vertices.size());
+		attrib.vertexNormal.reserve(vertices.size());
+		for (const auto& v : vertices) {
+			attrib.vertexPosition.push_back(v.position);
+			attrib.vertexTexcoord.push_back(v.texCoord);
+			attrib.vertexNormal.push_back(v.normal);
+		}
+
+		index.positionIndex.reserve(indices.size() / 3);
+		for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+			index.positionIndex.push_back(glm::ivec3(indices[i], indices[i + 1], indices[i + 2]));
+		}
+		index.texcoordIndex = index.positionIndex;
+		index.normalIndex = index.positionIndex;
+
+		return SaveObj(path, attrib, index);
+	}
+
+	template <typename Job>
+	bool timed(const std::string& path, Job job) {
+		auto start = std::chrono::high_resolution_clock::now();
+		const bool success = job();
+		auto now = std::chrono::high_resolution_clock::now();
+		std::cout << "export " << path << (success ? "" : " failure") << " in "
+			<< std::chrono::duration<double, std::milli>(now - start).count() << " ms" << std::endl;
+		return success;
+	}
+}
+
+MeshExporter::MeshExporter() {
+	_worker = std::thread(&MeshExporter::run, this);
+}
+
+MeshExporter& MeshExporter::getInstance() {
+	static MeshExporter exporter;
+	return exporter;
+}
+
+MeshExporter::~MeshExporter() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_condition.notify_one();
+	_worker.join();
+}
+
+std::future<bool> MeshExporter::exportMesh(
+	const std::string& path,
+	std::vector<Vertex> vertices,
+	std::vector<uint32_t> indices,
+	MeshExportFormat format) {
+	return enqueue(std::packaged_task<bool()>(
+		[path, format, vertices = std::move(vertices), indices = std::move(indices)]() {
+		return timed(path, [&]() {
+			return format == MeshExportFormat::Obj ?
+				writeObj(path, vertices, indices) : writeBinary(path, vertices, indices);
+		});
+	}));
+}
+
+std::future<bool> MeshExporter::exportObj(const std::string& path, attrib_t attrib, index_t index) {
+	return enqueue(std::packaged_task<bool()>(
+		[path, attrib = std::move(attrib), index = std::move(index)]() {
+		return timed(path, [&]() { return SaveObj(path, attrib, index); });
+	}));
+}
+
+std::future<bool> MeshExporter::exportCache(
+	const std::string& objPath,
+	std::vector<unsigned char> vertexData,
+	const VertexFormat& format,
+	std::vector<unsigned char> indexData,
+	GLenum indexType,
+	const BoundingBox& boundingBox,
+	std::vector<MeshLod> lods,
+	const MeshOptimizeOptions& options,
+	const VertexFormatOptions& formatOptions) {
+	return enqueue(std::packaged_task<bool()>(
+		[objPath, format, indexType, boundingBox, options, formatOptions,
+		vertexData = std::move(vertexData), indexData = std::move(indexData), lods = std::move(lods)]() {
+		const size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+		return timed(MeshCache::getCachePath(objPath), [&]() {
+			return MeshCache::save(objPath,
+				vertexData.data(), vertexData.size() / format.getStride(), format,
+				indexData.data(), indexData.size() / indexSize, indexType,
+				boundingBox, lods, options, formatOptions);
+		});
+	}));
+}
+
+size_t MeshExporter::getPendingCount() const {
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _jobs.size();
+}
+
+std::future<bool> MeshExporter::enqueue(std::packaged_task<bool()> job) {
+	std::future<bool> result = job.get_future();
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_jobs.push_back(std::move(job));
+	}
+	_condition.notify_one();
+	return result;
+}
+
+void MeshExporter::run() {
+	for (;;) {
+		std::packaged_task<bool()> job;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_condition.wait(lock, [this]() { return _stop || !_jobs.empty(); });
+			if (_jobs.empty()) {
+				return;
+			}
+			job = std::move(_jobs.front());
+			_jobs.pop_front();
+		}
+		job();
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "./base/bounding_box.h"
+#include "./base/vertex.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "obj_loader.h"
+#include "vertex_format.h"
+
+enum class MeshExportFormat {
+	Obj,    // wavefront obj text
+	Binary  // header followed by the raw vertex and index arrays
+};
+
+// Writes meshes to disk on a background thread so that callers never block
+// on formatting or file io. The data is moved into the queued job.
+class MeshExporter {
+public:
+	MeshExporter();
+
+	MeshExporter(const MeshExporter&) = delete;
+
+	// the exporter the mesh loads write their cache entries with
+	static MeshExporter& getInstance();
+
+	// finishes all queued jobs before returning
+	~MeshExporter();
+
+	std::future<bool> exportMesh(
+		const std::string& path,
+		std::vector<Vertex> vertices,
+		std::vector<uint32_t> indices,
+		MeshExportFormat format);
+
+	std::future<bool> exportObj(const std::string& path, attrib_t attrib, index_t index);
+
+	// the mesh cache entry of an obj file from its buffer contents, see MeshCache::save
+	std::future<bool> exportCache(
+		const std::string& objPath,
+		std::vector<unsigned char> vertexData,
+		const VertexFormat& format,
+		std::vector<unsigned char> indexData,
+		GLenum indexType,
+		const BoundingBox& boundingBox,
+		std::vector<MeshLod> lods,
+		const MeshOptimizeOptions& options,
+		const VertexFormatOptions& formatOptions);
+
+	size_t getPendingCount() const;
+
+private:
+	std::thread _worker;
+	mutable std::mutex _mutex;
+	std::condition_variable _condition;
+	std::deque<std::packaged_task<bool()>> _jobs;
+	bool _stop = false;
+
+	std::future<bool> enqueue(std::packaged_task<bool()> job);
+
+	void run();
+};
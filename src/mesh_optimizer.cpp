@@ -0,0 +1,310 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "mesh_optimizer.h"
+
+namespace {
+	MeshOptimizeOptions defaultMeshOptimizeOptions;
+
+	constexpr uint32_t kUnused = UINT32_MAX;
+
+	// lru cache modelled by the vertex cache pass and the weights of its
+	// scoring function, as tuned in Forsyth's linear-speed vertex cache optimisation
+	constexpr int kCacheSize = 32;
+	constexpr int kMaxValence = 32;
+	constexpr float kCacheDecayPower = 1.5f;
+	constexpr float kLastTriangleScore = 0.75f;
+	constexpr float kValenceBoostScale = 2.0f;
+	constexpr float kValenceBoostPower = 0.5f;
+
+	// fifo cache used to split triangles into clusters for the overdraw pass
+	constexpr int kClusterCacheSize = 16;
+	constexpr size_t kMinClusterSize = 16;
+
+	struct ScoreTable {
+		float cache[kCacheSize];
+		float valence[kMaxValence + 1];
+
+		ScoreTable() {
+			for (int i = 0; i < kCacheSize; ++i) {
+				// the last triangle's vertices score alike, so that its
+				// order does not matter
+				cache[i] = i < 3 ? kLastTriangleScore :
+					std::pow(1.0f - (i - 3) / static_cast<float>(kCacheSize - 3), kCacheDecayPower);
+			}
+
+			// vertices with few triangles left are finished early
+			valence[0] = 0.0f;
+			for (int i = 1; i <= kMaxValence; ++i) {
+				valence[i] = kValenceBoostScale * std::pow(static_cast<float>(i), -kValenceBoostPower);
+			}
+		}
+
+		float getScore(int cachePosition, uint32_t remaining) const {
+			if (remaining == 0) {
+				return -1.0f;
+			}
+			return (cachePosition >= 0 ? cache[cachePosition] : 0.0f) +
+				valence[std::min<uint32_t>(remaining, kMaxValence)];
+		}
+	};
+}
+
+void SetDefaultMeshOptimizeOptions(const MeshOptimizeOptions& options) {
+	defaultMeshOptimizeOptions = options;
+}
+
+const MeshOptimizeOptions& GetDefaultMeshOptimizeOptions() {
+	return defaultMeshOptimizeOptions;
+}
+
+float ComputeAcmr(const std::vector<uint32_t>& indices, size_t vertexCount, int cacheSize) {
+	if (indices.size() < 3) {
+		return 0.0f;
+	}
+
+	// a vertex is cached while fewer than cacheSize misses happened since its own
+	std::vector<uint32_t> timestamps(vertexCount, 0);
+	uint32_t time = cacheSize + 1;
+	size_t misses = 0;
+	for (uint32_t index : indices) {
+		if (time - timestamps[index] > static_cast<uint32_t>(cacheSize)) {
+			timestamps[index] = time++;
+			++misses;
+		}
+	}
+
+	return static_cast<float>(misses) / (indices.size() / 3);
+}
+
+void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount) {
+	static const ScoreTable scores;
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0) {
+		return;
+	}
+
+	// triangles of every vertex, the first remaining[v] of them are not emitted yet
+	std::vector<uint32_t> remaining(vertexCount, 0);
+	for (uint32_t index : indices) {
+		++remaining[index];
+	}
+
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+	std::partial_sum(remaining.begin(), remaining.end(), offsets.begin() + 1);
+
+	std::vector<uint32_t> adjacency(indices.size());
+	{
+		std::vector<uint32_t> cursors(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < indices.size(); ++i) {
+			adjacency[cursors[indices[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+	}
+
+	std::vector<int> cachePositions(vertexCount, -1);
+	std::vector<float> vertexScores(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v) {
+		vertexScores[v] = scores.getScore(-1, remaining[v]);
+	}
+
+	std::vector<float> triangleScores(triangleCount);
+	for (size_t t = 0; t < triangleCount; ++t) {
+		triangleScores[t] = vertexScores[indices[3 * t]] +
+			vertexScores[indices[3 * t + 1]] + vertexScores[indices[3 * t + 2]];
+	}
+
+	std::vector<char> emitted(triangleCount, 0);
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+
+	std::vector<uint32_t> cache, nextCache;
+	cache.reserve(kCacheSize + 3);
+	nextCache.reserve(kCacheSize + 3);
+
+	size_t best = std::max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin();
+	size_t scan = 0;
+
+	for (size_t count = 0; count < triangleCount; ++count) {
+		// nothing in the cache has triangles left, continue in input order
+		if (best == kUnused) {
+			while (emitted[scan]) {
+				++scan;
+			}
+			best = scan;
+		}
+
+		emitted[best] = 1;
+		const uint32_t* triangle = &indices[3 * best];
+		result.insert(result.end(), triangle, triangle + 3);
+
+		for (int k = 0; k < 3; ++k) {
+			const uint32_t v = triangle[k];
+			uint32_t* begin = &adjacency[offsets[v]];
+			uint32_t* end = begin + remaining[v];
+			std::iter_swap(std::find(begin, end, static_cast<uint32_t>(best)), end - 1);
+			--remaining[v];
+		}
+
+		// the triangle's vertices move to the front, the rest shift back
+		nextCache.clear();
+		for (int k = 0; k < 3; ++k) {
+			if (std::find(nextCache.begin(), nextCache.end(), triangle[k]) == nextCache.end()) {
+				nextCache.push_back(triangle[k]);
+			}
+		}
+		const size_t fresh = nextCache.size();
+		for (uint32_t v : cache) {
+			if (std::find(nextCache.begin(), nextCache.begin() + fresh, v) == nextCache.begin() + fresh) {
+				nextCache.push_back(v);
+			}
+		}
+
+		// rescore the cached and the evicted vertices and their triangles,
+		// the best of those triangles goes next
+		best = kUnused;
+		float bestScore = -1.0f;
+		for (size_t i = 0; i < nextCache.size(); ++i) {
+			const uint32_t v = nextCache[i];
+			cachePositions[v] = i < kCacheSize ? static_cast<int>(i) : -1;
+
+			const float score = scores.getScore(cachePositions[v], remaining[v]);
+			const float delta = score - vertexScores[v];
+			vertexScores[v] = score;
+
+			for (uint32_t j = offsets[v]; j < offsets[v] + remaining[v]; ++j) {
+				const uint32_t t = adjacency[j];
+				triangleScores[t] += delta;
+				if (triangleScores[t] > bestScore) {
+					bestScore = triangleScores[t];
+					best = t;
+				}
+			}
+		}
+
+		if (nextCache.size() > kCacheSize) {
+			nextCache.resize(kCacheSize);
+		}
+		cache.swap(nextCache);
+	}
+
+	indices.swap(result);
+}
+
+void OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, float threshold) {
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0) {
+		return;
+	}
+
+	// a cluster ends where the cache order jumps, i.e. a triangle misses on all three vertices
+	std::vector<size_t> clusters = { 0 };
+	{
+		std::vector<uint32_t> timestamps(vertices.size(), 0);
+		uint32_t time = kClusterCacheSize + 1;
+		for (size_t t = 0; t < triangleCount; ++t) {
+			int misses = 0;
+			for (int k = 0; k < 3; ++k) {
+				const uint32_t v = indices[3 * t + k];
+				if (time - timestamps[v] > kClusterCacheSize) {
+					timestamps[v] = time++;
+					++misses;
+				}
+			}
+			if (misses == 3 && t - clusters.back() >= kMinClusterSize) {
+				clusters.push_back(t);
+			}
+		}
+		clusters.push_back(triangleCount);
+	}
+
+	// area weighted centroid and normal of each cluster and of the mesh
+	const size_t clusterCount = clusters.size() - 1;
+	std::vector<glm::vec3> centroids(clusterCount, glm::vec3(0.0f));
+	std::vector<glm::vec3> normals(clusterCount, glm::vec3(0.0f));
+	std::vector<float> areas(clusterCount, 0.0f);
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+
+	for (size_t c = 0; c < clusterCount; ++c) {
+		for (size_t t = clusters[c]; t < clusters[c + 1]; ++t) {
+			const glm::vec3& p0 = vertices[indices[3 * t]].position;
+			const glm::vec3& p1 = vertices[indices[3 * t + 1]].position;
+			const glm::vec3& p2 = vertices[indices[3 * t + 2]].position;
+			const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			const float area = glm::length(normal);
+
+			centroids[c] += (p0 + p1 + p2) * (area / 3.0f);
+			normals[c] += normal;
+			areas[c] += area;
+		}
+		meshCentroid += centroids[c];
+		meshArea += areas[c];
+	}
+	meshCentroid /= std::max(meshArea, 1e-20f);
+
+	// clusters far out along their own normal occlude the others, draw them first
+	std::vector<float> sortKeys(clusterCount, 0.0f);
+	for (size_t c = 0; c < clusterCount; ++c) {
+		const float length = glm::length(normals[c]);
+		if (areas[c] > 0.0f && length > 0.0f) {
+			sortKeys[c] = glm::dot(centroids[c] / areas[c] - meshCentroid, normals[c] / length);
+		}
+	}
+
+	std::vector<size_t> order(clusterCount);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&sortKeys](size_t a, size_t b) {
+		return sortKeys[a] > sortKeys[b];
+	});
+
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+	for (size_t c : order) {
+		result.insert(result.end(), indices.begin() + 3 * clusters[c], indices.begin() + 3 * clusters[c + 1]);
+	}
+
+	if (ComputeAcmr(result, vertices.size()) <= ComputeAcmr(indices, vertices.size()) * threshold) {
+		indices.swap(result);
+	}
+}
+
+void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+	std::vector<uint32_t> remap(vertices.size(), kUnused);
+	std::vector<Vertex> result;
+	result.reserve(vertices.size());
+
+	for (uint32_t& index : indices) {
+		if (remap[index] == kUnused) {
+			remap[index] = static_cast<uint32_t>(result.size());
+			result.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+
+	vertices.swap(result);
+}
+
+void OptimizeMesh(
+	std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+	const MeshOptimizeOptions& options, MeshOptimizeStats* stats) {
+	if (stats != nullptr) {
+		stats->acmrBefore = ComputeAcmr(indices, vertices.size());
+	}
+
+	if (options.vertexCache) {
+		OptimizeVertexCache(indices, vertices.size());
+	}
+
+	if (options.overdraw) {
+		OptimizeOverdraw(indices, vertices, options.overdrawThreshold);
+	}
+
+	if (options.vertexFetch) {
+		OptimizeVertexFetch(vertices, indices);
+	}
+
+	if (stats != nullptr) {
+		stats->acmrAfter = ComputeAcmr(indices, vertices.size());
+	}
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "base/vertex.h"
+
+struct MeshOptimizeOptions {
+	// reorder triangles for the post-transform vertex cache (Forsyth)
+	bool vertexCache = true;
+
+	// after the cache pass, draw clusters of triangles that face outwards
+	// first so that they occlude the rest, costs some cache efficiency
+	bool overdraw = false;
+
+	// largest growth of the acmr the overdraw pass may cause, it is undone beyond that
+	float overdrawThreshold = 1.05f;
+
+	// renumber vertices in the order the index buffer first uses them
+	bool vertexFetch = true;
+
+	// levels of detail appended to the index buffer, the full mesh included; 1 disables them
+	int lodLevels = 5;
+};
+
+struct MeshOptimizeStats {
+	float acmrBefore = 0.0f;
+	float acmrAfter = 0.0f;
+};
+
+// options used when loading meshes from obj files
+void SetDefaultMeshOptimizeOptions(const MeshOptimizeOptions& options);
+const MeshOptimizeOptions& GetDefaultMeshOptimizeOptions();
+
+// average cache miss ratio, vertex shader runs per triangle with a fifo
+// post-transform cache; 0.5 is the best a regular grid can do, 3 the worst
+float ComputeAcmr(const std::vector<uint32_t>& indices, size_t vertexCount, int cacheSize = 16);
+
+void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount);
+
+// expects a cache optimized index buffer, keeps the order within clusters
+void OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, float threshold);
+
+// vertices no triangle uses are dropped
+void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+// run the passes the options enable, in the order cache, overdraw, fetch
+void OptimizeMesh(
+	std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+	const MeshOptimizeOptions& options, MeshOptimizeStats* stats = nullptr);
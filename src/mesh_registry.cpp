@@ -0,0 +1,74 @@
+#include <iostream>
+
+#include "mesh_registry.h"
+
+MeshRegistry& MeshRegistry::getInstance() {
+	static MeshRegistry registry;
+	return registry;
+}
+
+std::shared_ptr<const Mesh> MeshRegistry::acquire(const std::string& filepath) {
+	if (std::shared_ptr<const Mesh> mesh = find(filepath)) {
+		return mesh;
+	}
+
+	std::shared_ptr<const Mesh> mesh = std::make_shared<Mesh>(filepath);
+	add(filepath, mesh);
+	return mesh;
+}
+
+std::shared_ptr<const Mesh> MeshRegistry::acquire(const MeshData& data) {
+	if (std::shared_ptr<const Mesh> mesh = find(data.getPath())) {
+		return mesh;
+	}
+
+	std::shared_ptr<const Mesh> mesh = std::make_shared<Mesh>(data);
+	add(data.getPath(), mesh);
+	return mesh;
+}
+
+size_t MeshRegistry::getMeshCount() const {
+	size_t count = 0;
+	for (const auto& entry : _meshes) {
+		if (!entry.second.expired()) {
+			++count;
+		}
+	}
+	return count;
+}
+
+size_t MeshRegistry::getGpuBytes() const {
+	size_t bytes = 0;
+	for (const auto& entry : _meshes) {
+		if (std::shared_ptr<const Mesh> mesh = entry.second.lock()) {
+			bytes += mesh->getGpuBytes();
+		}
+	}
+	return bytes;
+}
+
+std::shared_ptr<const Mesh> MeshRegistry::find(const std::string& filepath) const {
+	auto it = _meshes.find(filepath);
+	if (it != _meshes.end()) {
+		return it->second.lock();
+	}
+	return nullptr;
+}
+
+void MeshRegistry::add(const std::string& filepath, const std::shared_ptr<const Mesh>& mesh) {
+	removeExpired();
+	_meshes[filepath] = mesh;
+
+	std::cout << "mesh registry: " << getMeshCount() << " meshes, "
+		<< getGpuBytes() / 1024 << " KB" << std::endl;
+}
+
+void MeshRegistry::removeExpired() {
+	for (auto it = _meshes.begin(); it != _meshes.end();) {
+		if (it->second.expired()) {
+			it = _meshes.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "mesh.h"
+
+// Hands out shared, immutable meshes keyed by asset path, so that an obj file
+// is parsed and uploaded once no matter how many models use it. The registry
+// only holds weak references; a mesh is released with its last user.
+class MeshRegistry {
+public:
+	static MeshRegistry& getInstance();
+
+	MeshRegistry(const MeshRegistry&) = delete;
+
+	std::shared_ptr<const Mesh> acquire(const std::string& filepath);
+
+	// upload prepared data, unless a mesh of the same file is already alive
+	std::shared_ptr<const Mesh> acquire(const MeshData& data);
+
+	// the mesh of a file if it is alive, null otherwise
+	std::shared_ptr<const Mesh> find(const std::string& filepath) const;
+
+	// number of meshes currently alive
+	size_t getMeshCount() const;
+
+	// gpu memory of all meshes currently alive
+	size_t getGpuBytes() const;
+
+private:
+	MeshRegistry() = default;
+
+	std::unordered_map<std::string, std::weak_ptr<const Mesh>> _meshes;
+
+	void add(const std::string& filepath, const std::shared_ptr<const Mesh>& mesh);
+
+	void removeExpired();
+};
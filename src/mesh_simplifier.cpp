@@ -0,0 +1,350 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+
+namespace {
+	constexpr uint32_t kNone = UINT32_MAX;
+
+	// border planes outweigh the triangle planes so that outlines stay in place
+	constexpr double kBorderWeight = 10.0;
+
+	constexpr int kMaxPasses = 64;
+
+	// a collapse may turn a triangle by at most about 75 degrees
+	constexpr double kMinNormalCosine = 0.25;
+
+	// levels stop below this many triangles, or when one removes less than a quarter
+	constexpr size_t kMinLodTriangles = 64;
+	constexpr double kMinLodReduction = 0.25;
+
+	// ceiling of a level's error relative to the bounding box diagonal
+	constexpr float kMaxLodError = 0.05f;
+
+	// sum of squared distances to a set of weighted planes
+	struct Quadric {
+		double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+		double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+		double c = 0.0;
+		double weight = 0.0;
+
+		// the plane n.p + d = 0 with a unit normal
+		void addPlane(const glm::dvec3& n, double d, double w) {
+			a00 += w * n.x * n.x; a01 += w * n.x * n.y; a02 += w * n.x * n.z;
+			a11 += w * n.y * n.y; a12 += w * n.y * n.z; a22 += w * n.z * n.z;
+			b0 += w * d * n.x; b1 += w * d * n.y; b2 += w * d * n.z;
+			c += w * d * d;
+			weight += w;
+		}
+
+		void add(const Quadric& q) {
+			a00 += q.a00; a01 += q.a01; a02 += q.a02;
+			a11 += q.a11; a12 += q.a12; a22 += q.a22;
+			b0 += q.b0; b1 += q.b1; b2 += q.b2;
+			c += q.c;
+			weight += q.weight;
+		}
+
+		// mean squared distance of a point to the planes
+		double evaluate(const glm::vec3& p) const {
+			const double x = p.x, y = p.y, z = p.z;
+			const double r =
+				a00 * x * x + a11 * y * y + a22 * z * z +
+				2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+				2.0 * (b0 * x + b1 * y + b2 * z) + c;
+			return weight > 0.0 ? std::max(r, 0.0) / weight : 0.0;
+		}
+	};
+
+	struct Collapse {
+		uint32_t from;
+		uint32_t to;
+		double cost;
+		bool border;
+	};
+
+	inline uint64_t getEdgeKey(uint32_t a, uint32_t b) {
+		return static_cast<uint64_t>(a) << 32 | b;
+	}
+
+	// the triangles around every position, rebuilt on each pass
+	struct Adjacency {
+		std::vector<uint32_t> offsets;
+		std::vector<uint32_t> triangles;
+
+		void build(const std::vector<uint32_t>& indices, const std::vector<uint32_t>& positions, size_t vertexCount) {
+			offsets.assign(vertexCount + 1, 0);
+			for (uint32_t index : indices) {
+				++offsets[positions[index] + 1];
+			}
+			std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+			triangles.resize(indices.size());
+			std::vector<uint32_t> cursors(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < indices.size(); ++i) {
+				triangles[cursors[positions[indices[i]]]++] = static_cast<uint32_t>(i / 3);
+			}
+		}
+	};
+}
+
+std::vector<uint32_t> SimplifyMesh(
+	const Vertex* vertices, size_t vertexCount,
+	const std::vector<uint32_t>& indices,
+	size_t targetIndexCount, float maxError, float* resultError) {
+	// vertices split along seams share a position, the collapses work on positions
+	std::vector<uint32_t> positions(vertexCount);
+	{
+		std::vector<uint32_t> order(vertexCount);
+		std::iota(order.begin(), order.end(), 0);
+		auto less = [vertices](uint32_t a, uint32_t b) {
+			const glm::vec3& p = vertices[a].position;
+			const glm::vec3& q = vertices[b].position;
+			return p.x < q.x || (p.x == q.x && (p.y < q.y || (p.y == q.y && p.z < q.z)));
+		};
+		std::sort(order.begin(), order.end(), less);
+		for (size_t i = 0; i < vertexCount; ++i) {
+			const bool same = i > 0 && vertices[order[i]].position == vertices[order[i - 1]].position;
+			positions[order[i]] = same ? positions[order[i - 1]] : order[i];
+		}
+	}
+
+	// the vertices at every position
+	std::vector<uint32_t> wedgeOffsets(vertexCount + 1, 0);
+	std::vector<uint32_t> wedges(vertexCount);
+	{
+		for (size_t v = 0; v < vertexCount; ++v) {
+			++wedgeOffsets[positions[v] + 1];
+		}
+		std::partial_sum(wedgeOffsets.begin(), wedgeOffsets.end(), wedgeOffsets.begin());
+		std::vector<uint32_t> cursors(wedgeOffsets.begin(), wedgeOffsets.end() - 1);
+		for (size_t v = 0; v < vertexCount; ++v) {
+			wedges[cursors[positions[v]]++] = static_cast<uint32_t>(v);
+		}
+	}
+
+	auto getPosition = [vertices](uint32_t v) { return glm::dvec3(vertices[v].position); };
+
+	// half edges between positions, sorted; an edge without its twin is a border
+	std::vector<uint64_t> halfEdges;
+	auto buildHalfEdges = [&](const std::vector<uint32_t>& triangles) {
+		halfEdges.clear();
+		for (size_t i = 0; i < triangles.size(); i += 3) {
+			for (int k = 0; k < 3; ++k) {
+				halfEdges.push_back(getEdgeKey(positions[triangles[i + k]], positions[triangles[i + (k + 1) % 3]]));
+			}
+		}
+		std::sort(halfEdges.begin(), halfEdges.end());
+	};
+	auto isBorderEdge = [&halfEdges](uint32_t a, uint32_t b) {
+		return !std::binary_search(halfEdges.begin(), halfEdges.end(), getEdgeKey(b, a));
+	};
+
+	// quadrics of the triangle planes, weighted by area, and of the border planes
+	std::vector<Quadric> quadrics(vertexCount);
+	std::vector<char> border(vertexCount, 0);
+	buildHalfEdges(indices);
+	for (size_t i = 0; i < indices.size(); i += 3) {
+		const uint32_t p[3] = { positions[indices[i]], positions[indices[i + 1]], positions[indices[i + 2]] };
+		const glm::dvec3 normal = glm::cross(getPosition(p[1]) - getPosition(p[0]), getPosition(p[2]) - getPosition(p[0]));
+		const double length = glm::length(normal);
+		if (length <= 0.0) {
+			continue;
+		}
+
+		const glm::dvec3 n = normal / length;
+		for (int k = 0; k < 3; ++k) {
+			quadrics[p[k]].addPlane(n, -glm::dot(n, getPosition(p[k])), length * 0.5);
+		}
+
+		for (int k = 0; k < 3; ++k) {
+			const uint32_t a = p[k], b = p[(k + 1) % 3];
+			if (a != b && isBorderEdge(a, b)) {
+				const glm::dvec3 edge = getPosition(b) - getPosition(a);
+				const glm::dvec3 m = glm::normalize(glm::cross(edge, n));
+				const double d = -glm::dot(m, getPosition(a));
+				quadrics[a].addPlane(m, d, glm::dot(edge, edge) * kBorderWeight);
+				quadrics[b].addPlane(m, d, glm::dot(edge, edge) * kBorderWeight);
+				border[a] = border[b] = 1;
+			}
+		}
+	}
+
+	std::vector<uint32_t> result = indices;
+	const double maxCost = static_cast<double>(maxError) * maxError;
+	double error = 0.0;
+
+	Adjacency adjacency;
+	std::vector<Collapse> candidates;
+	std::vector<uint32_t> collapses(vertexCount, kNone);
+	std::vector<char> locked(vertexCount, 0);
+	std::vector<uint32_t> remap(vertexCount, kNone);
+
+	for (int pass = 0; pass < kMaxPasses && result.size() > targetIndexCount; ++pass) {
+		adjacency.build(result, positions, vertexCount);
+		if (pass > 0) {
+			buildHalfEdges(result);
+		}
+
+		// every half edge proposes to collapse its start onto its end, a
+		// border edge the other way round as well, since it has no twin
+		candidates.clear();
+		auto propose = [&](uint32_t a, uint32_t b, bool borderEdge) {
+			if (border[a] && !(borderEdge && border[b])) {
+				return;
+			}
+			Quadric q = quadrics[a];
+			q.add(quadrics[b]);
+			candidates.push_back({ a, b, q.evaluate(vertices[b].position), borderEdge });
+		};
+		for (size_t i = 0; i < result.size(); i += 3) {
+			for (int k = 0; k < 3; ++k) {
+				const uint32_t a = positions[result[i + k]], b = positions[result[i + (k + 1) % 3]];
+				if (a == b) {
+					continue;
+				}
+				const bool borderEdge = isBorderEdge(a, b);
+				propose(a, b, borderEdge);
+				if (borderEdge) {
+					propose(b, a, true);
+				}
+			}
+		}
+
+		std::sort(candidates.begin(), candidates.end(), [](const Collapse& x, const Collapse& y) {
+			return x.cost < y.cost;
+		});
+
+		// take the cheapest collapses that do not touch each other, an inner
+		// collapse removes two triangles, one on a border only one
+		const size_t trianglesToRemove = (result.size() - targetIndexCount) / 3;
+		size_t removed = 0;
+		std::fill(locked.begin(), locked.end(), 0);
+		std::fill(collapses.begin(), collapses.end(), kNone);
+
+		for (const Collapse& collapse : candidates) {
+			if (collapse.cost > maxCost || removed >= trianglesToRemove) {
+				break;
+			}
+			const uint32_t a = collapse.from, b = collapse.to;
+			if (locked[a] || locked[b]) {
+				continue;
+			}
+
+			// the triangles that survive must not flip
+			bool flips = false;
+			for (uint32_t j = adjacency.offsets[a]; j < adjacency.offsets[a + 1] && !flips; ++j) {
+				const uint32_t* triangle = &result[3 * adjacency.triangles[j]];
+				glm::dvec3 before[3], after[3];
+				bool degenerate = false;
+				for (int k = 0; k < 3; ++k) {
+					const uint32_t p = positions[triangle[k]];
+					degenerate = degenerate || p == b;
+					before[k] = getPosition(p);
+					after[k] = p == a ? getPosition(b) : before[k];
+				}
+				if (!degenerate) {
+					const glm::dvec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+					const glm::dvec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+					flips = glm::dot(n0, n1) < kMinNormalCosine * glm::length(n0) * glm::length(n1);
+				}
+			}
+			if (flips) {
+				continue;
+			}
+
+			collapses[a] = b;
+			quadrics[b].add(quadrics[a]);
+			error = std::max(error, collapse.cost);
+			removed += collapse.border ? 1 : 2;
+
+			locked[b] = 1;
+			for (uint32_t j = adjacency.offsets[a]; j < adjacency.offsets[a + 1]; ++j) {
+				const uint32_t* triangle = &result[3 * adjacency.triangles[j]];
+				for (int k = 0; k < 3; ++k) {
+					locked[positions[triangle[k]]] = 1;
+				}
+			}
+		}
+
+		if (removed == 0) {
+			break;
+		}
+
+		// move the vertices of collapsed positions onto the split of the
+		// target with the closest normal and texcoord, drop the degenerate triangles
+		std::fill(remap.begin(), remap.end(), kNone);
+		auto getTarget = [&](uint32_t v) {
+			const uint32_t to = collapses[positions[v]];
+			if (to == kNone) {
+				return v;
+			}
+			if (remap[v] == kNone) {
+				float best = std::numeric_limits<float>::max();
+				for (uint32_t j = wedgeOffsets[to]; j < wedgeOffsets[to + 1]; ++j) {
+					const Vertex& w = vertices[wedges[j]];
+					const glm::vec3 dn = w.normal - vertices[v].normal;
+					const glm::vec2 dt = w.texCoord - vertices[v].texCoord;
+					const float distance = glm::dot(dn, dn) + glm::dot(dt, dt);
+					if (distance < best) {
+						best = distance;
+						remap[v] = wedges[j];
+					}
+				}
+			}
+			return remap[v];
+		};
+
+		size_t count = 0;
+		for (size_t i = 0; i < result.size(); i += 3) {
+			const uint32_t v0 = getTarget(result[i]), v1 = getTarget(result[i + 1]), v2 = getTarget(result[i + 2]);
+			const uint32_t p0 = positions[v0], p1 = positions[v1], p2 = positions[v2];
+			if (p0 != p1 && p1 != p2 && p2 != p0) {
+				result[count++] = v0;
+				result[count++] = v1;
+				result[count++] = v2;
+			}
+		}
+		result.resize(count);
+	}
+
+	if (resultError != nullptr) {
+		*resultError = static_cast<float>(std::sqrt(error));
+	}
+	return result;
+}
+
+std::vector<MeshLod> GenerateLods(
+	const Vertex* vertices, size_t vertexCount,
+	std::vector<uint32_t>& indices, int maxLevelCount) {
+	std::vector<MeshLod> lods = { { 0, static_cast<uint32_t>(indices.size()), 0.0f } };
+
+	glm::vec3 boxMin(std::numeric_limits<float>::max()), boxMax(-std::numeric_limits<float>::max());
+	for (size_t i = 0; i < vertexCount; ++i) {
+		boxMin = glm::min(boxMin, vertices[i].position);
+		boxMax = glm::max(boxMax, vertices[i].position);
+	}
+	const float maxError = vertexCount > 0 ? kMaxLodError * glm::length(boxMax - boxMin) : 0.0f;
+
+	std::vector<uint32_t> current(indices);
+	while (static_cast<int>(lods.size()) < maxLevelCount && current.size() / 3 >= 2 * kMinLodTriangles) {
+		float error = 0.0f;
+		std::vector<uint32_t> next = SimplifyMesh(
+			vertices, vertexCount, current, current.size() / 6 * 3, maxError, &error);
+		if (next.size() > current.size() * (1.0 - kMinLodReduction)) {
+			break;
+		}
+
+		// each level is measured against the one before, their errors add up
+		OptimizeVertexCache(next, vertexCount);
+		lods.push_back({ static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(next.size()),
+			lods.back().error + error });
+		indices.insert(indices.end(), next.begin(), next.end());
+		current.swap(next);
+	}
+
+	return lods;
+}
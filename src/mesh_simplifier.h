@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "base/vertex.h"
+
+// a level of detail, a range of the mesh's index buffer
+struct MeshLod {
+	uint32_t indexOffset;
+	uint32_t indexCount;
+
+	// largest distance, in object space, of the level from the full mesh
+	float error;
+};
+
+// Quadric error metric simplification that only rewrites indices: every edge
+// collapse moves a vertex onto one of its neighbours, so that all levels share
+// the vertex buffer of the full mesh. Vertices split along normal or texcoord
+// seams collapse together, each onto the neighbouring split with the closest
+// attributes; border edges are kept by heavily weighted border planes.
+// Returns the simplified indices and their error, stops at the target index
+// count or before a collapse would exceed maxError.
+std::vector<uint32_t> SimplifyMesh(
+	const Vertex* vertices, size_t vertexCount,
+	const std::vector<uint32_t>& indices,
+	size_t targetIndexCount, float maxError, float* resultError = nullptr);
+
+// append levels of half the triangles of the previous one to the indices until
+// maxLevelCount or until simplification stalls; the first level is the input
+std::vector<MeshLod> GenerateLods(
+	const Vertex* vertices, size_t vertexCount,
+	std::vector<uint32_t>& indices, int maxLevelCount);
@@ -1,275 +1,107 @@
-#include <iostream>
-#include <limits>
-#include <unordered_map>
 #include <algorithm>
 
-#include "obj_loader.h"
+#include "mesh_registry.h"
 #include "model.h"
 
-
-Model::Model(const std::string& filepath) {
-	attrib_t attrib;
-	index_t index;
-	std::string err;
-
-	//	std::string::size_type index = filepath.find_last_of("/");
-
-	if (!LoadObj(filepath, attrib, index)) {
-		throw std::runtime_error("load " + filepath + " failure: " + err);
-	}
-	if (!err.empty()) {
-		std::cerr << err << std::endl;
-	}
-
-	std::vector<Vertex> vertices;
-	std::vector<uint32_t> indices;
-	std::unordered_map<Vertex, uint32_t> uniqueVertices;
-
-	//positionIndex.size: Ȼλãһtex; i:ǰ
-	for (int i = 0; i < index.positionIndex.size(); i++) {
-		Vertex vertex1{}, vertex2{}, vertex3{};
-
-		vertex1.position = attrib.vertexPosition[index.positionIndex[i].x];
-		vertex2.position = attrib.vertexPosition[index.positionIndex[i].y];
-		vertex3.position = attrib.vertexPosition[index.positionIndex[i].z];
-		
-		vertex1.normal = attrib.vertexNormal[index.normalIndex[i].x];
-		vertex2.normal = attrib.vertexNormal[index.normalIndex[i].y];
-		vertex3.normal = attrib.vertexNormal[index.normalIndex[i].z];
-
-		vertex1.texCoord = attrib.vertexTexcoord[index.texcoordIndex[i].x];
-		vertex2.texCoord = attrib.vertexTexcoord[index.texcoordIndex[i].y];
-		vertex3.texCoord = attrib.vertexTexcoord[index.texcoordIndex[i].z];
-
-
-		// check if the vertex appeared before to reduce redundant data
-		if (uniqueVertices.count(vertex1) == 0) {
-			uniqueVertices[vertex1] = static_cast<uint32_t>(vertices.size());
-			vertices.push_back(vertex1);
-		}
-		indices.push_back(uniqueVertices[vertex1]);
-
-		if (uniqueVertices.count(vertex2) == 0) {
-			uniqueVertices[vertex2] = static_cast<uint32_t>(vertices.size());
-			vertices.push_back(vertex2);
-		}
-		indices.push_back(uniqueVertices[vertex2]);
-
-		if (uniqueVertices.count(vertex3) == 0) {
-			uniqueVertices[vertex3] = static_cast<uint32_t>(vertices.size());
-			vertices.push_back(vertex3);
-		}
-		indices.push_back(uniqueVertices[vertex3]);
-	}
-
-	_vertices = vertices;
-	_indices = indices;
-
-	computeBoundingBox();
-
-	initGLResources();
-
-	initBoxGLResources();
-
-	SaveObj(attrib, index);
-
-	GLenum error = glGetError();
-	if (error != GL_NO_ERROR) {
-		cleanup();
-		throw std::runtime_error("OpenGL Error: " + std::to_string(error));
-	}
-}
-
+Model::Model(const std::string& filepath)
+    : _mesh(MeshRegistry::getInstance().acquire(filepath)) { }
 
 Model::Model(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
-    : _vertices(vertices), _indices(indices) {
-
-    computeBoundingBox();
-
-    initGLResources();
-
-    initBoxGLResources();
-
-    GLenum error = glGetError();
-    if (error != GL_NO_ERROR) {
-        cleanup();
-        throw std::runtime_error("OpenGL Error: " + std::to_string(error));
-    }
-}
-
-Model::Model(Model&& rhs) noexcept
-    : _vertices(std::move(rhs._vertices)),
-      _indices(std::move(rhs._indices)),
-      _boundingBox(std::move(rhs._boundingBox)),
-      _vao(rhs._vao), _vbo(rhs._vbo), _ebo(rhs._ebo), 
-      _boxVao(rhs._boxVao), _boxVbo(rhs._boxVbo), _boxEbo(rhs._boxEbo) {
-    _vao = 0;
-    _vbo = 0;
-    _ebo = 0;
-    _boxVao = 0;
-    _boxVbo = 0;
-    _boxEbo = 0;
-}
-
-Model::~Model() {
-    cleanup();
-}
-
-BoundingBox Model::getBoundingBox() const {
-    return _boundingBox;
-}
-
-void Model::draw() const {
-    glBindVertexArray(_vao);
-    glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(_indices.size()), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
-}
+    : _mesh(std::make_shared<Mesh>(vertices, indices)) { }
 
-void Model::drawBoundingBox() const {
-    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-    glBindVertexArray(_boxVao);
-    glDrawElements(GL_LINES, 24, GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-}
+Model::Model(std::shared_ptr<const Mesh> mesh)
+    : _mesh(std::move(mesh)) { }
 
 GLuint Model::getVao() const {
-    return _vao;
+    return _mesh != nullptr ? _mesh->getVao() : 0;
 }
 
 GLuint Model::getBoundingBoxVao() const {
-    return _boxVao;
+    return _mesh != nullptr ? _mesh->getBoundingBoxVao() : 0;
 }
 
 size_t Model::getVertexCount() const {
-    return _vertices.size();
+    return _mesh != nullptr ? _mesh->getVertexCount() : 0;
 }
 
 size_t Model::getFaceCount() const {
-    return _indices.size() / 3;
+    return _mesh != nullptr ? _mesh->getFaceCount() : 0;
 }
 
-void Model::initGLResources() {
-    // create a vertex array object
-    glGenVertexArrays(1, &_vao);
-    // create a vertex buffer object
-    glGenBuffers(1, &_vbo);
-    // create a element array buffer
-    glGenBuffers(1, &_ebo);
-
-    glBindVertexArray(_vao);
-    glBindBuffer(GL_ARRAY_BUFFER, _vbo);
-    glBufferData(GL_ARRAY_BUFFER, 
-        sizeof(Vertex) * _vertices.size(), _vertices.data(), GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, 
-        _indices.size() * sizeof(uint32_t), _indices.data(), GL_STATIC_DRAW);
-
-    // specify layout, size of a vertex, data type, normalize, sizeof vertex array, offset of the attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoord));
-    glEnableVertexAttribArray(2);
+size_t Model::getLodFaceCount() const {
+    return _mesh != nullptr ? _mesh->getLod(_lod).indexCount / 3 : 0;
+}
 
-    glBindVertexArray(0);
+int Model::getLod() const {
+    return _lod;
 }
 
-void Model::computeBoundingBox() {
-    float minX = std::numeric_limits<float>::max();
-    float minY = std::numeric_limits<float>::max();
-    float minZ = std::numeric_limits<float>::max();
-    float maxX = -std::numeric_limits<float>::max();
-    float maxY = -std::numeric_limits<float>::max();
-    float maxZ = -std::numeric_limits<float>::max();
+void Model::updateLod(const glm::mat4& view, const glm::mat4& projection, int viewportHeight, float pixelError) {
+    // coarser levels must be this much below the threshold before they are picked
+    constexpr float hysteresis = 0.75f;
 
-    for (const auto& v : _vertices) {
-        minX = std::min(v.position.x, minX);
-        minY = std::min(v.position.y, minY);
-        minZ = std::min(v.position.z, minZ);
-        maxX = std::max(v.position.x, maxX);
-        maxY = std::max(v.position.y, maxY);
-        maxZ = std::max(v.position.z, maxZ);
+    if (_mesh == nullptr || _mesh->getLodCount() == 1) {
+        _lod = 0;
+        return;
     }
 
-    _boundingBox.min = glm::vec3(minX, minY, minZ);
-    _boundingBox.max = glm::vec3(maxX, maxY, maxZ);
+    // pixels per object space unit at the distance of the bounding box center,
+    // w is the view depth for a perspective projection and 1 for an orthographic one
+    const BoundingBox box = _mesh->getBoundingBox();
+    const glm::vec3 center = glm::vec3(getModelMatrix() * glm::vec4((box.min + box.max) * 0.5f, 1.0f));
+    const float w = (projection * view * glm::vec4(center, 1.0f)).w;
+    if (w <= 0.0f) {
+        _lod = 0;
+        return;
+    }
+    const glm::vec3 s = glm::abs(scale);
+    const float pixelsPerUnit = std::max(s.x, std::max(s.y, s.z)) * projection[1][1] / w * viewportHeight * 0.5f;
+
+    int lod = 0;
+    for (int i = _mesh->getLodCount() - 1; i > 0; --i) {
+        const float threshold = i > _lod ? pixelError * hysteresis : pixelError;
+        if (_mesh->getLod(i).error * pixelsPerUnit <= threshold) {
+            lod = i;
+            break;
+        }
+    }
+    _lod = lod;
 }
 
-void Model::initBoxGLResources() {
-    std::vector<glm::vec3> boxVertices = {
-        glm::vec3(_boundingBox.min.x, _boundingBox.min.y, _boundingBox.min.z),
-        glm::vec3(_boundingBox.max.x, _boundingBox.min.y, _boundingBox.min.z),
-        glm::vec3(_boundingBox.min.x, _boundingBox.max.y, _boundingBox.min.z),
-        glm::vec3(_boundingBox.max.x, _boundingBox.max.y, _boundingBox.min.z),
-        glm::vec3(_boundingBox.min.x, _boundingBox.min.y, _boundingBox.max.z),
-        glm::vec3(_boundingBox.max.x, _boundingBox.min.y, _boundingBox.max.z),
-        glm::vec3(_boundingBox.min.x, _boundingBox.max.y, _boundingBox.max.z),
-        glm::vec3(_boundingBox.max.x, _boundingBox.max.y, _boundingBox.max.z),
-    };
-
-    std::vector<uint32_t> boxIndices = {
-        0, 1,
-        0, 2,
-        0, 4,
-        3, 1,
-        3, 2,
-        3, 7,
-        5, 4,
-        5, 1,
-        5, 7,
-        6, 4,
-        6, 7,
-        6, 2
-    };
-
-    glGenVertexArrays(1, &_boxVao);
-    glGenBuffers(1, &_boxVbo);
-    glGenBuffers(1, &_boxEbo);
-
-    glBindVertexArray(_boxVao);
-    glBindBuffer(GL_ARRAY_BUFFER, _boxVbo);
-    glBufferData(GL_ARRAY_BUFFER, boxVertices.size() * sizeof(glm::vec3), boxVertices.data(), GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _boxEbo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, boxIndices.size() * sizeof(uint32_t), boxIndices.data(), GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
-    glEnableVertexAttribArray(0);
-
-    glBindVertexArray(0);
+BoundingBox Model::getBoundingBox() const {
+    return _mesh != nullptr ? _mesh->getBoundingBox() : BoundingBox{ glm::vec3(0.0f), glm::vec3(0.0f) };
 }
 
-void Model::cleanup() {
-    if (_boxEbo) {
-        glDeleteBuffers(1, &_boxEbo);
-        _boxEbo = 0;
-    }
+const std::shared_ptr<const Mesh>& Model::getMesh() const {
+    return _mesh;
+}
 
-    if (_boxVbo) {
-        glDeleteBuffers(1, &_boxVbo);
-        _boxVbo = 0;
-    }
+void Model::setMesh(std::shared_ptr<const Mesh> mesh) {
+    _mesh = std::move(mesh);
+    _lod = 0;
+}
 
-    if (_boxVao) {
-        glDeleteVertexArrays(1, &_boxVao);
-        _boxVao = 0;
-    }
+bool Model::hasMesh() const {
+    return _mesh != nullptr;
+}
 
-    if (_ebo != 0) {
-        glDeleteBuffers(1, &_ebo);
-        _ebo = 0;
+void Model::downloadGeometry(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) const {
+    if (_mesh == nullptr) {
+        vertices.clear();
+        indices.clear();
+        return;
     }
+    _mesh->downloadGeometry(vertices, indices);
+}
 
-    if (_vbo != 0) {
-        glDeleteBuffers(1, &_vbo);
-        _vbo = 0;
+void Model::draw() const {
+    if (_mesh != nullptr) {
+        _mesh->draw(_lod);
     }
+}
 
-    if (_vao != 0) {
-        glDeleteVertexArrays(1, &_vao);
-        _vao = 0;
+void Model::drawBoundingBox() const {
+    if (_mesh != nullptr) {
+        _mesh->drawBoundingBox();
     }
 }
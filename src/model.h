@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -8,16 +9,26 @@
 #include "./base/vertex.h"
 #include "./base/object3d.h"
 #include "./base/bounding_box.h"
+#include "./base/material.h"
+#include "mesh.h"
 
+// An instance of a shared mesh: its own transform and material binding,
+// the geometry is owned by the mesh. A model without a mesh yet, e.g. while
+// the mesh streams in, draws nothing and has an empty bounding box.
 class Model : public Object3D {
 public:
+    Model() = default;
+
+    // the mesh is shared with every other model loaded from the same file
     Model(const std::string& filepath);
 
     Model(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
 
-    Model(Model&& rhs) noexcept;
+    Model(std::shared_ptr<const Mesh> mesh);
+
+    Model(Model&& rhs) noexcept = default;
 
-    virtual ~Model();
+    virtual ~Model() = default;
 
     GLuint getVao() const;
 
@@ -27,34 +38,37 @@ public:
 
     size_t getFaceCount() const;
 
-    BoundingBox getBoundingBox() const;
+    // faces of the level of detail that draw() uses
+    size_t getLodFaceCount() const;
 
-    virtual void draw() const;
+    int getLod() const;
 
-    virtual void drawBoundingBox() const;
+    // Pick the coarsest level whose error projects to at most pixelError
+    // pixels on a viewport of the given height. A model only goes coarser
+    // once the error is well below the threshold, so that it does not
+    // flicker between two levels at the boundary.
+    void updateLod(const glm::mat4& view, const glm::mat4& projection, int viewportHeight, float pixelError = 1.0f);
 
-protected:
-    // vertices of the table represented in model's own coordinate
-    std::vector<Vertex> _vertices;
-    std::vector<uint32_t> _indices;
+    BoundingBox getBoundingBox() const;
 
-    // bounding box
-    BoundingBox _boundingBox;
+    const std::shared_ptr<const Mesh>& getMesh() const;
 
-    // opengl objects
-    GLuint _vao = 0;
-    GLuint _vbo = 0;
-    GLuint _ebo = 0;
+    void setMesh(std::shared_ptr<const Mesh> mesh);
 
-    GLuint _boxVao = 0;
-    GLuint _boxVbo = 0;
-    GLuint _boxEbo = 0;
+    bool hasMesh() const;
 
-    void computeBoundingBox();
+    // read the vertex and index buffers back from the gpu, e.g. for exporting
+    void downloadGeometry(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) const;
 
-    void initGLResources();
+    virtual void draw() const;
+
+    virtual void drawBoundingBox() const;
 
-    void initBoxGLResources();
+public:
+    std::shared_ptr<PhongMaterial> material;
+
+protected:
+    std::shared_ptr<const Mesh> _mesh;
 
-    void cleanup();
-};
\ No newline at end of file
+    int _lod = 0;
+};
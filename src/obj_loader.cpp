@@ -1,9 +1,306 @@
 #include <fstream>
 #include <sstream>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <charconv>
+#include <filesystem>
 
 #include "obj_loader.h"
+#include "./base/mapped_file.h"
+#include "./base/thread_pool.h"
 
-bool LoadObj(const std::string& _filepath, attrib_t& _attrib, index_t& _index){
+namespace {
+	// exact powers of ten for the float fast path (10^10 still fits the 24 bit mantissa)
+	const float kPow10[] = {
+		1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+	};
+
+	inline bool isBlank(char c) {
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	inline bool isDigit(char c) {
+		return static_cast<unsigned>(c - '0') < 10u;
+	}
+
+	inline const char* skipBlanks(const char* p, const char* end) {
+		while (p < end && isBlank(*p)) {
+			++p;
+		}
+		return p;
+	}
+
+	inline const char* findLineEnd(const char* p, const char* end) {
+		const void* eol = std::memchr(p, '\n', static_cast<size_t>(end - p));
+		return eol != nullptr ? static_cast<const char*>(eol) : end;
+	}
+
+	// parse a (possibly signed) decimal integer, nullptr on failure
+	const char* parseInt(const char* p, const char* end, int& value) {
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+')) {
+			negative = *p == '-';
+			++p;
+		}
+
+		if (p >= end || !isDigit(*p)) {
+			return nullptr;
+		}
+
+		int result = 0;
+		while (p < end && isDigit(*p)) {
+			result = result * 10 + (*p - '0');
+			++p;
+		}
+
+		value = negative ? -result : result;
+		return p;
+	}
+
+	// parse a decimal float, nullptr on failure. Short mantissas take an exact
+	// fast path, anything else goes through strtof so the result is always the
+	// correctly rounded value the stream parser would produce
+	const char* parseFloat(const char* p, const char* end, float& value) {
+		const char* start = p;
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+')) {
+			negative = *p == '-';
+			++p;
+		}
+
+		uint64_t mantissa = 0;
+		int digits = 0;
+		int exponent = 0;
+		bool anyDigit = false;
+
+		while (p < end && isDigit(*p)) {
+			if (digits < 19) {
+				mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+				if (mantissa != 0) ++digits;
+			} else {
+				++exponent;
+			}
+			anyDigit = true;
+			++p;
+		}
+
+		if (p < end && *p == '.') {
+			++p;
+			while (p < end && isDigit(*p)) {
+				if (digits < 19) {
+					mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+					if (mantissa != 0) ++digits;
+					--exponent;
+				}
+				anyDigit = true;
+				++p;
+			}
+		}
+
+		if (!anyDigit) {
+			return nullptr;
+		}
+
+		if (p < end && (*p == 'e' || *p == 'E')) {
+			int e = 0;
+			const char* q = parseInt(p + 1, end, e);
+			if (q != nullptr) {
+				exponent += e;
+				p = q;
+			}
+		}
+
+		if (digits < 19 && mantissa <= (1u << 24) && exponent >= -10 && exponent <= 10) {
+			float f = static_cast<float>(mantissa);
+			f = exponent < 0 ? f / kPow10[-exponent] : f * kPow10[exponent];
+			value = negative ? -f : f;
+			return p;
+		}
+
+		// slow path: the token is copied to the stack to null terminate it
+		char buffer[64];
+		const size_t length = static_cast<size_t>(p - start);
+		if (length < sizeof(buffer)) {
+			std::memcpy(buffer, start, length);
+			buffer[length] = '\0';
+			value = std::strtof(buffer, nullptr);
+		} else {
+			value = std::strtof(std::string(start, p).c_str(), nullptr);
+		}
+
+		return p;
+	}
+
+	// resolve a 1-based (or negative, relative) obj index to a 0-based one
+	inline int resolveIndex(int index, size_t count) {
+		return index > 0 ? index - 1 : static_cast<int>(count) + index;
+	}
+
+	// parse "v/vt/vn" of a face corner
+	const char* parseCorner(const char* p, const char* end, int& v, int& vt, int& vn) {
+		p = parseInt(skipBlanks(p, end), end, v);
+		if (p == nullptr || p >= end || *p != '/') return nullptr;
+		p = parseInt(p + 1, end, vt);
+		if (p == nullptr || p >= end || *p != '/') return nullptr;
+		return parseInt(p + 1, end, vn);
+	}
+
+	// cheap first pass counting records so the output can be reserved once
+	void countRecords(const char* p, const char* end,
+		size_t& positions, size_t& texcoords, size_t& normals, size_t& faces) {
+		positions = texcoords = normals = faces = 0;
+		while (p < end) {
+			const char* eol = findLineEnd(p, end);
+			p = skipBlanks(p, eol);
+			if (eol - p >= 2) {
+				if (p[0] == 'v') {
+					if (isBlank(p[1]))     ++positions;
+					else if (p[1] == 't')  ++texcoords;
+					else if (p[1] == 'n')  ++normals;
+				} else if (p[0] == 'f' && isBlank(p[1])) {
+					++faces;
+				}
+			}
+			p = eol + 1;
+		}
+	}
+
+	// records of one newline aligned slice of the file. Relative (negative)
+	// face indices can only be resolved against the chunk's own counts, so the
+	// slots holding them are remembered and rebased during the merge
+	struct ObjChunk {
+		const char* begin = nullptr;
+		const char* end = nullptr;
+		attrib_t attrib;
+		index_t index;
+		std::vector<size_t> relativePositions;
+		std::vector<size_t> relativeTexcoords;
+		std::vector<size_t> relativeNormals;
+	};
+
+	inline int resolveCorner(int index, size_t count, size_t slot, std::vector<size_t>& relative) {
+		if (index < 0) {
+			relative.push_back(slot);
+		}
+		return resolveIndex(index, count);
+	}
+
+	void parseChunk(ObjChunk& chunk) {
+		attrib_t& attrib = chunk.attrib;
+		index_t& index = chunk.index;
+
+		size_t positions, texcoords, normals, faces;
+		countRecords(chunk.begin, chunk.end, positions, texcoords, normals, faces);
+		attrib.vertexPosition.reserve(positions);
+		attrib.vertexTexcoord.reserve(texcoords);
+		attrib.vertexNormal.reserve(normals);
+		index.positionIndex.reserve(faces);
+		index.texcoordIndex.reserve(faces);
+		index.normalIndex.reserve(faces);
+
+		const char* p = chunk.begin;
+		const char* end = chunk.end;
+		while (p < end) {
+			const char* eol = findLineEnd(p, end);
+			p = skipBlanks(p, eol);
+
+			if (eol - p >= 2 && p[0] == 'v' && isBlank(p[1])) {
+				float x = 0.0f, y = 0.0f, z = 0.0f;
+				const char* q = parseFloat(skipBlanks(p + 2, eol), eol, x);
+				if (q) q = parseFloat(skipBlanks(q, eol), eol, y);
+				if (q) q = parseFloat(skipBlanks(q, eol), eol, z);
+				attrib.vertexPosition.push_back(glm::vec3(x, y, z));
+			} else if (eol - p >= 3 && p[0] == 'v' && p[1] == 't' && isBlank(p[2])) {
+				float x = 0.0f, y = 0.0f;
+				const char* q = parseFloat(skipBlanks(p + 3, eol), eol, x);
+				if (q) q = parseFloat(skipBlanks(q, eol), eol, y);
+				attrib.vertexTexcoord.push_back(glm::vec2(x, y));
+			} else if (eol - p >= 3 && p[0] == 'v' && p[1] == 'n' && isBlank(p[2])) {
+				float x = 0.0f, y = 0.0f, z = 0.0f;
+				const char* q = parseFloat(skipBlanks(p + 3, eol), eol, x);
+				if (q) q = parseFloat(skipBlanks(q, eol), eol, y);
+				if (q) q = parseFloat(skipBlanks(q, eol), eol, z);
+				attrib.vertexNormal.push_back(glm::vec3(x, y, z));
+			} else if (eol - p >= 2 && p[0] == 'f' && isBlank(p[1])) {
+				int v[3], vt[3], vn[3];
+				const char* q = p + 2;
+				for (int k = 0; k < 3 && q != nullptr; ++k) {
+					q = parseCorner(q, eol, v[k], vt[k], vn[k]);
+				}
+
+				// only triangles in v/vt/vn form are supported, like the stream parser
+				if (q != nullptr) {
+					const size_t nv = attrib.vertexPosition.size();
+					const size_t nt = attrib.vertexTexcoord.size();
+					const size_t nn = attrib.vertexNormal.size();
+					const size_t slot = index.positionIndex.size() * 3;
+					glm::ivec3 pi, ti, ni;
+					for (int k = 0; k < 3; ++k) {
+						pi[k] = resolveCorner(v[k], nv, slot + k, chunk.relativePositions);
+						ti[k] = resolveCorner(vt[k], nt, slot + k, chunk.relativeTexcoords);
+						ni[k] = resolveCorner(vn[k], nn, slot + k, chunk.relativeNormals);
+					}
+					index.positionIndex.push_back(pi);
+					index.texcoordIndex.push_back(ti);
+					index.normalIndex.push_back(ni);
+				}
+			}
+
+			p = eol + 1;
+		}
+	}
+
+	template <typename T>
+	void copyRange(const std::vector<T>& src, std::vector<T>& dst, size_t offset) {
+		if (!src.empty()) {
+			std::memcpy(dst.data() + offset, src.data(), src.size() * sizeof(T));
+		}
+	}
+
+	void rebase(std::vector<glm::ivec3>& dst, size_t offset,
+		const std::vector<size_t>& slots, size_t base) {
+		// files without faces leave dst empty
+		if (slots.empty()) {
+			return;
+		}
+		int* corners = &dst.data()->x + offset * 3;
+		for (size_t slot : slots) {
+			corners[slot] += static_cast<int>(base);
+		}
+	}
+
+	// running totals of the records in front of a chunk
+	struct ObjCounts {
+		size_t positions = 0;
+		size_t texcoords = 0;
+		size_t normals = 0;
+		size_t faces = 0;
+	};
+
+	// place a parsed chunk at its prefix-summed offsets in the global arrays
+	void mergeChunk(const ObjChunk& chunk, const ObjCounts& base, attrib_t& attrib, index_t& index) {
+		copyRange(chunk.attrib.vertexPosition, attrib.vertexPosition, base.positions);
+		copyRange(chunk.attrib.vertexTexcoord, attrib.vertexTexcoord, base.texcoords);
+		copyRange(chunk.attrib.vertexNormal, attrib.vertexNormal, base.normals);
+		copyRange(chunk.index.positionIndex, index.positionIndex, base.faces);
+		copyRange(chunk.index.texcoordIndex, index.texcoordIndex, base.faces);
+		copyRange(chunk.index.normalIndex, index.normalIndex, base.faces);
+
+		rebase(index.positionIndex, base.faces, chunk.relativePositions, base.positions);
+		rebase(index.texcoordIndex, base.faces, chunk.relativeTexcoords, base.texcoords);
+		rebase(index.normalIndex, base.faces, chunk.relativeNormals, base.normals);
+	}
+
+	// the smallest slice worth handing to a separate thread
+	constexpr size_t kMinChunkBytes = 256 * 1024;
+}
+
+static bool LoadObjStream(const std::string& _filepath, attrib_t& _attrib, index_t& _index){
 
 	// ļ
 	std::ifstream fin(_filepath);
@@ -85,33 +382,222 @@ bool LoadObj(const std::string& _filepath, attrib_t& _attrib, index_t& _index){
 }
 
 
-void SaveObj(attrib_t& _attrib, index_t& _index){
+static bool LoadObjMapped(const std::string& _filepath, attrib_t& _attrib, index_t& _index,
+	int _numThreads, size_t& _bytes, int& _threadsUsed){
+	try {
+		MappedFile file(_filepath);
+		const char* begin = file.getData();
+		const char* end = begin + file.getSize();
+		_bytes = file.getSize();
 
-//	const std::string modelSavingPath="./userdata/";
-	const std::string _path = "./userdata/writeuser.obj";
-	std::ofstream fout(_path);
+		// split the file at newline boundaries, one chunk per thread
+		size_t numChunks = _numThreads > 0 ? _numThreads : std::max(1u, std::thread::hardware_concurrency());
+		numChunks = std::max<size_t>(1, std::min(numChunks, _bytes / kMinChunkBytes));
 
-
-	if (fout.is_open()){
-		for (int i = 0; i < _attrib.vertexPosition.size(); i++) {
-			fout << "v " << _attrib.vertexPosition[i].x << " " << _attrib.vertexPosition[i].y << " " << _attrib.vertexPosition[i].z << std::endl;
+		std::vector<ObjChunk> chunks(numChunks);
+		const char* p = begin;
+		for (size_t i = 0; i < numChunks; ++i) {
+			const char* q = i + 1 == numChunks ? end : begin + _bytes / numChunks * (i + 1);
+			if (q < p) {
+				q = p;
+			}
+			if (q < end) {
+				q = findLineEnd(q, end);
+				q = q < end ? q + 1 : end;
+			}
+			chunks[i].begin = p;
+			chunks[i].end = q;
+			p = q;
 		}
-		for (int i = 0; i < _attrib.vertexTexcoord.size(); i++) {
-			fout << "vt " << _attrib.vertexTexcoord[i].x << " " << _attrib.vertexTexcoord[i].y << std::endl;
+		_threadsUsed = static_cast<int>(numChunks);
+
+		// on the asset loader's pool when the parse runs in one of its tasks
+		auto runParallel = [&chunks](const std::function<void(size_t)>& job) {
+			ParallelFor(chunks.size(), static_cast<int>(chunks.size()), job);
+		};
+
+		runParallel([&chunks](size_t i) { parseChunk(chunks[i]); });
+
+		// exclusive prefix sum of the per chunk record counts
+		std::vector<ObjCounts> offsets(numChunks + 1);
+		for (size_t i = 0; i < numChunks; ++i) {
+			offsets[i + 1].positions = offsets[i].positions + chunks[i].attrib.vertexPosition.size();
+			offsets[i + 1].texcoords = offsets[i].texcoords + chunks[i].attrib.vertexTexcoord.size();
+			offsets[i + 1].normals = offsets[i].normals + chunks[i].attrib.vertexNormal.size();
+			offsets[i + 1].faces = offsets[i].faces + chunks[i].index.positionIndex.size();
 		}
-		for (int i = 0; i < _attrib.vertexNormal.size(); i++) {
-			fout << "vn " << _attrib.vertexNormal[i].x << " " << _attrib.vertexNormal[i].y << " " << _attrib.vertexNormal[i].z << std::endl;
+
+		// indices in the file are relative to the file, not to what the caller
+		// may already hold, so the output is replaced rather than appended to
+		if (numChunks == 1) {
+			// nothing to merge, hand the buffers over instead of copying
+			_attrib = std::move(chunks[0].attrib);
+			_index = std::move(chunks[0].index);
 		}
+		else {
+			const ObjCounts& total = offsets[numChunks];
+			_attrib.vertexPosition.resize(total.positions);
+			_attrib.vertexTexcoord.resize(total.texcoords);
+			_attrib.vertexNormal.resize(total.normals);
+			_index.positionIndex.resize(total.faces);
+			_index.texcoordIndex.resize(total.faces);
+			_index.normalIndex.resize(total.faces);
 
-		for (int i = 0; i < _index.positionIndex.size(); i++){
-			fout << "f " << _index.positionIndex[i].x + 1 << "/" << _index.texcoordIndex[i].x + 1 << "/" << _index.normalIndex[i].x + 1 << " ";
-			fout << _index.positionIndex[i].y + 1 << "/" << _index.texcoordIndex[i].y + 1 << "/" << _index.normalIndex[i].y + 1 << " ";
-			fout << _index.positionIndex[i].z + 1 << "/" << _index.texcoordIndex[i].z + 1 << "/" << _index.normalIndex[i].z + 1 << std::endl;
+			runParallel([&](size_t i) { mergeChunk(chunks[i], offsets[i], _attrib, _index); });
 		}
-		fout.close();
+	}
+	catch (const std::exception& e) {
+		std::cout << "file:" << _filepath << "read error: " << e.what() << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+static ObjLoadOptions defaultObjLoadOptions;
+
+void SetDefaultObjLoadOptions(const ObjLoadOptions& _options){
+	defaultObjLoadOptions = _options;
+}
+
+const ObjLoadOptions& GetDefaultObjLoadOptions(){
+	return defaultObjLoadOptions;
+}
+
+bool LoadObj(const std::string& _filepath, attrib_t& _attrib, index_t& _index){
+	return LoadObj(_filepath, _attrib, _index, defaultObjLoadOptions);
+}
+
+bool LoadObj(const std::string& _filepath, attrib_t& _attrib, index_t& _index,
+	const ObjLoadOptions& _options, ObjLoadStats* _stats){
+	auto start = std::chrono::high_resolution_clock::now();
+
+	size_t bytes = 0;
+	int threads = 1;
+	bool success = false;
+	if (_options.memoryMapped) {
+		success = LoadObjMapped(_filepath, _attrib, _index, _options.numThreads, bytes, threads);
 	}
 	else {
+		success = LoadObjStream(_filepath, _attrib, _index);
+		std::ifstream fin(_filepath, std::ios::binary | std::ios::ate);
+		bytes = fin.is_open() ? static_cast<size_t>(fin.tellg()) : 0;
+	}
+
+	if (_stats != nullptr) {
+		auto now = std::chrono::high_resolution_clock::now();
+		_stats->bytes = bytes;
+		_stats->seconds = std::chrono::duration<double>(now - start).count();
+		_stats->threads = threads;
+	}
+
+	return success;
+}
+
+
+namespace {
+	// formats obj records with to_chars into a large buffer that is written
+	// out in big blocks instead of flushing every line
+	class ObjWriter {
+	public:
+		ObjWriter(std::ofstream& fout) : _fout(fout), _buffer(kBufferSize) { }
+
+		~ObjWriter() {
+			flush();
+		}
+
+		void record(const char* type, const float* values, int count) {
+			reserve(kMaxRecordSize);
+			put(type);
+			for (int i = 0; i < count; ++i) {
+				_buffer[_used++] = ' ';
+				_used = std::to_chars(&_buffer[_used], &_buffer[0] + _buffer.size(), values[i]).ptr - &_buffer[0];
+			}
+			_buffer[_used++] = '\n';
+		}
+
+		void face(const glm::ivec3& v, const glm::ivec3& vt, const glm::ivec3& vn) {
+			reserve(kMaxRecordSize);
+			put("f");
+			for (int k = 0; k < 3; ++k) {
+				_buffer[_used++] = ' ';
+				putInt(v[k] + 1);
+				_buffer[_used++] = '/';
+				putInt(vt[k] + 1);
+				_buffer[_used++] = '/';
+				putInt(vn[k] + 1);
+			}
+			_buffer[_used++] = '\n';
+		}
+
+		void flush() {
+			_fout.write(_buffer.data(), _used);
+			_used = 0;
+		}
+
+	private:
+		static constexpr size_t kBufferSize = 1 << 20;
+		static constexpr size_t kMaxRecordSize = 256;
+
+		std::ofstream& _fout;
+		std::vector<char> _buffer;
+		size_t _used = 0;
+
+		void reserve(size_t size) {
+			if (_used + size > _buffer.size()) {
+				flush();
+			}
+		}
+
+		void put(const char* str) {
+			while (*str) {
+				_buffer[_used++] = *str++;
+			}
+		}
+
+		void putInt(int value) {
+			_used = std::to_chars(&_buffer[_used], &_buffer[0] + _buffer.size(), value).ptr - &_buffer[0];
+		}
+	};
+}
+
+bool SaveObj(const std::string& _path, const attrib_t& _attrib, const index_t& _index){
+	std::error_code ec;
+	const std::filesystem::path parent = std::filesystem::path(_path).parent_path();
+	if (!parent.empty()) {
+		std::filesystem::create_directories(parent, ec);
+	}
+
+	std::ofstream fout(_path, std::ios::binary);
+	if (!fout.is_open()){
+		std::cout << "file:" << _path << "write error" << std::endl;
+		return false;
+	}
+
+	{
+		ObjWriter writer(fout);
+		for (const auto& v : _attrib.vertexPosition) {
+			writer.record("v", &v[0], 3);
+		}
+		for (const auto& vt : _attrib.vertexTexcoord) {
+			writer.record("vt", &vt[0], 2);
+		}
+		for (const auto& vn : _attrib.vertexNormal) {
+			writer.record("vn", &vn[0], 3);
+		}
+		for (size_t i = 0; i < _index.positionIndex.size(); i++) {
+			writer.face(_index.positionIndex[i], _index.texcoordIndex[i], _index.normalIndex[i]);
+		}
+	}
+
+	if (!fout) {
 		std::cout << "file:" << _path << "write error" << std::endl;
+		return false;
 	}
+
+	return true;
 }
 
+void SaveObj(attrib_t& _attrib, index_t& _index){
+	SaveObj("./userdata/writeuser.obj", _attrib, _index);
+}
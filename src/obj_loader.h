@@ -17,5 +17,37 @@ typedef struct{
 	std::vector<glm::ivec3> normalIndex;
 } index_t;
 
+struct ObjLoadOptions {
+	// scan a memory mapped file with the zero-copy tokenizer,
+	// otherwise fall back to the line by line stream parser
+	bool memoryMapped = true;
+
+	// threads used by the memory mapped parser, 0 means one per core.
+	// small files are never split below a few hundred KB per thread. When
+	// called from a task of a thread pool the chunks go to its idle workers
+	int numThreads = 0;
+};
+
+struct ObjLoadStats {
+	size_t bytes = 0;
+	double seconds = 0.0;
+	int threads = 1;
+
+	// parsing throughput in MB/s
+	double getThroughput() const {
+		return seconds > 0.0 ? bytes / (1024.0 * 1024.0) / seconds : 0.0;
+	}
+};
+
+// options used by LoadObj when the caller does not pass its own
+void SetDefaultObjLoadOptions(const ObjLoadOptions& _options);
+const ObjLoadOptions& GetDefaultObjLoadOptions();
+
 bool LoadObj(const std::string& _filepath, attrib_t& _attrib, index_t& _index); 
+bool LoadObj(const std::string& _filepath, attrib_t& _attrib, index_t& _index,
+	const ObjLoadOptions& _options, ObjLoadStats* _stats = nullptr);
+
+// write an obj file in one buffered pass, blocking; see MeshExporter for the
+// asynchronous interface
+bool SaveObj(const std::string& _path, const attrib_t& _attrib, const index_t& _index);
 void SaveObj(attrib_t& _attrib, index_t& _index);
@@ -0,0 +1,541 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include <imgui.h>
+
+#include "./base/gl_state.h"
+#include "geometry_arena.h"
+#include "render_queue.h"
+
+namespace {
+	// key layout from the most significant bit, the low 16 bits are unused
+	constexpr int kLayerShift = 62;
+	constexpr int kProgramShift = 52;
+	constexpr int kMaterialShift = 40;
+	constexpr int kDepthShift = 16;
+
+	constexpr uint32_t kMaxProgramId = (1u << 10) - 1;
+	constexpr uint32_t kMaxMaterialId = (1u << 12) - 1;
+
+	struct PacketUniforms {
+		UniformHandle model;
+		UniformHandle positionOffset;
+		UniformHandle positionScale;
+		UniformHandle ka;
+		UniformHandle kd;
+		UniformHandle ks;
+		UniformHandle ns;
+		UniformHandle flatColor;
+	};
+
+	// looked up on every program switch, handles cannot go stale when a program is deleted
+	PacketUniforms resolveUniforms(const GLSLProgram& program) {
+		PacketUniforms uniforms;
+		uniforms.model = program.getUniform("model");
+		uniforms.positionOffset = program.getUniform("positionOffset");
+		uniforms.positionScale = program.getUniform("positionScale");
+		uniforms.ka = program.getUniform("material.ka");
+		uniforms.kd = program.getUniform("material.kd");
+		uniforms.ks = program.getUniform("material.ks");
+		uniforms.ns = program.getUniform("material.ns");
+		uniforms.flatColor = program.getUniform("flatColor");
+		return uniforms;
+	}
+
+	// past the limit objects share the last id, they still draw but are not grouped
+	uint32_t getId(std::unordered_map<const void*, uint32_t>& ids, const void* object, uint32_t maxId) {
+		const uint32_t id = ids.emplace(object, static_cast<uint32_t>(ids.size())).first->second;
+		return std::min(id, maxId);
+	}
+
+	// positive floats order like their bit patterns, the top 24 bits are kept
+	uint32_t quantizeDepth(float depth) {
+		depth = std::max(depth, 0.0f);
+		uint32_t bits;
+		std::memcpy(&bits, &depth, sizeof(bits));
+		return bits >> 7;
+	}
+
+	MultiDrawOptions defaultMultiDrawOptions;
+
+	bool isMergeable(const DrawPacket& packet, MultiDrawPath path) {
+		if (path == MultiDrawPath::Separate || packet.range.indexType == 0 || packet.range.instanceCount != 1) {
+			return false;
+		}
+		return path != MultiDrawPath::Indirect || packet.multiDrawProgram != nullptr;
+	}
+
+	// both mergeable, what a run must share on the path
+	bool canMerge(const DrawPacket& lhs, const DrawPacket& rhs, MultiDrawPath path) {
+		if (lhs.layer != rhs.layer || lhs.program != rhs.program ||
+			lhs.material != rhs.material || lhs.texture != rhs.texture ||
+			lhs.range.vao != rhs.range.vao || lhs.range.mode != rhs.range.mode ||
+			lhs.range.indexType != rhs.range.indexType || lhs.depthFunc != rhs.depthFunc ||
+			lhs.positionOffset != rhs.positionOffset || lhs.positionScale != rhs.positionScale) {
+			return false;
+		}
+
+		if (path == MultiDrawPath::Indirect) {
+			return lhs.multiDrawProgram == rhs.multiDrawProgram;
+		}
+		return lhs.model == rhs.model && lhs.color == rhs.color;
+	}
+
+	size_t getIndexSize(GLenum indexType) {
+		return indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+	}
+
+	void uploadStream(GLenum target, GLuint buffer, size_t& capacity, const void* data, size_t bytes) {
+		if (capacity < bytes) {
+			capacity = 1;
+			while (capacity < bytes) {
+				capacity *= 2;
+			}
+		}
+
+		glBindBuffer(target, buffer);
+		glBufferData(target, capacity, nullptr, GL_STREAM_DRAW);
+		glBufferSubData(target, 0, bytes, data);
+	}
+}
+
+void SetDefaultMultiDrawOptions(const MultiDrawOptions& options) {
+	defaultMultiDrawOptions = options;
+}
+
+const MultiDrawOptions& GetDefaultMultiDrawOptions() {
+	return defaultMultiDrawOptions;
+}
+
+bool SupportsMultiDrawIndirect() {
+	return GLAD_GL_VERSION_4_3 && glMultiDrawElementsIndirect != nullptr;
+}
+
+MultiDrawPath ChooseMultiDrawPath(const MultiDrawOptions& options) {
+	if (!options.enabled) {
+		return MultiDrawPath::Separate;
+	}
+	return options.indirect && SupportsMultiDrawIndirect() ? MultiDrawPath::Indirect : MultiDrawPath::BaseVertex;
+}
+
+const char* GetMultiDrawPathName(MultiDrawPath path) {
+	switch (path) {
+	case MultiDrawPath::BaseVertex:
+		return "multi draw base vertex";
+	case MultiDrawPath::Indirect:
+		return "multi draw indirect";
+	default:
+		return "separate draws";
+	}
+}
+
+RenderQueue::RenderQueue()
+	: _multiDrawPath(ChooseMultiDrawPath(GetDefaultMultiDrawOptions())) { }
+
+RenderQueue::~RenderQueue() {
+	if (_commandBuffer != 0) {
+		glDeleteBuffers(1, &_commandBuffer);
+	}
+
+	if (_drawDataBuffer != 0) {
+		glDeleteBuffers(1, &_drawDataBuffer);
+	}
+
+	deleteIndirectVaos();
+}
+
+void RenderQueue::setMultiDrawPath(MultiDrawPath path) {
+	if (path == MultiDrawPath::Indirect && !SupportsMultiDrawIndirect()) {
+		path = MultiDrawPath::BaseVertex;
+	}
+	_multiDrawPath = path;
+}
+
+MultiDrawPath RenderQueue::getMultiDrawPath() const {
+	return _multiDrawPath;
+}
+
+double RenderQueue::getSubmitMs(MultiDrawPath path) const {
+	return _submitMs[static_cast<int>(path)];
+}
+
+void RenderQueue::submit(const DrawPacket& packet) {
+	_packets.push_back(packet);
+}
+
+void RenderQueue::submit(
+	const Model& model, GLSLProgram* program, const glm::mat4& view, GLSLProgram* multiDrawProgram) {
+	submit(*model.getMesh(), model.getLod(), program, model.material.get(), model.getModelMatrix(), view,
+		multiDrawProgram);
+}
+
+void RenderQueue::submit(
+	const Mesh& mesh, int lod, GLSLProgram* program, const PhongMaterial* material,
+	const glm::mat4& model, const glm::mat4& view, GLSLProgram* multiDrawProgram) {
+	DrawPacket packet;
+	packet.range = mesh.getDrawRange(lod);
+	packet.program = program;
+	packet.multiDrawProgram = multiDrawProgram;
+	packet.material = material;
+	packet.model = model;
+
+	const VertexFormat& format = mesh.getVertexFormat();
+	packet.positionOffset = format.positionOffset;
+	packet.positionScale = format.positionScale;
+
+	const BoundingBox box = mesh.getBoundingBox();
+	packet.depth = -(view * model * glm::vec4((box.min + box.max) * 0.5f, 1.0f)).z;
+
+	_packets.push_back(packet);
+}
+
+void RenderQueue::submit(const InstanceBatch& batch, int lod, GLSLProgram* program, const PhongMaterial* material) {
+	DrawPacket packet;
+	packet.range = batch.getDrawRange(lod);
+	packet.program = program;
+	packet.material = material;
+
+	const VertexFormat& format = batch.getMesh()->getVertexFormat();
+	packet.positionOffset = format.positionOffset;
+	packet.positionScale = format.positionScale;
+
+	_packets.push_back(packet);
+}
+
+void RenderQueue::submit(const SkyBox& skybox) {
+	DrawPacket packet;
+	packet.layer = RenderLayer::Sky;
+	packet.range = skybox.getDrawRange();
+	packet.program = skybox.getProgram();
+	packet.texture = skybox.getTexture();
+	packet.depthFunc = GL_LEQUAL;
+	_packets.push_back(packet);
+}
+
+void RenderQueue::execute() {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	_items.resize(_packets.size());
+	for (size_t i = 0; i < _packets.size(); ++i) {
+		_items[i].key = makeKey(_packets[i]);
+		_items[i].index = static_cast<uint32_t>(i);
+	}
+	radixSort();
+
+	_stats = RenderQueueStats();
+	_stats.packets = static_cast<int>(_packets.size());
+	_stats.sortMs = std::chrono::duration<double, std::milli>(
+		std::chrono::high_resolution_clock::now() - start).count();
+
+	const auto submitStart = std::chrono::high_resolution_clock::now();
+	buildRuns();
+	if (!_commands.empty()) {
+		uploadIndirect();
+	}
+
+	GLState& glState = GLState::getInstance();
+	GLSLProgram* program = nullptr;
+	PacketUniforms uniforms;
+	const PhongMaterial* material = nullptr;
+	const Texture* texture = nullptr;
+	GLuint vao = 0;
+
+	auto bindState = [&](const DrawPacket& packet, GLSLProgram* packetProgram, GLuint packetVao) {
+		if (packetProgram != program) {
+			program = packetProgram;
+			program->use();
+			uniforms = resolveUniforms(*program);
+			// the material uniforms belong to the previous program
+			material = nullptr;
+			++_stats.programSwitches;
+		}
+
+		glState.setDepthFunc(packet.depthFunc);
+
+		if (packet.material != nullptr && packet.material != material) {
+			program->setVec3(uniforms.ka, packet.material->ka);
+			program->setVec3(uniforms.kd, packet.material->kd);
+			program->setVec3(uniforms.ks, packet.material->ks);
+			program->setFloat(uniforms.ns, packet.material->ns);
+			material = packet.material;
+			++_stats.materialSwitches;
+		}
+
+		const Texture* packetTexture =
+			packet.material != nullptr ? packet.material->mapKd.get() : packet.texture;
+		if (packetTexture != nullptr && packetTexture != texture) {
+			packetTexture->bind(0);
+			texture = packetTexture;
+			++_stats.textureSwitches;
+		}
+
+		// the program skips the values it already holds, and those it does not have
+		program->setMat4(uniforms.model, packet.model);
+		program->setVec3(uniforms.positionOffset, packet.positionOffset);
+		program->setVec3(uniforms.positionScale, packet.positionScale);
+		program->setVec4(uniforms.flatColor, packet.color);
+
+		if (packetVao != vao) {
+			glState.bindVertexArray(packetVao);
+			vao = packetVao;
+			++_stats.vertexArraySwitches;
+		}
+	};
+
+	for (const DrawRun& run : _runs) {
+		const DrawPacket& first = _packets[_items[run.begin].index];
+		const GLsizei drawCount = static_cast<GLsizei>(run.end - run.begin);
+
+		if (drawCount == 1) {
+			bindState(first, first.program, first.range.vao);
+			first.range.draw();
+			++_stats.drawCalls;
+			_stats.instances += first.range.instanceCount;
+			continue;
+		}
+
+		if (_multiDrawPath == MultiDrawPath::Indirect) {
+			bindState(first, first.multiDrawProgram, run.vao);
+			glMultiDrawElementsIndirect(first.range.mode, first.range.indexType,
+				(void*)(run.firstCommand * sizeof(DrawElementsIndirectCommand)), drawCount, 0);
+		}
+		else {
+			bindState(first, first.program, first.range.vao);
+
+			_counts.clear();
+			_offsets.clear();
+			_baseVertices.clear();
+			for (uint32_t i = run.begin; i < run.end; ++i) {
+				const DrawRange& range = _packets[_items[i].index].range;
+				_counts.push_back(range.count);
+				_offsets.push_back((const void*)range.offset);
+				_baseVertices.push_back(range.baseVertex);
+			}
+
+			glMultiDrawElementsBaseVertex(first.range.mode, _counts.data(), first.range.indexType,
+				_offsets.data(), drawCount, _baseVertices.data());
+		}
+
+		++_stats.drawCalls;
+		++_stats.multiDraws;
+		_stats.mergedPackets += drawCount;
+		_stats.instances += drawCount;
+	}
+
+	if (!_commands.empty()) {
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+
+	_stats.submitMs = std::chrono::duration<double, std::milli>(
+		std::chrono::high_resolution_clock::now() - submitStart).count();
+	_submitMs[static_cast<int>(_multiDrawPath)] = _stats.submitMs;
+
+	_packets.clear();
+	_programIds.clear();
+	_materialIds.clear();
+}
+
+const RenderQueueStats& RenderQueue::getStats() const {
+	return _stats;
+}
+
+void RenderQueue::drawStatsGui() {
+	ImGui::Text("render queue");
+	ImGui::Separator();
+	ImGui::Text("draws: %d, sort: %.3f ms", _stats.drawCalls, _stats.sortMs);
+	ImGui::Text("switches: %d programs, %d materials, %d textures, %d vaos",
+		_stats.programSwitches, _stats.materialSwitches,
+		_stats.textureSwitches, _stats.vertexArraySwitches);
+	ImGui::NewLine();
+
+	const char* pathNames[kMultiDrawPathCount];
+	for (int i = 0; i < kMultiDrawPathCount; ++i) {
+		pathNames[i] = GetMultiDrawPathName(static_cast<MultiDrawPath>(i));
+	}
+	int multiDrawPath = static_cast<int>(_multiDrawPath);
+	ImGui::Text("multi draw");
+	ImGui::Separator();
+	if (ImGui::Combo("submit path", &multiDrawPath, pathNames, kMultiDrawPathCount)) {
+		setMultiDrawPath(static_cast<MultiDrawPath>(multiDrawPath));
+	}
+	ImGui::Text("opengl 4.3 indirect draws: %s", SupportsMultiDrawIndirect() ? "yes" : "no, base vertex instead");
+	ImGui::Text("merged: %d of %d packets in %d multi draw calls",
+		_stats.mergedPackets, _stats.packets, _stats.multiDraws);
+	ImGui::Text("cpu submit ms: %.3f separate, %.3f base vertex, %.3f indirect",
+		getSubmitMs(MultiDrawPath::Separate),
+		getSubmitMs(MultiDrawPath::BaseVertex),
+		getSubmitMs(MultiDrawPath::Indirect));
+	ImGui::NewLine();
+}
+
+uint64_t RenderQueue::makeKey(const DrawPacket& packet) {
+	const void* material = packet.material != nullptr
+		? static_cast<const void*>(packet.material) : static_cast<const void*>(packet.texture);
+
+	return (static_cast<uint64_t>(packet.layer) << kLayerShift) |
+		(static_cast<uint64_t>(getId(_programIds, packet.program, kMaxProgramId)) << kProgramShift) |
+		(static_cast<uint64_t>(getId(_materialIds, material, kMaxMaterialId)) << kMaterialShift) |
+		(static_cast<uint64_t>(quantizeDepth(packet.depth)) << kDepthShift);
+}
+
+void RenderQueue::radixSort() {
+	const size_t count = _items.size();
+	if (count < 2) {
+		return;
+	}
+
+	_scratch.resize(count);
+	SortItem* source = _items.data();
+	SortItem* target = _scratch.data();
+
+	for (int shift = 0; shift < 64; shift += 8) {
+		size_t histogram[256] = {};
+		for (size_t i = 0; i < count; ++i) {
+			++histogram[(source[i].key >> shift) & 0xFF];
+		}
+
+		// every key has the same byte here, the pass would not move anything
+		if (histogram[(source[0].key >> shift) & 0xFF] == count) {
+			continue;
+		}
+
+		size_t offset = 0;
+		for (size_t& bucket : histogram) {
+			const size_t size = bucket;
+			bucket = offset;
+			offset += size;
+		}
+
+		for (size_t i = 0; i < count; ++i) {
+			target[histogram[(source[i].key >> shift) & 0xFF]++] = source[i];
+		}
+
+		std::swap(source, target);
+	}
+
+	if (source != _items.data()) {
+		_items.swap(_scratch);
+	}
+}
+
+void RenderQueue::buildRuns() {
+	_runs.clear();
+	_commands.clear();
+	_drawData.clear();
+
+	const uint32_t count = static_cast<uint32_t>(_items.size());
+	for (uint32_t begin = 0; begin < count; ) {
+		const DrawPacket& first = _packets[_items[begin].index];
+
+		uint32_t end = begin + 1;
+		if (isMergeable(first, _multiDrawPath)) {
+			while (end < count) {
+				const DrawPacket& packet = _packets[_items[end].index];
+				if (!isMergeable(packet, _multiDrawPath) || !canMerge(first, packet, _multiDrawPath)) {
+					break;
+				}
+				++end;
+			}
+		}
+
+		DrawRun run;
+		run.begin = begin;
+		run.end = end;
+		run.firstCommand = static_cast<uint32_t>(_commands.size());
+		run.vao = first.range.vao;
+
+		// without a vertex array reading the draw data the packets go one by one
+		if (_multiDrawPath == MultiDrawPath::Indirect && end - begin > 1) {
+			run.vao = getIndirectVao(first.range.vao);
+			if (run.vao == 0) {
+				run.vao = first.range.vao;
+				run.end = end = begin + 1;
+			}
+		}
+
+		if (_multiDrawPath == MultiDrawPath::Indirect && end - begin > 1) {
+			const size_t indexSize = getIndexSize(first.range.indexType);
+			for (uint32_t i = begin; i < end; ++i) {
+				const DrawPacket& packet = _packets[_items[i].index];
+
+				DrawElementsIndirectCommand command;
+				command.count = static_cast<GLuint>(packet.range.count);
+				command.instanceCount = 1;
+				command.firstIndex = static_cast<GLuint>(packet.range.offset / indexSize);
+				command.baseVertex = packet.range.baseVertex;
+				command.baseInstance = static_cast<GLuint>(_drawData.size());
+				_commands.push_back(command);
+
+				_drawData.push_back({ packet.model, packet.color });
+			}
+		}
+
+		_runs.push_back(run);
+		begin = end;
+	}
+}
+
+GLuint RenderQueue::getIndirectVao(GLuint poolVao) {
+	const GeometryArena& arena = GeometryArena::getInstance();
+	if (_indirectGeneration != arena.getGeneration()) {
+		deleteIndirectVaos();
+		_indirectGeneration = arena.getGeneration();
+	}
+
+	auto it = _indirectVaos.find(poolVao);
+	if (it != _indirectVaos.end()) {
+		return it->second;
+	}
+
+	if (_drawDataBuffer == 0) {
+		glGenBuffers(1, &_commandBuffer);
+		glGenBuffers(1, &_drawDataBuffer);
+	}
+
+	GLuint vao = 0;
+	glGenVertexArrays(1, &vao);
+
+	// set up once, the draw data buffer keeps its name when it is orphaned
+	GLState& glState = GLState::getInstance();
+	glState.bindVertexArray(vao);
+	const bool found = arena.setPoolAttributes(poolVao);
+	if (found) {
+		glBindBuffer(GL_ARRAY_BUFFER, _drawDataBuffer);
+		SetInstanceAttributes();
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	glState.bindVertexArray(0);
+
+	if (!found) {
+		glDeleteVertexArrays(1, &vao);
+		vao = 0;
+	}
+
+	_indirectVaos[poolVao] = vao;
+	return vao;
+}
+
+void RenderQueue::deleteIndirectVaos() {
+	// the tracker must not hold a name the driver may hand out again
+	if (!_indirectVaos.empty()) {
+		GLState::getInstance().bindVertexArray(0);
+	}
+
+	for (const auto& entry : _indirectVaos) {
+		if (entry.second != 0) {
+			glDeleteVertexArrays(1, &entry.second);
+		}
+	}
+	_indirectVaos.clear();
+}
+
+void RenderQueue::uploadIndirect() {
+	// the command buffer stays bound for the draws
+	uploadStream(GL_ARRAY_BUFFER, _drawDataBuffer, _drawDataCapacity,
+		_drawData.data(), _drawData.size() * sizeof(InstanceData));
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	uploadStream(GL_DRAW_INDIRECT_BUFFER, _commandBuffer, _commandCapacity,
+		_commands.data(), _commands.size() * sizeof(DrawElementsIndirectCommand));
+}
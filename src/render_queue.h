@@ -0,0 +1,248 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "./base/draw_range.h"
+#include "./base/glsl_program.h"
+#include "./base/material.h"
+#include "./base/skybox.h"
+#include "./base/texture.h"
+#include "instance_batch.h"
+#include "model.h"
+
+// How packets that follow each other in the sorted order with the same
+// state and geometry buffers are submitted.
+enum class MultiDrawPath : uint8_t {
+	// a draw call per packet
+	Separate = 0,
+	// one glMultiDrawElementsBaseVertex per run that also shares the model
+	// matrix and the color, opengl 3.3 has no way to tell the draws apart
+	BaseVertex = 1,
+	// one glMultiDrawElementsIndirect per run, opengl 4.3. The base instance
+	// of each command selects its model matrix and color in a buffer read by
+	// the per instance attributes of the packets' multi draw program.
+	Indirect = 2
+};
+
+constexpr int kMultiDrawPathCount = 3;
+
+struct MultiDrawOptions {
+	// merge runs of packets, otherwise a draw call per packet
+	bool enabled = true;
+
+	// the indirect path where the context has it, otherwise base vertex
+	bool indirect = true;
+};
+
+void SetDefaultMultiDrawOptions(const MultiDrawOptions& options);
+const MultiDrawOptions& GetDefaultMultiDrawOptions();
+
+// glMultiDrawElementsIndirect and base instances are core in opengl 4.3,
+// main.cpp asks for 3.3 and drivers may hand out a newer context
+bool SupportsMultiDrawIndirect();
+
+MultiDrawPath ChooseMultiDrawPath(const MultiDrawOptions& options);
+
+const char* GetMultiDrawPathName(MultiDrawPath path);
+
+// layers are drawn in this order whatever the rest of the sort key
+enum class RenderLayer : uint8_t {
+	Opaque = 0,
+	// drawn last at the far plane, where the opaque geometry already fills the depth buffer
+	Sky = 1
+};
+
+// One draw of a stage. The program is the one resolved uniforms are set on:
+// "model", "positionOffset", "positionScale", "material.ka", "material.kd",
+// "material.ks", "material.ns" and "flatColor", those it does not have are
+// skipped.
+struct DrawPacket {
+	RenderLayer layer = RenderLayer::Opaque;
+
+	DrawRange range;
+
+	GLSLProgram* program = nullptr;
+
+	// the program's INSTANCED variant for the indirect path, which reads the
+	// model matrix and the color as per instance attributes, packets
+	// without one are not merged on that path
+	GLSLProgram* multiDrawProgram = nullptr;
+
+	// its diffuse map is bound to unit 0
+	const PhongMaterial* material = nullptr;
+
+	// bound to unit 0 instead when there is no material, e.g. the sky cubemap
+	const Texture* texture = nullptr;
+
+	glm::mat4 model = glm::mat4(1.0f);
+
+	// decode of quantized positions, from the vertex format of the mesh
+	glm::vec3 positionOffset = glm::vec3(0.0f);
+	glm::vec3 positionScale = glm::vec3(1.0f);
+
+	glm::vec4 color = glm::vec4(1.0f);
+
+	GLenum depthFunc = GL_LESS;
+
+	// view space distance, opaque packets of the same state go front to back
+	float depth = 0.0f;
+};
+
+// counts of the last execute()
+struct RenderQueueStats {
+	int packets = 0;
+	int drawCalls = 0;
+
+	// draw calls that submitted more than one packet, and the packets they submitted
+	int multiDraws = 0;
+	int mergedPackets = 0;
+
+	// copies drawn, more than the draw calls with instancing
+	int instances = 0;
+
+	int programSwitches = 0;
+	int materialSwitches = 0;
+	int textureSwitches = 0;
+	int vertexArraySwitches = 0;
+
+	double sortMs = 0.0;
+
+	// cpu time from the sorted packets to the last draw call
+	double submitMs = 0.0;
+};
+
+// Collects the draws of a frame, sorts them by a 64-bit key and submits
+// them with as few state changes as the order allows. From the most
+// significant bits the key holds the layer, the program, the material or
+// texture and the quantized depth, so packets are grouped by state first
+// and go front to back within a group. Runs of packets of the same state
+// and vertex array are then merged as the multi draw path allows.
+class RenderQueue {
+public:
+	// on the path the default options choose
+	RenderQueue();
+
+	RenderQueue(const RenderQueue&) = delete;
+
+	~RenderQueue();
+
+	// the indirect path falls back to base vertex where it is not supported
+	void setMultiDrawPath(MultiDrawPath path);
+
+	MultiDrawPath getMultiDrawPath() const;
+
+	// the last submit time on a path, 0 until it was used
+	double getSubmitMs(MultiDrawPath path) const;
+
+	void submit(const DrawPacket& packet);
+
+	// an opaque packet of the model's current level of detail, its depth
+	// is the view distance of the bounding box center
+	void submit(
+		const Model& model, GLSLProgram* program, const glm::mat4& view,
+		GLSLProgram* multiDrawProgram = nullptr);
+
+	// the same for a copy of a mesh without a model of its own
+	void submit(
+		const Mesh& mesh, int lod, GLSLProgram* program, const PhongMaterial* material,
+		const glm::mat4& model, const glm::mat4& view, GLSLProgram* multiDrawProgram = nullptr);
+
+	// one instanced packet of every uploaded instance, the program has the
+	// INSTANCED define and takes the model matrices from the instance buffer
+	void submit(const InstanceBatch& batch, int lod, GLSLProgram* program, const PhongMaterial* material);
+
+	// in the sky layer with GL_LEQUAL, its cubemap on unit 0
+	void submit(const SkyBox& skybox);
+
+	// sort and draw the submitted packets, then start over
+	void execute();
+
+	const RenderQueueStats& getStats() const;
+
+	// the render queue and multi draw sections of a control panel, the
+	// submit path can be switched there
+	void drawStatsGui();
+
+private:
+	struct SortItem {
+		uint64_t key;
+		uint32_t index;
+	};
+
+	// sorted items [begin, end) submitted with one call, the commands of
+	// an indirect run start at firstCommand and are drawn from vao
+	struct DrawRun {
+		uint32_t begin;
+		uint32_t end;
+		uint32_t firstCommand;
+		GLuint vao;
+	};
+
+	// layout glMultiDrawElementsIndirect reads
+	struct DrawElementsIndirectCommand {
+		GLuint count;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+
+	std::vector<DrawPacket> _packets;
+
+	std::vector<SortItem> _items;
+	std::vector<SortItem> _scratch;
+
+	// small ids of the programs and materials of this frame, in order of submission
+	std::unordered_map<const void*, uint32_t> _programIds;
+	std::unordered_map<const void*, uint32_t> _materialIds;
+
+	RenderQueueStats _stats;
+
+	MultiDrawPath _multiDrawPath = MultiDrawPath::Separate;
+	double _submitMs[kMultiDrawPathCount] = {};
+
+	std::vector<DrawRun> _runs;
+
+	// the indirect path's commands and per draw data, the index of a
+	// command's record is its base instance
+	std::vector<DrawElementsIndirectCommand> _commands;
+	std::vector<InstanceData> _drawData;
+	GLuint _commandBuffer = 0;
+	GLuint _drawDataBuffer = 0;
+	size_t _commandCapacity = 0;
+	size_t _drawDataCapacity = 0;
+
+	// Vertex arrays of the indirect path by the arena pool's vertex array,
+	// the pool's attributes plus the per draw data as per instance ones, so
+	// the pool's own vertex array keeps no instanced attributes. Dropped
+	// when the arena generation changes.
+	std::unordered_map<GLuint, GLuint> _indirectVaos;
+	uint32_t _indirectGeneration = 0;
+
+	// arrays of a base vertex run
+	std::vector<GLsizei> _counts;
+	std::vector<const void*> _offsets;
+	std::vector<GLint> _baseVertices;
+
+	uint64_t makeKey(const DrawPacket& packet);
+
+	// split the sorted items into runs, and fill the commands and the
+	// per draw data of the indirect ones
+	void buildRuns();
+
+	// 0 if the vertex array is not one of the arena's pools
+	GLuint getIndirectVao(GLuint poolVao);
+
+	void deleteIndirectVaos();
+
+	// orphaned and grown to the next power of two like the instance buffers
+	void uploadIndirect();
+
+	// stable least significant byte first, bytes every key shares are skipped
+	void radixSort();
+};
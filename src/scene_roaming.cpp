@@ -1,8 +1,12 @@
 #include <algorithm>
+#include <unordered_set>
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
 
+#include "./base/gl_state.h"
+#include "instance_batch.h"
+#include "shader_registry.h"
 #include "scene_roaming.h"
 
 const std::string cabinPath = "./media/cabin.obj";
@@ -34,15 +38,10 @@ bool CollisionDetection(BoundingBox box, glm::mat4 modelMatrix, glm::vec3 camera
 	return false;
 }
 
-void SceneRoaming::init(Window& window, MouseInput& mouseInput) {
+void SceneRoaming::load(Window& window, AssetLoader& assetLoader) {
 	int windowWidth = window.getWidth();
 	int windowHeight = window.getHeight();
 
-	// set input mode
-	mouseInput.move.xOld = mouseInput.move.xCurrent = 0.5 * window.getWidth();
-	mouseInput.move.yOld = mouseInput.move.yCurrent = 0.5 * window.getHeight();
-	glfwSetCursorPos(window.getHandle(), mouseInput.move.xCurrent, mouseInput.move.yCurrent);
-
 	// init cameras
 	_cameras.resize(2);
 	const float aspect = 1.0f * windowWidth / windowHeight;
@@ -61,21 +60,19 @@ void SceneRoaming::init(Window& window, MouseInput& mouseInput) {
 	_cameras[1]->position = glm::vec3(0.0f, 5.0f, 20.0f);
 
 
-	// init skybox
-	_skybox.reset(new SkyBox(skyboxTexturePaths));
+	// init skybox, created once the cubemap is resident
+	_skyboxTexture = assetLoader.loadCubemap(skyboxTexturePaths);
 
-	// init models
+	// init models, their meshes stream in
 	_models.resize(2);
 	// bunny
-	_models[0].reset(new Model(bunnyPath));
+	_models[0].reset(new Model);
 	_models[0]->position = glm::vec3(8.8f, 7.0f, 2.0f);
+	_pendingMeshes.emplace_back(_models[0].get(), assetLoader.loadMesh(bunnyPath));
 	// cabin
-	_models[1].reset(new Model(cabinPath));
+	_models[1].reset(new Model);
 	_models[1]->position = glm::vec3(0.0f, 0.0f, -10.0f);
-	
-	// init textures
-	std::shared_ptr<Texture2D> bunnyTexture = std::make_shared<Texture2D>(bunnyTexturePath);
-	std::shared_ptr<Texture2D> cabinTexture = std::make_shared<Texture2D>(cabinTexturePath);
+	_pendingMeshes.emplace_back(_models[1].get(), assetLoader.loadMesh(cabinPath));
 
 	// init materials
 	_materials.resize(2);
@@ -86,8 +83,11 @@ void SceneRoaming::init(Window& window, MouseInput& mouseInput) {
 		_materials[i]->ks = glm::vec3(1.0f, 1.0f, 1.0f);
 		_materials[i]->ns = 10.0f;
 	}
-	_materials[0]->mapKd = bunnyTexture;
-	_materials[1]->mapKd = cabinTexture;
+	_pendingTextures.emplace_back(_materials[0].get(), assetLoader.loadTexture(bunnyTexturePath));
+	_pendingTextures.emplace_back(_materials[1].get(), assetLoader.loadTexture(cabinTexturePath));
+
+	_models[0]->material = _materials[0];
+	_models[1]->material = _materials[1];
 
 	// init geometries
 	_ball.reset(new Ball());
@@ -95,6 +95,7 @@ void SceneRoaming::init(Window& window, MouseInput& mouseInput) {
 	_cube.reset(new Cube());
 	_cylinder.reset(new Cylinder());
 	_prism.reset(new Prism());
+	_instancedFlatShader = AcquireFlatColorProgram(true);
 
 
 	// init lights
@@ -112,10 +113,124 @@ void SceneRoaming::init(Window& window, MouseInput& mouseInput) {
 
 	// init shaders
 	initPhongShader();
+
+	// camera and light blocks shared by the stage's programs
+	_frameUniforms.reset(new UniformBuffer(kFrameDataBinding, sizeof(FrameData)));
+	_lightUniforms.reset(new UniformBuffer(kLightDataBinding, sizeof(LightData)));
+
+	_exporter.reset(new MeshExporter);
+
+	// the cabin and the primitives never move, their world space geometry
+	// is merged into a draw per program and material
+	_staticBatching = GetDefaultStaticBatchOptions().enabled;
+	_staticBatch.reset(new StaticBatch);
+	_staticIds.assign(_models.size(), -1);
+	_staticIds[1] = _staticBatch->addModel(*_models[1], _phongShader.get(), _instancedPhongShader.get());
+
+	auto addPrimitive = [this](const auto& primitive) {
+		_staticBatch->addPrimitive(primitive.getGeometry(), primitive.getDrawRange().count, primitive.color);
+	};
+	addPrimitive(*_ball);
+	addPrimitive(*_cone);
+	addPrimitive(*_cube);
+	addPrimitive(*_cylinder);
+	addPrimitive(*_prism);
+}
+
+bool SceneRoaming::updateAssets() {
+	for (auto it = _pendingMeshes.begin(); it != _pendingMeshes.end();) {
+		if (it->second.isReady()) {
+			it->first->setMesh(it->second.get());
+			it = _pendingMeshes.erase(it);
+		} else {
+			++it;
+		}
+	}
+
+	for (auto it = _pendingTextures.begin(); it != _pendingTextures.end();) {
+		if (it->second.isReady()) {
+			it->first->mapKd = it->second.get();
+			it = _pendingTextures.erase(it);
+		} else {
+			++it;
+		}
+	}
+
+	if (_skybox == nullptr && _skyboxTexture.isReady()) {
+		_skybox.reset(new SkyBox(_skyboxTexture.get()));
+		_skyboxTexture = AssetHandle<TextureCubemap>();
+	}
+
+	return _pendingMeshes.empty() && _pendingTextures.empty() && _skybox != nullptr;
+}
+
+void SceneRoaming::activate(Window& window, MouseInput& mouseInput) {
+	// set input mode
+	mouseInput.move.xOld = mouseInput.move.xCurrent = 0.5 * window.getWidth();
+	mouseInput.move.yOld = mouseInput.move.yCurrent = 0.5 * window.getHeight();
+	glfwSetCursorPos(window.getHandle(), mouseInput.move.xCurrent, mouseInput.move.yCurrent);
+
+	// the other stages use the same binding points
+	_frameUniforms->bind();
+	_lightUniforms->bind();
 }
 
-void SceneRoaming::deinit() {
+void SceneRoaming::unload() {
+	// finish the pending exports before the stage goes away
+	_exporter.reset();
+
+	// it points at the models and primitives
+	_staticBatch.reset();
+	_staticIds.clear();
+
+	_cameras.clear();
+	_models.clear();
+	_materials.clear();
+	_skybox.reset();
+
+	_ball.reset();
+	_cone.reset();
+	_cube.reset();
+	_cylinder.reset();
+	_prism.reset();
+
+	_ambientLight.reset();
+	_directionalLight.reset();
+	_spotLight.reset();
+
+	_phongShader.reset();
+	_instancedPhongShader.reset();
+	_instancedFlatShader.reset();
+	_frameUniforms.reset();
+	_lightUniforms.reset();
+
+	_pendingMeshes.clear();
+	_pendingTextures.clear();
+	_skyboxTexture = AssetHandle<TextureCubemap>();
+}
+
+size_t SceneRoaming::getResidentBytes() const {
+	// meshes, textures, the skybox and the baked static geometry, the
+	// shaders and primitives are a few KB
+	size_t bytes = _skybox != nullptr ? _skybox->getGpuBytes() : 0;
+	if (_staticBatch != nullptr) {
+		bytes += _staticBatch->getGpuBytes();
+	}
+
+	std::unordered_set<const Mesh*> meshes;
+	for (const auto& model : _models) {
+		if (model->hasMesh() && meshes.insert(model->getMesh().get()).second) {
+			bytes += model->getMesh()->getGpuBytes();
+		}
+	}
+
+	for (const auto& material : _materials) {
+		if (material->mapKd != nullptr) {
+			bytes += material->mapKd->getGpuBytes();
+		}
+	}
 
+	return bytes;
 }
 
 void SceneRoaming::handleInput(Window& window, KeyboardInput& keyboardInput, MouseInput& mouseInput, float deltaTime) {
@@ -152,6 +267,9 @@ void SceneRoaming::handleInput(Window& window, KeyboardInput& keyboardInput, Mou
 		return;
 	}
 
+	// a static model that is moved gets baked again
+	const glm::mat4 oldModelMatrix = _models[activeModelIndex]->getModelMatrix();
+
 	// "middle mouse button" - zoom to fit
 	if (mouseInput.click.middle == true) {
 		std::cout << "Zoom To Fit" << std::endl;
@@ -253,6 +371,10 @@ void SceneRoaming::handleInput(Window& window, KeyboardInput& keyboardInput, Mou
 		_models[activeModelIndex]->scale = { scale, scale, scale };
 	}
 
+	if (_staticIds[activeModelIndex] >= 0 && _models[activeModelIndex]->getModelMatrix() != oldModelMatrix) {
+		_staticBatch->markDirty(_staticIds[activeModelIndex]);
+	}
+
 
 	if (keyboardInput.keyStates[GLFW_KEY_F2] == GLFW_PRESS) {
 		//CaptureScreen(_windowWidth, _windowHeight, renderFrame());
@@ -275,6 +397,24 @@ void SceneRoaming::handleInput(Window& window, KeyboardInput& keyboardInput, Mou
 		keyboardInput.keyStates[GLFW_KEY_F2] = GLFW_RELEASE;
 	}
 
+	// "F3" / "F4" - export the active model as obj / binary, written in the background
+	if ((keyboardInput.keyStates[GLFW_KEY_F3] == GLFW_PRESS || keyboardInput.keyStates[GLFW_KEY_F4] == GLFW_PRESS) &&
+		_models[activeModelIndex]->hasMesh()) {
+		const bool obj = keyboardInput.keyStates[GLFW_KEY_F3] == GLFW_PRESS;
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		_models[activeModelIndex]->downloadGeometry(vertices, indices);
+
+		time_t t = time(0);
+		char path[64] = "";
+		strftime(path, sizeof(path), obj ? "./userdata/%Y_%m_%d_%H_%M_%S.obj" : "./userdata/%Y_%m_%d_%H_%M_%S.mesh", localtime(&t));
+		_exporter->exportMesh(path, std::move(vertices), std::move(indices),
+			obj ? MeshExportFormat::Obj : MeshExportFormat::Binary);
+
+		keyboardInput.keyStates[GLFW_KEY_F3] = GLFW_RELEASE;
+		keyboardInput.keyStates[GLFW_KEY_F4] = GLFW_RELEASE;
+	}
+
 	// Mouse Scroll  - Zoom in/out
 	if (mouseInput.scroll.y != 0) {
 		if (mouseInput.scroll.y > 0)
@@ -334,55 +474,92 @@ void SceneRoaming::renderFrame() {
 
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glEnable(GL_DEPTH_TEST);
-
-	glm::mat4 projection = _cameras[activeCameraIndex]->getProjectionMatrix();
-	glm::mat4 view = _cameras[activeCameraIndex]->getViewMatrix();
-	
-	_phongShader->use();
-	// 1. transfer mvp matrix to the shader
-	_phongShader->setMat4("projection", projection);
-	_phongShader->setMat4("view", view);
-
-	// 2. transfer light attributes to the shader
-	_phongShader->setVec3("ambientLight.color", _ambientLight->color);
-	_phongShader->setFloat("ambientLight.intensity", _ambientLight->intensity);
-	_phongShader->setVec3("spotLight.position", _spotLight->position);
-	_phongShader->setVec3("spotLight.direction", _spotLight->getFront());
-	_phongShader->setFloat("spotLight.intensity", _spotLight->intensity);
-	_phongShader->setVec3("spotLight.color", _spotLight->color);
-	_phongShader->setFloat("spotLight.angle", _spotLight->angle);
-	_phongShader->setFloat("spotLight.kc", _spotLight->kc);
-	_phongShader->setFloat("spotLight.kl", _spotLight->kl);
-	_phongShader->setFloat("spotLight.kq", _spotLight->kq);
-	_phongShader->setVec3("directionalLight.direction", _directionalLight->getFront());
-	_phongShader->setFloat("directionalLight.intensity", _directionalLight->intensity);
-	_phongShader->setVec3("directionalLight.color", _directionalLight->color);
-
-	// 3. transfer view position to the shader
-	_phongShader->setVec3("eye.position", _cameras[activeCameraIndex]->position);
+	// the tracker skips what the previous frame already set
+	GLState& glState = GLState::getInstance();
+	glState.enable(GL_DEPTH_TEST);
+
+	// camera and lights go to the shared uniform blocks, uploaded only when they changed
+	const FrameData frameData = MakeFrameData(*_cameras[activeCameraIndex]);
+	const LightData lightData = MakeLightData(*_ambientLight, *_directionalLight, *_spotLight);
+	_frameUniforms->update(&frameData);
+	_lightUniforms->update(&lightData);
+
+	const glm::mat4& projection = frameData.projection;
+	const glm::mat4& view = frameData.view;
+
+	// levels of detail are picked against the current viewport
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	size_t drawnFaces = 0;
+	size_t fullFaces = 0;
+
+	// models whose bounding box is outside the view are not submitted
+	const Frustum frustum = _cameras[activeCameraIndex]->getFrustum();
+	int visibleModels = 0;
+	int culledModels = 0;
+
+	// bake what arrived or moved, the static objects are then drawn from the batch
+	if (_staticBatching) {
+		_staticBatch->update();
+	}
 
 	// draw models
 	for (int i = 0; i < _models.size() ; i++) {
-		_phongShader->setMat4("model", _models[i]->getModelMatrix());
-		_phongShader->setVec3("material.ka", _materials[i]->ka);
-		_phongShader->setVec3("material.kd", _materials[i]->kd);
-		_phongShader->setVec3("material.ks", _materials[i]->ks);
-		_phongShader->setFloat("material.ns", _materials[i]->ns);
+		const PhongMaterial* material = _models[i]->material.get();
+		// still streaming in
+		if (!_models[i]->hasMesh() || material->mapKd == nullptr) {
+			continue;
+		}
+
+		if (_staticBatching && _staticIds[i] >= 0 && _staticBatch->isBaked(_staticIds[i])) {
+			continue;
+		}
+
+		if (!frustum.intersect(_models[i]->getBoundingBox(), _models[i]->getModelMatrix())) {
+			++culledModels;
+			continue;
+		}
+		++visibleModels;
 
-		glActiveTexture(GL_TEXTURE0);
-		_materials[i]->mapKd->bind();
+		_models[i]->updateLod(view, projection, viewport[3]);
+		drawnFaces += _models[i]->getLodFaceCount();
+		fullFaces += _models[i]->getFaceCount();
 
-		_models[i]->draw();
+		_renderQueue.submit(*_models[i], _phongShader.get(), view, _instancedPhongShader.get());
 	}
 
-	_skybox->draw(projection, view);
+	// the primitives share the flat color program and keep their GL_LEQUAL
+	auto submitPrimitive = [this](const auto& primitive) {
+		DrawPacket packet;
+		packet.range = primitive.getDrawRange();
+		packet.program = primitive.getProgram();
+		packet.multiDrawProgram = _instancedFlatShader.get();
+		packet.color = primitive.color;
+		packet.depthFunc = GL_LEQUAL;
+		_renderQueue.submit(packet);
+	};
+	if (_staticBatching) {
+		_staticBatch->submit(_renderQueue, frustum, view);
+
+		const StaticBatchStats& staticStats = _staticBatch->getStats();
+		visibleModels += staticStats.visibleObjects;
+		culledModels += staticStats.culledObjects;
+		drawnFaces += staticStats.faces;
+		fullFaces += staticStats.faces;
+	}
+	else {
+		submitPrimitive(*_ball);
+		submitPrimitive(*_cone);
+		submitPrimitive(*_cube);
+		submitPrimitive(*_cylinder);
+		submitPrimitive(*_prism);
+	}
+
+	if (_skybox != nullptr) {
+		_renderQueue.submit(*_skybox);
+	}
 
-	_ball->draw(projection, view);
-	_cone->draw(projection, view);
-	_cube->draw(projection, view);
-	_cylinder->draw(projection, view);
-	_prism->draw(projection, view);
+	_renderQueue.execute();
 
 	// draw ui elements
 	ImGui_ImplOpenGL3_NewFrame();
@@ -424,6 +601,46 @@ void SceneRoaming::renderFrame() {
 		ImGui::SliderFloat("angle##3", (float*)&_spotLight->angle, 0.0f, glm::radians(180.0f), "%f rad");
 		ImGui::NewLine();
 
+		ImGui::Text("frustum culling");
+		ImGui::Separator();
+		ImGui::Text("visible: %d, culled: %d", visibleModels, culledModels);
+		ImGui::NewLine();
+
+		ImGui::Text("level of detail");
+		ImGui::Separator();
+		ImGui::Text("triangles: %zu of %zu", drawnFaces, fullFaces);
+		ImGui::NewLine();
+
+		const GLStateStats& glStats = glState.getFrameStats();
+		ImGui::Text("gl state");
+		ImGui::Separator();
+		ImGui::Text("calls: %d issued, %d elided", glStats.issued, glStats.elided);
+		ImGui::NewLine();
+
+		_renderQueue.drawStatsGui();
+
+		const StaticBatchStats& staticStats = _staticBatch->getStats();
+		ImGui::Text("static batch");
+		ImGui::Separator();
+		ImGui::Checkbox("static batching", &_staticBatching);
+		ImGui::Text("objects: %d in %d groups, %d draws", staticStats.objects, staticStats.groups, staticStats.draws);
+		ImGui::Text("rebuilds: %d groups, %d objects rebaked, last bake: %.3f ms",
+			staticStats.groupRebuilds, staticStats.objectRebakes, staticStats.bakeMs);
+		ImGui::NewLine();
+
+		ImGui::Text("geometry arena");
+		ImGui::Separator();
+		for (const GeometryPoolReport& pool : GeometryArena::getInstance().getReport()) {
+			ImGui::Text("%s pool, %d byte vertices: %d allocations, %d free ranges",
+				pool.positionsOnly ? "position" : "mesh", pool.stride, pool.allocations, pool.freeRanges);
+			ImGui::Text("  vertices %zu of %zu, indices %zu of %zu KB",
+				pool.vertexUsed, pool.vertexCapacity, pool.indexUsedBytes / 1024, pool.indexCapacityBytes / 1024);
+		}
+		if (ImGui::Button("defragment")) {
+			GeometryArena::getInstance().defragment();
+		}
+		ImGui::NewLine();
+
 		ImGui::End();
 	}
 
@@ -442,15 +659,26 @@ void SceneRoaming::initPhongShader() {
 		"out vec3 fNormal;\n"
 		"out vec2 fTexCoord;\n"
 
+		"#ifdef INSTANCED\n"
+		INSTANCE_DATA_GLSL
+		"out vec4 fTint;\n"
+		"#else\n"
 		"uniform mat4 model;\n"
-		"uniform mat4 view;\n"
-		"uniform mat4 projection;\n"
+		"#endif\n"
+		FRAME_DATA_GLSL
+		"uniform vec3 positionOffset;\n"
+		"uniform vec3 positionScale;\n"
 
 		"void main() {\n"
-		"	fPosition = vec3(model * vec4(aPosition, 1.0f));\n"
+		"#ifdef INSTANCED\n"
+		"	mat4 model = aInstanceModel;\n"
+		"	fTint = aInstanceTint;\n"
+		"#endif\n"
+		"	vec3 position = positionOffset + positionScale * aPosition;\n"
+		"	fPosition = vec3(model * vec4(position, 1.0f));\n"
 		"	fNormal = mat3(transpose(inverse(model))) * aNormal;\n"
 		"	fTexCoord = aTexCoord;\n"
-		"	gl_Position = projection * view * model * vec4(aPosition, 1.0f);\n"
+		"	gl_Position = projection * view * model * vec4(position, 1.0f);\n"
 		"}\n";
 
 
@@ -459,6 +687,9 @@ void SceneRoaming::initPhongShader() {
 		"in vec3 fPosition;\n"
 		"in vec3 fNormal;\n"
 		"in vec2 fTexCoord;\n"
+		"#ifdef INSTANCED\n"
+		"in vec4 fTint;\n"
+		"#endif\n"
 		"out vec4 color;\n"
 
 		"// material data structure declaration\n"
@@ -469,42 +700,12 @@ void SceneRoaming::initPhongShader() {
 		"	float ns;\n"
 		"};\n"
 
-		"// ambient light data structure declaration\n"
-		"struct AmbientLight {\n"
-		"	vec3 color;\n"
-		"	float intensity;\n"
-		"};\n"
-
-		"// directional light data structure declaration\n"
-		"struct DirectionalLight {\n"
-		"	vec3 direction;\n"
-		"	float intensity;\n"
-		"	vec3 color;\n"
-		"};\n"
-
-		"// spot light data structure declaration\n"
-		"struct SpotLight {\n"
-		"	vec3 position;\n"
-		"	vec3 direction;\n"
-		"	float intensity;\n"
-		"	vec3 color;\n"
-		"	float angle;\n"
-		"	float kc;\n"
-		"	float kl;\n"
-		"	float kq;\n"
-		"};\n"
-
-		"// view data structure declaration\n"
-		"struct Eye {\n"
-		"	vec3 position;\n"
-		"};\n"
+		"// camera and light data shared by every program\n"
+		FRAME_DATA_GLSL
+		LIGHT_DATA_GLSL
 
 		"// uniform variables\n"
 		"uniform Material material;\n"
-		"uniform AmbientLight ambientLight;\n"
-		"uniform DirectionalLight directionalLight;\n"
-		"uniform SpotLight spotLight;\n"
-		"uniform Eye eye;\n"
 		"uniform sampler2D mapKd;\n"
 
 		"vec3 calcAmbient() {\n"
@@ -534,7 +735,7 @@ void SceneRoaming::initPhongShader() {
 		"	vec3 spotlightDir = normalize(spotLight.position - fPosition);\n"
 		"	vec3 direreflectDir = reflect(-direlightDir, normal);\n"
 		"	vec3 spotreflectDir = reflect(-spotlightDir, normal);\n"
-		"	vec3 viewDir = normalize(eye.position - fPosition);\n"
+		"	vec3 viewDir = normalize(eyePosition - fPosition);\n"
 
 		"	vec3 directionalSpec = directionalLight.intensity * directionalLight.color * pow(max(dot(direreflectDir, viewDir), 0.0f), material.ns) * material.ks; \n"
 
@@ -557,11 +758,13 @@ void SceneRoaming::initPhongShader() {
 		"	vec4 result;\n"
 		"	result = vec4(calcAmbient() + calcDiffuse(normal) + calcSpecular(normal), 1.0f);\n"
 		"	color = texture(mapKd, fTexCoord) * result;\n"
+		"#ifdef INSTANCED\n"
+		"	color *= fTint;\n"
+		"#endif\n"
 		"}\n";
 
 
-	_phongShader.reset(new GLSLProgram);
-	_phongShader->attachVertexShader(vsCode);
-	_phongShader->attachFragmentShader(fsCode);
-	_phongShader->link();
+	// both stages use the same sources and so share the program
+	_phongShader = ShaderRegistry::getInstance().acquire(vsCode, fsCode);
+	_instancedPhongShader = ShaderRegistry::getInstance().acquire(vsCode, fsCode, { "INSTANCED" });
 }
\ No newline at end of file
@@ -6,6 +6,7 @@
 
 #include "./base/stage.h"
 #include "./base/glsl_program.h"
+#include "./base/uniform_buffer.h"
 #include "./base/skybox.h"
 #include "./base/light.h"
 #include "./base/camera.h"
@@ -18,6 +19,10 @@
 #include "cube.h"
 #include "cylinder.h"
 #include "prism.h"
+#include "mesh_exporter.h"
+#include "asset_loader.h"
+#include "render_queue.h"
+#include "static_batch.h"
 
 class SceneRoaming final: public Stage {
 public:
@@ -25,9 +30,15 @@ public:
 	
 	~SceneRoaming() = default;
 
-	void init(Window& window, MouseInput& mouseInput) override;
+	void load(Window& window, AssetLoader& assetLoader) override;
 
-	void deinit() override;
+	bool updateAssets() override;
+
+	void activate(Window& window, MouseInput& mouseInput) override;
+
+	void unload() override;
+
+	size_t getResidentBytes() const override;
 
 	void handleInput(
 		Window& window,
@@ -37,6 +48,11 @@ public:
 	void renderFrame() override;
 
 private:
+	// assets streaming in, bound by updateAssets() once resident
+	std::vector<std::pair<Model*, AssetHandle<const Mesh>>> _pendingMeshes;
+	std::vector<std::pair<PhongMaterial*, AssetHandle<Texture2D>>> _pendingTextures;
+	AssetHandle<TextureCubemap> _skyboxTexture;
+
 	// 3D objects
 	std::vector<std::unique_ptr<Camera>> _cameras;
 	int activeCameraIndex = 0;
@@ -52,16 +68,36 @@ private:
 	std::unique_ptr<Cylinder> _cylinder;
 	std::unique_ptr<Prism> _prism;
 
-	std::vector<std::unique_ptr<PhongMaterial>> _materials;
+	std::vector<std::shared_ptr<PhongMaterial>> _materials;
 
 	// shaders
-	std::unique_ptr<GLSLProgram> _phongShader;
+	std::shared_ptr<GLSLProgram> _phongShader;
+
+	// the INSTANCED variants, for the multi draw indirect path
+	std::shared_ptr<GLSLProgram> _instancedPhongShader;
+	std::shared_ptr<GLSLProgram> _instancedFlatShader;
+
+	// draws of the frame, sorted by state and depth
+	RenderQueue _renderQueue;
+
+	// the objects that never move, _staticIds holds the batch's id of
+	// each model or -1 for the ones that move
+	std::unique_ptr<StaticBatch> _staticBatch;
+	std::vector<int> _staticIds;
+	bool _staticBatching = true;
+
+	// writes models to disk in the background
+	std::unique_ptr<MeshExporter> _exporter;
 
 	// lights
 	std::unique_ptr<AmbientLight> _ambientLight;
 	std::unique_ptr<DirectionalLight> _directionalLight;
 	std::unique_ptr<SpotLight> _spotLight;
 
+	// per frame camera and light data
+	std::unique_ptr<UniformBuffer> _frameUniforms;
+	std::unique_ptr<UniformBuffer> _lightUniforms;
+
 private:
 	void initPhongShader();
 };
\ No newline at end of file
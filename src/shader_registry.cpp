@@ -0,0 +1,129 @@
+#include <iostream>
+
+#include "./base/uniform_buffer.h"
+#include "instance_batch.h"
+#include "shader_registry.h"
+
+namespace {
+	std::string insertDefines(const std::string& code, const std::vector<std::string>& defines) {
+		if (defines.empty()) {
+			return code;
+		}
+
+		std::string lines;
+		for (const std::string& define : defines) {
+			lines += "#define " + define + "\n";
+		}
+
+		// the #version directive has to stay first
+		size_t position = 0;
+		if (code.compare(0, 8, "#version") == 0) {
+			const size_t end = code.find('\n');
+			position = end != std::string::npos ? end + 1 : code.size();
+			if (end == std::string::npos) {
+				lines = "\n" + lines;
+			}
+		}
+
+		return code.substr(0, position) + lines + code.substr(position);
+	}
+}
+
+ShaderRegistry& ShaderRegistry::getInstance() {
+	static ShaderRegistry registry;
+	return registry;
+}
+
+std::shared_ptr<GLSLProgram> ShaderRegistry::acquire(
+	const std::string& vertexCode,
+	const std::string& fragmentCode,
+	const std::vector<std::string>& defines) {
+	const std::string vertexSource = insertDefines(vertexCode, defines);
+	const std::string fragmentSource = insertDefines(fragmentCode, defines);
+
+	// the sources themselves are the key, the separator cannot occur in glsl
+	const std::string key = vertexSource + '\0' + fragmentSource;
+	auto it = _programs.find(key);
+	if (it != _programs.end()) {
+		if (std::shared_ptr<GLSLProgram> program = it->second.lock()) {
+			return program;
+		}
+	}
+
+	std::shared_ptr<GLSLProgram> program = std::make_shared<GLSLProgram>();
+	program->attachVertexShader(vertexSource);
+	program->attachFragmentShader(fragmentSource);
+	program->link();
+
+	removeExpired();
+	_programs[key] = program;
+
+	std::cout << "shader registry: " << getProgramCount() << " programs" << std::endl;
+	return program;
+}
+
+size_t ShaderRegistry::getProgramCount() const {
+	size_t count = 0;
+	for (const auto& entry : _programs) {
+		if (!entry.second.expired()) {
+			++count;
+		}
+	}
+	return count;
+}
+
+void ShaderRegistry::removeExpired() {
+	for (auto it = _programs.begin(); it != _programs.end();) {
+		if (it->second.expired()) {
+			it = _programs.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+std::shared_ptr<GLSLProgram> AcquireFlatColorProgram(bool instanced, bool vertexColors) {
+	const char* vsCode =
+		"#version 330 core\n"
+		"layout(location = 0) in vec3 aPosition;\n"
+		"#ifdef VERTEX_COLOR\n"
+		"layout(location = 1) in vec4 aColor;\n"
+		"#endif\n"
+		"#ifdef INSTANCED\n"
+		INSTANCE_DATA_GLSL
+		"#else\n"
+		"uniform vec4 flatColor;\n"
+		"#endif\n"
+		"out vec4 fColor;\n"
+		FRAME_DATA_GLSL
+		"void main() {\n"
+		"#ifdef INSTANCED\n"
+		"	fColor = aInstanceTint;\n"
+		"	mat4 model = aInstanceModel;\n"
+		"#else\n"
+		"	fColor = flatColor;\n"
+		"	mat4 model = mat4(1.0f);\n"
+		"#endif\n"
+		"#ifdef VERTEX_COLOR\n"
+		"	fColor *= aColor;\n"
+		"#endif\n"
+		"	gl_Position = projection * view * model * vec4(aPosition, 1.0f);\n"
+		"}\n";
+
+	const char* fsCode =
+		"#version 330 core\n"
+		"in vec4 fColor;\n"
+		"out vec4 color;\n"
+		"void main() {\n"
+		"	color = fColor;\n"
+		"}\n";
+
+	std::vector<std::string> defines;
+	if (instanced) {
+		defines.push_back("INSTANCED");
+	}
+	if (vertexColors) {
+		defines.push_back("VERTEX_COLOR");
+	}
+	return ShaderRegistry::getInstance().acquire(vsCode, fsCode, defines);
+}
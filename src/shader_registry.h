@@ -0,0 +1,42 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "./base/glsl_program.h"
+
+// Hands out shared programs keyed by their vertex and fragment sources and
+// defines, so that identical programs of different stages and primitives are
+// compiled, or loaded from the binary cache, once and bound with one
+// glUseProgram. Like the mesh registry it only holds weak references; a
+// program is deleted with its last user.
+class ShaderRegistry {
+public:
+	static ShaderRegistry& getInstance();
+
+	ShaderRegistry(const ShaderRegistry&) = delete;
+
+	// each define is inserted as "#define <define>" after the #version line of both stages
+	std::shared_ptr<GLSLProgram> acquire(
+		const std::string& vertexCode,
+		const std::string& fragmentCode,
+		const std::vector<std::string>& defines = {});
+
+	// number of programs currently alive
+	size_t getProgramCount() const;
+
+private:
+	ShaderRegistry() = default;
+
+	std::unordered_map<std::string, std::weak_ptr<GLSLProgram>> _programs;
+
+	void removeExpired();
+};
+
+// Program of the flat colored primitives, the color is the vec4 uniform
+// "flatColor" so that every primitive shares it. The instanced variant
+// takes the model matrix and the color from the per instance attributes,
+// with vertex colors the color is also multiplied by attribute 1.
+std::shared_ptr<GLSLProgram> AcquireFlatColorProgram(bool instanced = false, bool vertexColors = false);
@@ -0,0 +1,323 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <limits>
+
+#include <glm/gtc/packing.hpp>
+
+#include "shader_registry.h"
+#include "static_batch.h"
+
+namespace {
+	StaticBatchOptions defaultStaticBatchOptions;
+
+	// vertex of the flat group, see GeometryLayout::positions(true)
+	struct ColoredPosition {
+		glm::vec3 position;
+		uint32_t color;
+	};
+
+	GeometryLayout getLayout(bool flat) {
+		return flat ? GeometryLayout::positions(true) : GeometryLayout::of(VertexFormat());
+	}
+
+	// of the vertices the indices use, arrays of the primitives may hold unused garbage
+	template <typename GetPosition>
+	BoundingBox computeWorldBox(const std::vector<uint32_t>& indices, GetPosition getPosition) {
+		BoundingBox box;
+		box.min = glm::vec3(std::numeric_limits<float>::max());
+		box.max = glm::vec3(-std::numeric_limits<float>::max());
+		for (uint32_t index : indices) {
+			const glm::vec3 position = getPosition(index);
+			box.min = glm::min(box.min, position);
+			box.max = glm::max(box.max, position);
+		}
+
+		if (indices.empty()) {
+			box.min = box.max = glm::vec3(0.0f);
+		}
+		return box;
+	}
+}
+
+void SetDefaultStaticBatchOptions(const StaticBatchOptions& options) {
+	defaultStaticBatchOptions = options;
+}
+
+const StaticBatchOptions& GetDefaultStaticBatchOptions() {
+	return defaultStaticBatchOptions;
+}
+
+int StaticBatch::addModel(const Model& model, GLSLProgram* program, GLSLProgram* multiDrawProgram) {
+	Object object;
+	object.group = findGroup(false, program, multiDrawProgram, model.material.get());
+	object.model = &model;
+
+	const int index = static_cast<int>(_objects.size());
+	_objects.push_back(std::move(object));
+	_groups[_objects.back().group].objects.push_back(index);
+	++_stats.objects;
+	return index;
+}
+
+int StaticBatch::addPrimitive(const GeometryAllocation& geometry, GLsizei indexCount, const glm::vec4& color) {
+	Object object;
+	object.group = findGroup(true, nullptr, nullptr, nullptr);
+	object.color = &color;
+
+	std::vector<unsigned char> vertices;
+	geometry.download(vertices, object.indices);
+	object.indices.resize(std::min(object.indices.size(), static_cast<size_t>(indexCount)));
+	object.positions.resize(vertices.size() / sizeof(glm::vec3));
+	std::memcpy(object.positions.data(), vertices.data(), object.positions.size() * sizeof(glm::vec3));
+
+	const int index = static_cast<int>(_objects.size());
+	_objects.push_back(std::move(object));
+
+	Group& group = _groups[_objects.back().group];
+	group.objects.push_back(index);
+	group.rebuild = true;
+	++_stats.objects;
+	return index;
+}
+
+void StaticBatch::markDirty(int object) {
+	_objects[object].dirty = true;
+}
+
+bool StaticBatch::isBaked(int object) const {
+	return _objects[object].baked;
+}
+
+void StaticBatch::update() {
+	const auto start = std::chrono::high_resolution_clock::now();
+	bool baked = false;
+
+	// models whose mesh arrived or changed read it back, their group is laid out again
+	for (Object& object : _objects) {
+		if (object.model == nullptr || object.model->getMesh().get() == object.mesh) {
+			continue;
+		}
+
+		object.mesh = object.model->getMesh().get();
+		if (object.mesh != nullptr) {
+			object.model->downloadGeometry(object.vertices, object.indices);
+		}
+		else {
+			object.vertices.clear();
+			object.indices.clear();
+		}
+		_groups[object.group].rebuild = true;
+	}
+
+	for (Group& group : _groups) {
+		if (group.rebuild) {
+			rebuildGroup(group);
+			++_stats.groupRebuilds;
+			baked = true;
+		}
+	}
+
+	for (Object& object : _objects) {
+		if (object.dirty && object.baked) {
+			rebakeObject(object);
+			++_stats.objectRebakes;
+			baked = true;
+		}
+	}
+
+	if (baked) {
+		_stats.bakeMs = std::chrono::duration<double, std::milli>(
+			std::chrono::high_resolution_clock::now() - start).count();
+	}
+}
+
+void StaticBatch::submit(RenderQueue& queue, const Frustum& frustum, const glm::mat4& view) {
+	_stats.draws = 0;
+	_stats.visibleObjects = 0;
+	_stats.culledObjects = 0;
+	_stats.faces = 0;
+
+	const glm::mat4 identity(1.0f);
+
+	for (const Group& group : _groups) {
+		// the material's texture may still be streaming in
+		if (!group.geometry.isValid() || (!group.flat && group.material->mapKd == nullptr)) {
+			continue;
+		}
+
+		DrawPacket packet;
+		packet.range = group.geometry.getDrawRange();
+		packet.program = group.program;
+		packet.multiDrawProgram = group.multiDrawProgram;
+		packet.material = group.material;
+		// like the primitives on their own
+		packet.depthFunc = group.flat ? GL_LEQUAL : GL_LESS;
+
+		const size_t groupOffset = packet.range.offset;
+		size_t firstIndex = 0;
+		size_t indexCount = 0;
+		float depth = 0.0f;
+
+		auto flush = [&]() {
+			if (indexCount == 0) {
+				return;
+			}
+			packet.range.offset = groupOffset + firstIndex * sizeof(uint32_t);
+			packet.range.count = static_cast<GLsizei>(indexCount);
+			packet.depth = depth;
+			queue.submit(packet);
+			++_stats.draws;
+			indexCount = 0;
+		};
+
+		for (int index : group.objects) {
+			const Object& object = _objects[index];
+			if (!object.baked || object.indices.empty()) {
+				continue;
+			}
+
+			if (!frustum.intersect(object.worldBox, identity)) {
+				++_stats.culledObjects;
+				flush();
+				continue;
+			}
+			++_stats.visibleObjects;
+			_stats.faces += object.indices.size() / 3;
+
+			const glm::vec3 center = (object.worldBox.min + object.worldBox.max) * 0.5f;
+			const float objectDepth = -(view * glm::vec4(center, 1.0f)).z;
+
+			// the objects of a group lie one after another in its index range
+			if (indexCount == 0) {
+				firstIndex = object.firstIndex;
+				depth = objectDepth;
+			}
+			indexCount += object.indices.size();
+			depth = std::min(depth, objectDepth);
+		}
+
+		flush();
+	}
+}
+
+const StaticBatchStats& StaticBatch::getStats() const {
+	return _stats;
+}
+
+size_t StaticBatch::getGpuBytes() const {
+	size_t bytes = 0;
+	for (const Group& group : _groups) {
+		bytes += group.geometry.getGpuBytes();
+	}
+	return bytes;
+}
+
+int StaticBatch::findGroup(
+	bool flat, GLSLProgram* program, GLSLProgram* multiDrawProgram, const PhongMaterial* material) {
+	for (int i = 0; i < static_cast<int>(_groups.size()); ++i) {
+		const Group& group = _groups[i];
+		if (group.flat == flat && (flat || (group.program == program && group.material == material))) {
+			return i;
+		}
+	}
+
+	Group group;
+	group.flat = flat;
+	if (flat) {
+		group.flatProgram = AcquireFlatColorProgram(false, true);
+		group.flatMultiDrawProgram = AcquireFlatColorProgram(true, true);
+		group.program = group.flatProgram.get();
+		group.multiDrawProgram = group.flatMultiDrawProgram.get();
+	}
+	else {
+		group.program = program;
+		group.multiDrawProgram = multiDrawProgram;
+		group.material = material;
+	}
+
+	_groups.push_back(std::move(group));
+	_stats.groups = static_cast<int>(_groups.size());
+	return static_cast<int>(_groups.size()) - 1;
+}
+
+void StaticBatch::bake(Object& object, std::vector<unsigned char>& data) const {
+	const size_t begin = data.size();
+
+	if (object.model != nullptr) {
+		const glm::mat4 model = object.model->getModelMatrix();
+		const glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+
+		data.resize(begin + object.vertices.size() * sizeof(Vertex));
+		Vertex* vertices = reinterpret_cast<Vertex*>(data.data() + begin);
+		for (size_t i = 0; i < object.vertices.size(); ++i) {
+			vertices[i].position = glm::vec3(model * glm::vec4(object.vertices[i].position, 1.0f));
+			vertices[i].normal = glm::normalize(normalMatrix * object.vertices[i].normal);
+			vertices[i].texCoord = object.vertices[i].texCoord;
+		}
+
+		object.worldBox = computeWorldBox(object.indices, [vertices](uint32_t index) {
+			return vertices[index].position;
+		});
+	}
+	else {
+		const uint32_t color = glm::packUnorm4x8(*object.color);
+
+		data.resize(begin + object.positions.size() * sizeof(ColoredPosition));
+		ColoredPosition* vertices = reinterpret_cast<ColoredPosition*>(data.data() + begin);
+		for (size_t i = 0; i < object.positions.size(); ++i) {
+			vertices[i].position = object.positions[i];
+			vertices[i].color = color;
+		}
+
+		object.worldBox = computeWorldBox(object.indices, [&object](uint32_t index) {
+			return object.positions[index];
+		});
+	}
+
+	object.baked = true;
+	object.dirty = false;
+}
+
+void StaticBatch::rebuildGroup(Group& group) {
+	const GeometryLayout layout = getLayout(group.flat);
+	const size_t stride = layout.getStride();
+
+	std::vector<unsigned char> vertices;
+	std::vector<uint32_t> indices;
+
+	for (int index : group.objects) {
+		Object& object = _objects[index];
+		object.firstVertex = vertices.size() / stride;
+		object.firstIndex = indices.size();
+
+		// a model still waiting for its mesh
+		if (object.indices.empty()) {
+			object.baked = false;
+			continue;
+		}
+
+		bake(object, vertices);
+		for (uint32_t vertexIndex : object.indices) {
+			indices.push_back(static_cast<uint32_t>(object.firstVertex) + vertexIndex);
+		}
+	}
+
+	// the previous allocation goes back to the arena
+	group.rebuild = false;
+	if (indices.empty()) {
+		group.geometry.reset();
+		return;
+	}
+	group.geometry = GeometryArena::getInstance().allocate(
+		layout, vertices.data(), vertices.size() / stride, indices.data(), indices.size(), GL_UNSIGNED_INT);
+}
+
+void StaticBatch::rebakeObject(Object& object) {
+	Group& group = _groups[object.group];
+	const size_t stride = getLayout(group.flat).getStride();
+
+	std::vector<unsigned char> vertices;
+	bake(object, vertices);
+	group.geometry.updateVertices(object.firstVertex, vertices.size() / stride, vertices.data());
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "./base/bounding_box.h"
+#include "./base/frustum.h"
+#include "./base/glsl_program.h"
+#include "./base/material.h"
+#include "./base/vertex.h"
+#include "geometry_arena.h"
+#include "model.h"
+#include "render_queue.h"
+
+struct StaticBatchOptions {
+	// bake the static objects of a stage, otherwise they are drawn one by one
+	bool enabled = true;
+};
+
+void SetDefaultStaticBatchOptions(const StaticBatchOptions& options);
+const StaticBatchOptions& GetDefaultStaticBatchOptions();
+
+struct StaticBatchStats {
+	int objects = 0;
+	int groups = 0;
+
+	// of the last submit()
+	int draws = 0;
+	int visibleObjects = 0;
+	int culledObjects = 0;
+	size_t faces = 0;
+
+	// since the batch was created, a rebuild lays out a whole group again
+	// while a rebake overwrites the vertices of one object in place
+	int groupRebuilds = 0;
+	int objectRebakes = 0;
+
+	// the last update() that baked anything
+	double bakeMs = 0.0;
+};
+
+// Objects that never move, their world transforms baked into merged vertex
+// and index buffers in the geometry arena, one group per program and
+// material. The flat colored primitives share a group, their colors are
+// baked into the vertices. Every object keeps its index range within its
+// group for culling, the visible ranges that follow each other go out as
+// one packet, so a fully visible group is a single draw.
+//
+// An object marked dirty is baked again into its own vertices. A group is
+// only laid out again when the geometry of one of its objects changed, e.g.
+// when a streamed mesh arrives.
+class StaticBatch {
+public:
+	StaticBatch() = default;
+
+	StaticBatch(const StaticBatch&) = delete;
+
+	// The model's mesh at full detail, drawn with its material. It is baked
+	// once the mesh is resident, the model must outlive the batch.
+	int addModel(const Model& model, GLSLProgram* program, GLSLProgram* multiDrawProgram);
+
+	// A primitive whose positions are in world space already, read back
+	// from the arena. The color is read again on every bake.
+	int addPrimitive(const GeometryAllocation& geometry, GLsizei indexCount, const glm::vec4& color);
+
+	// the object moved or changed its color, baked again by the next update()
+	void markDirty(int object);
+
+	// until then the object has to be drawn on its own
+	bool isBaked(int object) const;
+
+	void update();
+
+	// packets of the visible ranges, the depth is that of the nearest object of a range
+	void submit(RenderQueue& queue, const Frustum& frustum, const glm::mat4& view);
+
+	const StaticBatchStats& getStats() const;
+
+	size_t getGpuBytes() const;
+
+private:
+	struct Object {
+		int group = 0;
+
+		const Model* model = nullptr;
+		// the mesh the geometry was read from, a new one rebuilds the group
+		const Mesh* mesh = nullptr;
+
+		const glm::vec4* color = nullptr;
+
+		// object space geometry, kept to bake again without a read back,
+		// vertices for models and positions for primitives
+		std::vector<Vertex> vertices;
+		std::vector<glm::vec3> positions;
+		std::vector<uint32_t> indices;
+
+		// within the group's allocation
+		size_t firstVertex = 0;
+		size_t firstIndex = 0;
+
+		BoundingBox worldBox = { glm::vec3(0.0f), glm::vec3(0.0f) };
+
+		bool baked = false;
+		bool dirty = false;
+	};
+
+	struct Group {
+		bool flat = false;
+		GLSLProgram* program = nullptr;
+		GLSLProgram* multiDrawProgram = nullptr;
+		const PhongMaterial* material = nullptr;
+
+		// the vertex color programs of the flat group
+		std::shared_ptr<GLSLProgram> flatProgram;
+		std::shared_ptr<GLSLProgram> flatMultiDrawProgram;
+
+		std::vector<int> objects;
+		GeometryAllocation geometry;
+		bool rebuild = false;
+	};
+
+	std::vector<Object> _objects;
+	std::vector<Group> _groups;
+
+	StaticBatchStats _stats;
+
+	int findGroup(bool flat, GLSLProgram* program, GLSLProgram* multiDrawProgram, const PhongMaterial* material);
+
+	// the object's vertices in world space, appended to the data in the group's layout
+	void bake(Object& object, std::vector<unsigned char>& data) const;
+
+	void rebuildGroup(Group& group);
+
+	void rebakeObject(Object& object);
+};
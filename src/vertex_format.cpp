@@ -0,0 +1,195 @@
+#include <cstring>
+#include <cstddef>
+
+#include <glm/gtc/packing.hpp>
+
+#include "vertex_format.h"
+
+namespace {
+	VertexFormatOptions defaultVertexFormatOptions;
+
+	// byte offsets of the attributes within a packed vertex
+	size_t getNormalOffset(const VertexFormat& format) {
+		return format.quantizedPositions ? 4 * sizeof(uint16_t) : 3 * sizeof(float);
+	}
+
+	size_t getTexCoordOffset(const VertexFormat& format) {
+		return getNormalOffset(format) + sizeof(uint32_t);
+	}
+}
+
+void SetDefaultVertexFormatOptions(const VertexFormatOptions& options) {
+	defaultVertexFormatOptions = options;
+}
+
+const VertexFormatOptions& GetDefaultVertexFormatOptions() {
+	return defaultVertexFormatOptions;
+}
+
+GLsizei VertexFormat::getStride() const {
+	if (!packed) {
+		return sizeof(Vertex);
+	}
+	return static_cast<GLsizei>(getTexCoordOffset(*this) + 2 * sizeof(uint16_t));
+}
+
+void VertexFormat::setAttributes() const {
+	// specify layout, size of a vertex, data type, normalize, sizeof vertex array, offset of the attribute
+	if (!packed) {
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoord));
+	}
+	else {
+		const GLsizei stride = getStride();
+		if (quantizedPositions) {
+			glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)0);
+		}
+		else {
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+		}
+
+		// the shader reads the xyz of the signed normalized normal
+		glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)getNormalOffset(*this));
+
+		if (normalizedTexCoords) {
+			glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)getTexCoordOffset(*this));
+		}
+		else {
+			glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)getTexCoordOffset(*this));
+		}
+	}
+
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+}
+
+VertexFormat ChooseVertexFormat(
+	const Vertex* vertices, size_t count, const BoundingBox& boundingBox,
+	const VertexFormatOptions& options) {
+	VertexFormat format;
+	if (!options.packed) {
+		return format;
+	}
+
+	format.packed = true;
+
+	format.normalizedTexCoords = true;
+	for (size_t i = 0; i < count && format.normalizedTexCoords; ++i) {
+		const glm::vec2& uv = vertices[i].texCoord;
+		format.normalizedTexCoords = uv.x >= 0.0f && uv.x <= 1.0f && uv.y >= 0.0f && uv.y <= 1.0f;
+	}
+
+	if (options.quantizePositions) {
+		format.quantizedPositions = true;
+		format.positionOffset = boundingBox.min;
+		format.positionScale = boundingBox.max - boundingBox.min;
+	}
+
+	return format;
+}
+
+const void* PackedGeometry::getVertexData(const Vertex* source) const {
+	return format.packed ? static_cast<const void*>(vertices.data()) : static_cast<const void*>(source);
+}
+
+const void* PackedGeometry::getIndexData(const uint32_t* source) const {
+	return indexType == GL_UNSIGNED_SHORT ? static_cast<const void*>(indices.data()) : static_cast<const void*>(source);
+}
+
+PackedGeometry PackGeometry(
+	const Vertex* vertices, size_t vertexCount, const uint32_t* indices, size_t indexCount,
+	const BoundingBox& boundingBox, const VertexFormatOptions& options) {
+	PackedGeometry geometry;
+	geometry.format = ChooseVertexFormat(vertices, vertexCount, boundingBox, options);
+	if (geometry.format.packed) {
+		geometry.vertices = PackVertices(vertices, vertexCount, geometry.format);
+	}
+
+	if (options.shortIndices && vertexCount <= 65536) {
+		geometry.indexType = GL_UNSIGNED_SHORT;
+		geometry.indices.assign(indices, indices + indexCount);
+	}
+
+	return geometry;
+}
+
+std::vector<unsigned char> PackVertices(const Vertex* vertices, size_t count, const VertexFormat& format) {
+	const size_t stride = format.getStride();
+	std::vector<unsigned char> data(count * stride);
+	if (!format.packed) {
+		std::memcpy(data.data(), vertices, data.size());
+		return data;
+	}
+
+	const size_t normalOffset = getNormalOffset(format);
+	const size_t texCoordOffset = getTexCoordOffset(format);
+	const glm::vec3 inverseScale = glm::vec3(
+		format.positionScale.x > 0.0f ? 1.0f / format.positionScale.x : 0.0f,
+		format.positionScale.y > 0.0f ? 1.0f / format.positionScale.y : 0.0f,
+		format.positionScale.z > 0.0f ? 1.0f / format.positionScale.z : 0.0f);
+
+	for (size_t i = 0; i < count; ++i) {
+		const Vertex& vertex = vertices[i];
+		unsigned char* out = data.data() + i * stride;
+
+		if (format.quantizedPositions) {
+			const glm::vec3 p = (vertex.position - format.positionOffset) * inverseScale;
+			const uint16_t position[4] = {
+				glm::packUnorm1x16(p.x), glm::packUnorm1x16(p.y), glm::packUnorm1x16(p.z), 0 };
+			std::memcpy(out, position, sizeof(position));
+		}
+		else {
+			std::memcpy(out, &vertex.position, sizeof(glm::vec3));
+		}
+
+		const float length = glm::length(vertex.normal);
+		const glm::vec3 n = length > 0.0f ? vertex.normal / length : vertex.normal;
+		const uint32_t normal = glm::packSnorm3x10_1x2(glm::vec4(n, 0.0f));
+		std::memcpy(out + normalOffset, &normal, sizeof(normal));
+
+		const uint16_t texCoord[2] = {
+			format.normalizedTexCoords ? glm::packUnorm1x16(vertex.texCoord.x) : glm::packHalf1x16(vertex.texCoord.x),
+			format.normalizedTexCoords ? glm::packUnorm1x16(vertex.texCoord.y) : glm::packHalf1x16(vertex.texCoord.y) };
+		std::memcpy(out + texCoordOffset, texCoord, sizeof(texCoord));
+	}
+
+	return data;
+}
+
+void UnpackVertices(const unsigned char* data, size_t count, const VertexFormat& format, Vertex* vertices) {
+	if (!format.packed) {
+		std::memcpy(vertices, data, count * sizeof(Vertex));
+		return;
+	}
+
+	const size_t stride = format.getStride();
+	const size_t normalOffset = getNormalOffset(format);
+	const size_t texCoordOffset = getTexCoordOffset(format);
+
+	for (size_t i = 0; i < count; ++i) {
+		const unsigned char* in = data + i * stride;
+		Vertex& vertex = vertices[i];
+
+		if (format.quantizedPositions) {
+			uint16_t position[3];
+			std::memcpy(position, in, sizeof(position));
+			vertex.position = format.positionOffset + format.positionScale * glm::vec3(
+				glm::unpackUnorm1x16(position[0]), glm::unpackUnorm1x16(position[1]), glm::unpackUnorm1x16(position[2]));
+		}
+		else {
+			std::memcpy(&vertex.position, in, sizeof(glm::vec3));
+		}
+
+		uint32_t normal;
+		std::memcpy(&normal, in + normalOffset, sizeof(normal));
+		vertex.normal = glm::vec3(glm::unpackSnorm3x10_1x2(normal));
+
+		uint16_t texCoord[2];
+		std::memcpy(texCoord, in + texCoordOffset, sizeof(texCoord));
+		vertex.texCoord = format.normalizedTexCoords ?
+			glm::vec2(glm::unpackUnorm1x16(texCoord[0]), glm::unpackUnorm1x16(texCoord[1])) :
+			glm::vec2(glm::unpackHalf1x16(texCoord[0]), glm::unpackHalf1x16(texCoord[1]));
+	}
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "./base/vertex.h"
+#include "./base/bounding_box.h"
+
+struct VertexFormatOptions {
+	// GL_INT_2_10_10_10_REV normals and 16 bit texcoords, otherwise 32 byte float vertices
+	bool packed = true;
+
+	// unorm16 positions within the bounding box, the vertex shader scales them
+	// back with positionOffset and positionScale
+	bool quantizePositions = false;
+
+	// 16 bit indices for meshes with at most 65536 vertices
+	bool shortIndices = true;
+};
+
+// options used when meshes are uploaded
+void SetDefaultVertexFormatOptions(const VertexFormatOptions& options);
+const VertexFormatOptions& GetDefaultVertexFormatOptions();
+
+// Layout of the vertices of one mesh in its vertex buffer. Packed vertices
+// are 20 bytes, 16 with quantized positions, instead of the 32 of Vertex.
+struct VertexFormat {
+	bool packed = false;
+	bool quantizedPositions = false;
+
+	// unorm16 when every texcoord lies in [0, 1], half floats otherwise
+	bool normalizedTexCoords = false;
+
+	// object space position = positionOffset + positionScale * stored position
+	glm::vec3 positionOffset = glm::vec3(0.0f);
+	glm::vec3 positionScale = glm::vec3(1.0f);
+
+	GLsizei getStride() const;
+
+	// set up attributes 0 - 2 of the bound vertex array for the bound vertex buffer
+	void setAttributes() const;
+};
+
+// the most compact format the options allow for these vertices
+VertexFormat ChooseVertexFormat(
+	const Vertex* vertices, size_t count, const BoundingBox& boundingBox,
+	const VertexFormatOptions& options);
+
+// Buffer contents of a mesh in the chosen format, ready for glBufferData.
+// The arrays stay empty where the source arrays can be uploaded as they are.
+struct PackedGeometry {
+	VertexFormat format;
+	GLenum indexType = GL_UNSIGNED_INT;
+	std::vector<unsigned char> vertices;
+	std::vector<uint16_t> indices;
+
+	// the buffer contents, the source arrays where nothing was packed
+	const void* getVertexData(const Vertex* source) const;
+
+	const void* getIndexData(const uint32_t* source) const;
+};
+
+// choose the formats and pack, does not touch opengl
+PackedGeometry PackGeometry(
+	const Vertex* vertices, size_t vertexCount, const uint32_t* indices, size_t indexCount,
+	const BoundingBox& boundingBox, const VertexFormatOptions& options);
+
+std::vector<unsigned char> PackVertices(const Vertex* vertices, size_t count, const VertexFormat& format);
+
+void UnpackVertices(const unsigned char* data, size_t count, const VertexFormat& format, Vertex* vertices);
@@ -0,0 +1,267 @@
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#include "./base/thread_pool.h"
+#include "vertex_indexer.h"
+
+namespace {
+	// corners from which the sort path pays for its threads
+	constexpr size_t kSortThreshold = 1 << 21;
+
+	// bits per attribute index in a packed sort key
+	constexpr int kKeyBits = 21;
+
+	constexpr uint32_t kEmpty = UINT32_MAX;
+
+	inline uint64_t mix(uint64_t x) {
+		x ^= x >> 33;
+		x *= 0xff51afd7ed558ccdull;
+		x ^= x >> 33;
+		x *= 0xc4ceb9fe1a85ec53ull;
+		x ^= x >> 33;
+		return x;
+	}
+
+	// -0 and +0 compare equal, so they must hash equal as well
+	inline uint64_t floatBits(float value) {
+		if (value == 0.0f) {
+			value = 0.0f;
+		}
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	struct Vec2Hash {
+		uint64_t operator()(const glm::vec2& v) const {
+			return mix(floatBits(v.x) | floatBits(v.y) << 32);
+		}
+	};
+
+	struct Vec3Hash {
+		uint64_t operator()(const glm::vec3& v) const {
+			return mix(mix(floatBits(v.x) | floatBits(v.y) << 32) ^ floatBits(v.z));
+		}
+	};
+
+	struct Triplet {
+		uint32_t position;
+		uint32_t texCoord;
+		uint32_t normal;
+
+		bool operator==(const Triplet& rhs) const {
+			return position == rhs.position && texCoord == rhs.texCoord && normal == rhs.normal;
+		}
+	};
+
+	struct TripletHash {
+		uint64_t operator()(const Triplet& t) const {
+			return mix(mix(t.position | static_cast<uint64_t>(t.texCoord) << 32) ^ t.normal);
+		}
+	};
+
+	// open addressing map from keys to ids numbered in insertion order,
+	// linear probing over a power of two table that is kept at most half full
+	template <typename Key, typename Hash>
+	class FlatIdMap {
+	public:
+		explicit FlatIdMap(size_t expectedCount) {
+			size_t capacity = 16;
+			while (capacity < expectedCount * 2) {
+				capacity *= 2;
+			}
+			_slots.resize(capacity);
+		}
+
+		// the id of the key, the next free id if it was not seen before
+		uint32_t insert(const Key& key) {
+			if ((_count + 1) * 2 > _slots.size()) {
+				grow();
+			}
+
+			const size_t mask = _slots.size() - 1;
+			for (size_t i = Hash()(key) & mask;; i = (i + 1) & mask) {
+				Slot& slot = _slots[i];
+				if (slot.id == kEmpty) {
+					slot.key = key;
+					slot.id = _count++;
+					return slot.id;
+				}
+				if (slot.key == key) {
+					return slot.id;
+				}
+			}
+		}
+
+		uint32_t size() const {
+			return _count;
+		}
+
+	private:
+		struct Slot {
+			Key key;
+			uint32_t id = kEmpty;
+		};
+
+		std::vector<Slot> _slots;
+		uint32_t _count = 0;
+
+		void grow() {
+			std::vector<Slot> slots(_slots.size() * 2);
+			const size_t mask = slots.size() - 1;
+			for (const Slot& slot : _slots) {
+				if (slot.id != kEmpty) {
+					size_t i = Hash()(slot.key) & mask;
+					while (slots[i].id != kEmpty) {
+						i = (i + 1) & mask;
+					}
+					slots[i] = slot;
+				}
+			}
+			_slots.swap(slots);
+		}
+	};
+
+	// map every attribute to the id of its value, equal values share an id
+	template <typename T, typename Hash>
+	std::vector<uint32_t> foldAttributes(const std::vector<T>& attributes, uint32_t& distinctCount) {
+		FlatIdMap<T, Hash> ids(attributes.size());
+		std::vector<uint32_t> remap(attributes.size());
+		for (size_t i = 0; i < attributes.size(); ++i) {
+			remap[i] = ids.insert(attributes[i]);
+		}
+		distinctCount = ids.size();
+		return remap;
+	}
+
+	// sort the chunks in parallel, then merge pairs of them level by level;
+	// within a task of a thread pool the chunks go to its idle workers
+	template <typename T, typename Less>
+	void parallelSort(std::vector<T>& items, size_t numThreads, Less less) {
+		std::vector<size_t> bounds;
+		for (size_t i = 0; i <= numThreads; ++i) {
+			bounds.push_back(items.size() * i / numThreads);
+		}
+
+		ParallelFor(numThreads, static_cast<int>(numThreads), [&](size_t i) {
+			std::sort(items.begin() + bounds[i], items.begin() + bounds[i + 1], less);
+		});
+
+		std::vector<T> buffer(items.size());
+		while (bounds.size() > 2) {
+			const size_t pairs = (bounds.size() - 1) / 2;
+			ParallelFor(pairs, static_cast<int>(numThreads), [&](size_t pair) {
+				const size_t i = pair * 2;
+				std::merge(items.begin() + bounds[i], items.begin() + bounds[i + 1],
+					items.begin() + bounds[i + 1], items.begin() + bounds[i + 2], buffer.begin() + bounds[i], less);
+			});
+
+			std::vector<size_t> merged;
+			size_t i = 0;
+			for (; i + 2 < bounds.size(); i += 2) {
+				merged.push_back(bounds[i]);
+			}
+
+			// an odd chunk out moves up a level as it is
+			if (i + 1 < bounds.size()) {
+				std::copy(items.begin() + bounds[i], items.end(), buffer.begin() + bounds[i]);
+				merged.push_back(bounds[i]);
+			}
+			merged.push_back(items.size());
+
+			items.swap(buffer);
+			bounds.swap(merged);
+		}
+	}
+}
+
+bool IndexObjVertices(
+	const attrib_t& attrib, const index_t& index,
+	std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+	int numThreads) {
+	uint32_t positionCount = 0, texCoordCount = 0, normalCount = 0;
+	const std::vector<uint32_t> positions = foldAttributes<glm::vec3, Vec3Hash>(attrib.vertexPosition, positionCount);
+	const std::vector<uint32_t> texCoords = foldAttributes<glm::vec2, Vec2Hash>(attrib.vertexTexcoord, texCoordCount);
+	const std::vector<uint32_t> normals = foldAttributes<glm::vec3, Vec3Hash>(attrib.vertexNormal, normalCount);
+
+	const size_t faceCount = index.positionIndex.size();
+	const size_t cornerCount = faceCount * 3;
+
+	// the corners of a face in the order x, y, z
+	auto getTriplet = [&](size_t corner) {
+		const int k = static_cast<int>(corner % 3);
+		return Triplet{
+			positions[index.positionIndex[corner / 3][k]],
+			texCoords[index.texcoordIndex[corner / 3][k]],
+			normals[index.normalIndex[corner / 3][k]] };
+	};
+
+	auto makeVertex = [&](size_t corner) {
+		const int k = static_cast<int>(corner % 3);
+		Vertex vertex{};
+		vertex.position = attrib.vertexPosition[index.positionIndex[corner / 3][k]];
+		vertex.normal = attrib.vertexNormal[index.normalIndex[corner / 3][k]];
+		vertex.texCoord = attrib.vertexTexcoord[index.texcoordIndex[corner / 3][k]];
+		return vertex;
+	};
+
+	vertices.clear();
+	indices.resize(cornerCount);
+
+	const size_t threadCount = numThreads > 0 ?
+		static_cast<size_t>(numThreads) : std::max(1u, std::thread::hardware_concurrency());
+	const bool packable =
+		positionCount <= (1u << kKeyBits) && texCoordCount <= (1u << kKeyBits) && normalCount <= (1u << kKeyBits);
+
+	if (cornerCount >= kSortThreshold && threadCount > 1 && packable) {
+		// sort the corners by triplet, ties by corner, so the first corner of
+		// each run is where that vertex first appears
+		struct Corner {
+			uint64_t key;
+			uint32_t index;
+		};
+
+		std::vector<Corner> corners(cornerCount);
+		for (size_t i = 0; i < cornerCount; ++i) {
+			const Triplet t = getTriplet(i);
+			corners[i].key = static_cast<uint64_t>(t.position) << (2 * kKeyBits) |
+				static_cast<uint64_t>(t.texCoord) << kKeyBits | t.normal;
+			corners[i].index = static_cast<uint32_t>(i);
+		}
+
+		parallelSort(corners, threadCount, [](const Corner& a, const Corner& b) {
+			return a.key < b.key || (a.key == b.key && a.index < b.index);
+		});
+
+		std::vector<uint32_t> firstCorner(cornerCount);
+		for (size_t begin = 0, end = 0; begin < cornerCount; begin = end) {
+			while (end < cornerCount && corners[end].key == corners[begin].key) {
+				firstCorner[corners[end++].index] = corners[begin].index;
+			}
+		}
+
+		// number the vertices in the order of their first corner
+		for (size_t i = 0; i < cornerCount; ++i) {
+			if (firstCorner[i] == i) {
+				indices[i] = static_cast<uint32_t>(vertices.size());
+				vertices.push_back(makeVertex(i));
+			}
+			else {
+				indices[i] = indices[firstCorner[i]];
+			}
+		}
+		return true;
+	}
+	else {
+		// a closed mesh has about half as many vertices as faces, seams add more
+		FlatIdMap<Triplet, TripletHash> ids(faceCount);
+		for (size_t i = 0; i < cornerCount; ++i) {
+			indices[i] = ids.insert(getTriplet(i));
+			if (indices[i] == vertices.size()) {
+				vertices.push_back(makeVertex(i));
+			}
+		}
+		return false;
+	}
+}
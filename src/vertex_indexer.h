@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "obj_loader.h"
+#include "base/vertex.h"
+
+// Turn the per corner (v, vt, vn) indices of an obj into an indexed vertex
+// array. Equal attributes are folded to one index first, so that corners
+// compare by integer triplet and still merge exactly like equal Vertex values;
+// vertices are numbered in the order they first appear. Large meshes are
+// sorted on several threads, or on the idle workers of the calling thread
+// pool, the rest go through a flat hash table sized from the face count.
+// numThreads 0 means one per core. Returns true if the corners were sorted.
+bool IndexObjVertices(
+	const attrib_t& attrib, const index_t& index,
+	std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+	int numThreads = 0);
@@ -1,6 +1,13 @@
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <unordered_set>
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
+#include "./base/gl_state.h"
+#include "instance_batch.h"
+#include "shader_registry.h"
 #include "whack_moles.h"
 
 const std::string modelPath = "./media/gopher.obj";
@@ -19,15 +26,10 @@ const std::vector<std::string> skyboxPaths = {
 	"./media/field/negz.jpg"
 };
 
-void WhackMoles::init(Window& window, MouseInput& mouseInput) {
+void WhackMoles::load(Window& window, AssetLoader& assetLoader) {
 	int windowWidth = window.getWidth();
 	int windowHeight = window.getHeight();
 
-	// set input mode
-	mouseInput.move.xOld = mouseInput.move.xCurrent = 0.5 * windowWidth;
-	mouseInput.move.yOld = mouseInput.move.yCurrent = 0.5 * windowHeight;
-	glfwSetCursorPos(window.getHandle(), mouseInput.move.xCurrent, mouseInput.move.yCurrent);
-
 	// init cameras
 	_cameras.resize(2);
 
@@ -46,25 +48,24 @@ void WhackMoles::init(Window& window, MouseInput& mouseInput) {
 		glm::radians(60.0f), aspect, 0.1f, 10000.0f));
 	_cameras[1]->position = glm::vec3(0.0f, 3.0f, 15.0f);
 
-	_skybox.reset(new SkyBox(skyboxPaths));
+	// created once the cubemap is resident
+	_skyboxTexture = assetLoader.loadCubemap(skyboxPaths);
 
-	// init model
+	// init model, the meshes stream in
+	AssetHandle<const Mesh> gopherMesh = assetLoader.loadMesh(modelPath);
 	_models.resize(10);
 	for (int i = 0; i < 9; i++) {
-		_models[i].reset(new Model(modelPath));
+		_models[i].reset(new Model);
+		_pendingMeshes.emplace_back(_models[i].get(), gopherMesh);
 		_models[i]->scale = glm::vec3(0.9f, 0.9f, 0.9f);
 		_models[i]->position = glm::vec3(i / 3 * 5.0f - 5.0f, -4.0f, i % 3 * 5.0f - 5.0f);
 	}
-	_models[9].reset(new Model(holePath));
+	_models[9].reset(new Model);
+	_pendingMeshes.emplace_back(_models[9].get(), assetLoader.loadMesh(holePath));
 	_models[9]->scale = glm::vec3(0.5f, 0.5f, 0.5f);
 	_models[9]->position = glm::vec3(0.0f, 0.0f, 0.0f);
 
 
-	// init textures
-	std::shared_ptr<Texture2D> gopherTexture = std::make_shared<Texture2D>(gopherTexturePath);
-	std::shared_ptr<Texture2D> stoneTexture = std::make_shared<Texture2D>(stoneTexturePath);
-
-
 	// init materials
 	_materials.resize(2);
 	for (int i = 0; i < _materials.size(); i++) {
@@ -74,8 +75,14 @@ void WhackMoles::init(Window& window, MouseInput& mouseInput) {
 		_materials[i]->ks = glm::vec3(1.0f, 1.0f, 1.0f);
 		_materials[i]->ns = 10.0f;
 	}
-	_materials[0]->mapKd = gopherTexture;
-	_materials[1]->mapKd = stoneTexture;
+	_pendingTextures.emplace_back(_materials[0].get(), assetLoader.loadTexture(gopherTexturePath));
+	_pendingTextures.emplace_back(_materials[1].get(), assetLoader.loadTexture(stoneTexturePath));
+
+	// the nine gophers share one mesh and one material
+	for (int i = 0; i < 9; i++) {
+		_models[i]->material = _materials[0];
+	}
+	_models[9]->material = _materials[1];
 	
 	// init lights
 	_ambientLight.reset(new AmbientLight);
@@ -96,10 +103,101 @@ void WhackMoles::init(Window& window, MouseInput& mouseInput) {
 	// init shader
 	initPhongShader();
 
+	const InstancingOptions& instancingOptions = GetDefaultInstancingOptions();
+	_instancing = instancingOptions.enabled;
+	_stressInstances = instancingOptions.stressInstances;
+
+	// camera and light blocks shared by the stage's programs
+	_frameUniforms.reset(new UniformBuffer(kFrameDataBinding, sizeof(FrameData)));
+	_lightUniforms.reset(new UniformBuffer(kLightDataBinding, sizeof(LightData)));
 }
 
-void WhackMoles::deinit() {
+bool WhackMoles::updateAssets() {
+	for (auto it = _pendingMeshes.begin(); it != _pendingMeshes.end();) {
+		if (it->second.isReady()) {
+			it->first->setMesh(it->second.get());
+			it = _pendingMeshes.erase(it);
+		} else {
+			++it;
+		}
+	}
+
+	for (auto it = _pendingTextures.begin(); it != _pendingTextures.end();) {
+		if (it->second.isReady()) {
+			it->first->mapKd = it->second.get();
+			it = _pendingTextures.erase(it);
+		} else {
+			++it;
+		}
+	}
 
+	if (_gopherBatch == nullptr && _models[0]->hasMesh()) {
+		_gopherBatch.reset(new InstanceBatch(_models[0]->getMesh()));
+	}
+
+	if (_skybox == nullptr && _skyboxTexture.isReady()) {
+		_skybox.reset(new SkyBox(_skyboxTexture.get()));
+		_skyboxTexture = AssetHandle<TextureCubemap>();
+	}
+
+	return _pendingMeshes.empty() && _pendingTextures.empty() && _skybox != nullptr;
+}
+
+void WhackMoles::activate(Window& window, MouseInput& mouseInput) {
+	// set input mode
+	mouseInput.move.xOld = mouseInput.move.xCurrent = 0.5 * window.getWidth();
+	mouseInput.move.yOld = mouseInput.move.yCurrent = 0.5 * window.getHeight();
+	glfwSetCursorPos(window.getHandle(), mouseInput.move.xCurrent, mouseInput.move.yCurrent);
+
+	// the other stages use the same binding points
+	_frameUniforms->bind();
+	_lightUniforms->bind();
+}
+
+void WhackMoles::unload() {
+	_cameras.clear();
+	_models.clear();
+	_materials.clear();
+	_skybox.reset();
+
+	_ambientLight.reset();
+	_directionalLight.reset();
+	_spotLight.reset();
+
+	_gopherBatch.reset();
+	_phongShader.reset();
+	_instancedPhongShader.reset();
+	_frameUniforms.reset();
+	_lightUniforms.reset();
+
+	_pendingMeshes.clear();
+	_pendingTextures.clear();
+	_skyboxTexture = AssetHandle<TextureCubemap>();
+}
+
+size_t WhackMoles::getResidentBytes() const {
+	// meshes, textures and the skybox, the shader is a few KB
+	size_t bytes = _skybox != nullptr ? _skybox->getGpuBytes() : 0;
+
+	// the nine gophers count once
+	std::unordered_set<const Mesh*> meshes;
+	for (const auto& model : _models) {
+		if (model->hasMesh() && meshes.insert(model->getMesh().get()).second) {
+			bytes += model->getMesh()->getGpuBytes();
+		}
+	}
+
+	for (const auto& material : _materials) {
+		if (material->mapKd != nullptr) {
+			bytes += material->mapKd->getGpuBytes();
+		}
+	}
+
+	if (_gopherBatch != nullptr) {
+		bytes += _gopherBatch->getGpuBytes();
+	}
+
+	return bytes;
 }
 
 void WhackMoles::handleInput(
@@ -250,53 +348,116 @@ void WhackMoles::renderFrame() {
 
 	glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glEnable(GL_DEPTH_TEST);
-
-	glm::mat4 projection = _cameras[activeCameraIndex]->getProjectionMatrix();
-	glm::mat4 view = _cameras[activeCameraIndex]->getViewMatrix();
-
-	_phongShader->use();
-	_phongShader->setMat4("projection", projection);
-	_phongShader->setMat4("view", view);
-
-	// 2. transfer light attributes to the shader
-	_phongShader->setVec3("ambientLight.color", _ambientLight->color);
-	_phongShader->setFloat("ambientLight.intensity", _ambientLight->intensity);
-	_phongShader->setVec3("spotLight.position", _spotLight->position);
-	_phongShader->setVec3("spotLight.direction", _spotLight->getFront());
-	_phongShader->setFloat("spotLight.intensity", _spotLight->intensity);
-	_phongShader->setVec3("spotLight.color", _spotLight->color);
-	_phongShader->setFloat("spotLight.angle", _spotLight->angle);
-	_phongShader->setFloat("spotLight.kc", _spotLight->kc);
-	_phongShader->setFloat("spotLight.kl", _spotLight->kl);
-	_phongShader->setFloat("spotLight.kq", _spotLight->kq);
-	_phongShader->setVec3("directionalLight.direction", _directionalLight->getFront());
-	_phongShader->setFloat("directionalLight.intensity", _directionalLight->intensity);
-	_phongShader->setVec3("directionalLight.color", _directionalLight->color);
-
-	// 3. transfer view position to the shader
-	_phongShader->setVec3("eye.position", _cameras[activeCameraIndex]->position);
-
-	_phongShader->setVec3("material.ka", _materials[0]->ka);
-	_phongShader->setVec3("material.kd", _materials[0]->kd);
-	_phongShader->setVec3("material.ks", _materials[0]->ks);
-	_phongShader->setFloat("material.ns", _materials[0]->ns);
-
-	glActiveTexture(GL_TEXTURE0);
-	_materials[0]->mapKd->bind();
+	// the tracker skips what the previous frame already set
+	GLState& glState = GLState::getInstance();
+	glState.enable(GL_DEPTH_TEST);
+
+	// camera and lights go to the shared uniform blocks, uploaded only when they changed
+	const FrameData frameData = MakeFrameData(*_cameras[activeCameraIndex]);
+	const LightData lightData = MakeLightData(*_ambientLight, *_directionalLight, *_spotLight);
+	_frameUniforms->update(&frameData);
+	_lightUniforms->update(&lightData);
+
+	const glm::mat4& projection = frameData.projection;
+	const glm::mat4& view = frameData.view;
+
+	// levels of detail are picked against the current viewport
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	size_t drawnFaces = 0;
+	size_t fullFaces = 0;
+
+	// models whose bounding box is outside the view are not submitted
+	const Frustum frustum = _cameras[activeCameraIndex]->getFrustum();
+	int visibleModels = 0;
+	int culledModels = 0;
+
+	// the gophers share a mesh and a material, instanced they go out in one
+	// draw at the finest level any of them picked
+	const auto submitStart = std::chrono::high_resolution_clock::now();
+	const bool instancing = _instancing && _gopherBatch != nullptr;
+	if (instancing) {
+		_gopherBatch->clear();
+	}
+	int gopherLod = std::numeric_limits<int>::max();
 
-	for (int i = 0; i < 9; i++) {
-		_phongShader->setMat4("model", _models[i]->getModelMatrix());
-		_models[i]->draw();
+	for (int i = 0; i < _models.size(); i++) {
+		const PhongMaterial* material = _models[i]->material.get();
+		// still streaming in
+		if (!_models[i]->hasMesh() || material->mapKd == nullptr) {
+			continue;
+		}
+
+		if (!frustum.intersect(_models[i]->getBoundingBox(), _models[i]->getModelMatrix())) {
+			++culledModels;
+			continue;
+		}
+		++visibleModels;
+
+		_models[i]->updateLod(view, projection, viewport[3]);
+		drawnFaces += _models[i]->getLodFaceCount();
+		fullFaces += _models[i]->getFaceCount();
+
+		if (i < 9) {
+			gopherLod = std::min(gopherLod, _models[i]->getLod());
+			if (instancing) {
+				_gopherBatch->add(_models[i]->getModelMatrix());
+				continue;
+			}
+		}
+
+		_renderQueue.submit(*_models[i], _phongShader.get(), view, _instancedPhongShader.get());
 	}
 
-	glActiveTexture(GL_TEXTURE0);
-	_materials[1]->mapKd->bind();
-	_phongShader->setMat4("model", _models[9]->getModelMatrix());
-	_models[9]->draw();
+	if (gopherLod == std::numeric_limits<int>::max()) {
+		gopherLod = 0;
+	}
 
+	// stress test, a grid of tinted gophers behind the field, one draw or a packet each
+	if (_stressInstances > 0 && _gopherBatch != nullptr && _materials[0]->mapKd != nullptr) {
+		const Mesh& mesh = *_gopherBatch->getMesh();
+		const BoundingBox box = mesh.getBoundingBox();
+		const size_t lodFaces = mesh.getLod(gopherLod).indexCount / 3;
+		const int side = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(_stressInstances))));
+
+		for (int i = 0; i < _stressInstances; ++i) {
+			const int column = i % side;
+			const int row = i / side;
+
+			glm::mat4 model(0.9f);
+			model[3] = glm::vec4((column - side / 2) * 3.0f, -4.0f, -10.0f - row * 3.0f, 1.0f);
+			if (!frustum.intersect(box, model)) {
+				++culledModels;
+				continue;
+			}
+			++visibleModels;
+			drawnFaces += lodFaces;
+			fullFaces += mesh.getFaceCount();
 
-	_skybox->draw(projection, view);
+			if (instancing) {
+				const float t = static_cast<float>(column + row) / side;
+				_gopherBatch->add(model, glm::vec4(1.0f, 0.6f + 0.4f * t, 1.0f - 0.4f * t, 1.0f));
+			}
+			else {
+				_renderQueue.submit(mesh, gopherLod, _phongShader.get(), _materials[0].get(), model, view,
+					_instancedPhongShader.get());
+			}
+		}
+	}
+
+	if (instancing && _gopherBatch->getInstanceCount() > 0) {
+		_gopherBatch->upload();
+		_renderQueue.submit(*_gopherBatch, gopherLod, _instancedPhongShader.get(), _materials[0].get());
+	}
+
+	if (_skybox != nullptr) {
+		_renderQueue.submit(*_skybox);
+	}
+
+	_renderQueue.execute();
+
+	_submitMs = std::chrono::duration<double, std::milli>(
+		std::chrono::high_resolution_clock::now() - submitStart).count();
 
 	// draw ui elements
 	ImGui_ImplOpenGL3_NewFrame();
@@ -338,6 +499,46 @@ void WhackMoles::renderFrame() {
 		ImGui::SliderFloat("angle##3", (float*)&_spotLight->angle, 0.0f, glm::radians(180.0f), "%f rad");
 		ImGui::NewLine();
 
+		ImGui::Text("frustum culling");
+		ImGui::Separator();
+		ImGui::Text("visible: %d, culled: %d", visibleModels, culledModels);
+		ImGui::NewLine();
+
+		ImGui::Text("level of detail");
+		ImGui::Separator();
+		ImGui::Text("triangles: %zu of %zu", drawnFaces, fullFaces);
+		ImGui::NewLine();
+
+		const GLStateStats& glStats = glState.getFrameStats();
+		ImGui::Text("gl state");
+		ImGui::Separator();
+		ImGui::Text("calls: %d issued, %d elided", glStats.issued, glStats.elided);
+		ImGui::NewLine();
+
+		_renderQueue.drawStatsGui();
+
+		ImGui::Text("geometry arena");
+		ImGui::Separator();
+		for (const GeometryPoolReport& pool : GeometryArena::getInstance().getReport()) {
+			ImGui::Text("%s pool, %d byte vertices: %d allocations, %d free ranges",
+				pool.positionsOnly ? "position" : "mesh", pool.stride, pool.allocations, pool.freeRanges);
+			ImGui::Text("  vertices %zu of %zu, indices %zu of %zu KB",
+				pool.vertexUsed, pool.vertexCapacity, pool.indexUsedBytes / 1024, pool.indexCapacityBytes / 1024);
+		}
+		if (ImGui::Button("defragment")) {
+			GeometryArena::getInstance().defragment();
+		}
+		ImGui::NewLine();
+
+		const RenderQueueStats& queueStats = _renderQueue.getStats();
+		ImGui::Text("instancing");
+		ImGui::Separator();
+		ImGui::Checkbox("instanced draw", &_instancing);
+		ImGui::SliderInt("stress instances", &_stressInstances, 0, 20000);
+		ImGui::Text("instances: %d in %d draws", queueStats.instances, queueStats.drawCalls);
+		ImGui::Text("cpu submit: %.3f ms", _submitMs);
+		ImGui::NewLine();
+
 		ImGui::End();
 	}
 
@@ -356,15 +557,26 @@ void WhackMoles::initPhongShader() {
 		"out vec3 fNormal;\n"
 		"out vec2 fTexCoord;\n"
 
+		"#ifdef INSTANCED\n"
+		INSTANCE_DATA_GLSL
+		"out vec4 fTint;\n"
+		"#else\n"
 		"uniform mat4 model;\n"
-		"uniform mat4 view;\n"
-		"uniform mat4 projection;\n"
+		"#endif\n"
+		FRAME_DATA_GLSL
+		"uniform vec3 positionOffset;\n"
+		"uniform vec3 positionScale;\n"
 
 		"void main() {\n"
-		"	fPosition = vec3(model * vec4(aPosition, 1.0f));\n"
+		"#ifdef INSTANCED\n"
+		"	mat4 model = aInstanceModel;\n"
+		"	fTint = aInstanceTint;\n"
+		"#endif\n"
+		"	vec3 position = positionOffset + positionScale * aPosition;\n"
+		"	fPosition = vec3(model * vec4(position, 1.0f));\n"
 		"	fNormal = mat3(transpose(inverse(model))) * aNormal;\n"
 		"	fTexCoord = aTexCoord;\n"
-		"	gl_Position = projection * view * model * vec4(aPosition, 1.0f);\n"
+		"	gl_Position = projection * view * model * vec4(position, 1.0f);\n"
 		"}\n";
 
 
@@ -373,6 +585,9 @@ void WhackMoles::initPhongShader() {
 		"in vec3 fPosition;\n"
 		"in vec3 fNormal;\n"
 		"in vec2 fTexCoord;\n"
+		"#ifdef INSTANCED\n"
+		"in vec4 fTint;\n"
+		"#endif\n"
 		"out vec4 color;\n"
 
 		"// material data structure declaration\n"
@@ -383,42 +598,12 @@ void WhackMoles::initPhongShader() {
 		"	float ns;\n"
 		"};\n"
 
-		"// ambient light data structure declaration\n"
-		"struct AmbientLight {\n"
-		"	vec3 color;\n"
-		"	float intensity;\n"
-		"};\n"
-
-		"// directional light data structure declaration\n"
-		"struct DirectionalLight {\n"
-		"	vec3 direction;\n"
-		"	float intensity;\n"
-		"	vec3 color;\n"
-		"};\n"
-
-		"// spot light data structure declaration\n"
-		"struct SpotLight {\n"
-		"	vec3 position;\n"
-		"	vec3 direction;\n"
-		"	float intensity;\n"
-		"	vec3 color;\n"
-		"	float angle;\n"
-		"	float kc;\n"
-		"	float kl;\n"
-		"	float kq;\n"
-		"};\n"
-
-		"// view data structure declaration\n"
-		"struct Eye {\n"
-		"	vec3 position;\n"
-		"};\n"
+		"// camera and light data shared by every program\n"
+		FRAME_DATA_GLSL
+		LIGHT_DATA_GLSL
 
 		"// uniform variables\n"
 		"uniform Material material;\n"
-		"uniform AmbientLight ambientLight;\n"
-		"uniform DirectionalLight directionalLight;\n"
-		"uniform SpotLight spotLight;\n"
-		"uniform Eye eye;\n"
 		"uniform sampler2D mapKd;\n"
 
 		"vec3 calcAmbient() {\n"
@@ -448,7 +633,7 @@ void WhackMoles::initPhongShader() {
 		"	vec3 spotlightDir = normalize(spotLight.position - fPosition);\n"
 		"	vec3 direreflectDir = reflect(-direlightDir, normal);\n"
 		"	vec3 spotreflectDir = reflect(-spotlightDir, normal);\n"
-		"	vec3 viewDir = normalize(eye.position - fPosition);\n"
+		"	vec3 viewDir = normalize(eyePosition - fPosition);\n"
 
 		"	vec3 directionalSpec = directionalLight.intensity * directionalLight.color * pow(max(dot(direreflectDir, viewDir), 0.0f), material.ns) * material.ks; \n"
 
@@ -471,11 +656,13 @@ void WhackMoles::initPhongShader() {
 		"	vec4 result;\n"
 		"	result = vec4(calcAmbient() + calcDiffuse(normal) + calcSpecular(normal), 1.0f);\n"
 		"	color = texture(mapKd, fTexCoord) * result;\n"
+		"#ifdef INSTANCED\n"
+		"	color *= fTint;\n"
+		"#endif\n"
 		"}\n";
 
 
-	_phongShader.reset(new GLSLProgram);
-	_phongShader->attachVertexShader(vsCode);
-	_phongShader->attachFragmentShader(fsCode);
-	_phongShader->link();
+	// both stages use the same sources and so share the program
+	_phongShader = ShaderRegistry::getInstance().acquire(vsCode, fsCode);
+	_instancedPhongShader = ShaderRegistry::getInstance().acquire(vsCode, fsCode, { "INSTANCED" });
 }
\ No newline at end of file
@@ -7,7 +7,12 @@
 #include "./base/camera.h"
 #include "./base/light.h"
 #include "./base/glsl_program.h"
+#include "./base/uniform_buffer.h"
+#include "./base/texture.h"
 #include "model.h"
+#include "asset_loader.h"
+#include "instance_batch.h"
+#include "render_queue.h"
 #include "./base/material.h"
 #include "./base/skybox.h"
 
@@ -18,9 +23,15 @@ public:
 
 	~WhackMoles() = default;
 
-	void init(Window& window, MouseInput& mouseInput) override;
+	void load(Window& window, AssetLoader& assetLoader) override;
 
-	void deinit() override;
+	bool updateAssets() override;
+
+	void activate(Window& window, MouseInput& mouseInput) override;
+
+	void unload() override;
+
+	size_t getResidentBytes() const override;
 
 	void handleInput(
 		Window& window,
@@ -30,18 +41,44 @@ public:
 	void renderFrame() override;
 
 private:
+	// assets streaming in, bound by updateAssets() once resident
+	std::vector<std::pair<Model*, AssetHandle<const Mesh>>> _pendingMeshes;
+	std::vector<std::pair<PhongMaterial*, AssetHandle<Texture2D>>> _pendingTextures;
+	AssetHandle<TextureCubemap> _skyboxTexture;
+
 	// 3D objects
 	std::vector<std::unique_ptr<Camera>> _cameras;
 	int activeCameraIndex = 0;
 
 	std::vector<std::unique_ptr<Model>> _models;
-	std::vector<std::unique_ptr<PhongMaterial>> _materials;
+	std::vector<std::shared_ptr<PhongMaterial>> _materials;
 
 	std::unique_ptr<AmbientLight> _ambientLight;
 	std::unique_ptr<DirectionalLight> _directionalLight;
 	std::unique_ptr<SpotLight> _spotLight;
 
-	std::unique_ptr<GLSLProgram> _phongShader;
+	// per frame camera and light data
+	std::unique_ptr<UniformBuffer> _frameUniforms;
+	std::unique_ptr<UniformBuffer> _lightUniforms;
+
+	std::shared_ptr<GLSLProgram> _phongShader;
+
+	// the phong program with the INSTANCED define, for the gopher batch and
+	// the multi draw indirect path
+	std::shared_ptr<GLSLProgram> _instancedPhongShader;
+
+	// the gophers and the stress test instances in one draw, created once
+	// the gopher mesh is resident
+	std::unique_ptr<InstanceBatch> _gopherBatch;
+
+	bool _instancing = true;
+	int _stressInstances = 0;
+
+	// building and submitting the draws of the last frame
+	double _submitMs = 0.0;
+
+	// draws of the frame, sorted by state and depth
+	RenderQueue _renderQueue;
 
 	std::unique_ptr<SkyBox> _skybox;
 